@@ -63,6 +63,24 @@ struct lttng_calibrate {
  */
 extern int lttng_session_daemon_alive(void);
 
+/*
+ * Open a connection to the session daemon which is kept open and used by the
+ * following commands of the *current* flow of execution instead of connecting
+ * for each of them, until lttng_session_daemon_disconnect() is called. The
+ * session daemon closes it after a failed command, in which case the next
+ * command reconnects.
+ *
+ * On success, returns 0 else a negative LTTng error code.
+ */
+extern int lttng_session_daemon_connect(void);
+
+/*
+ * Close the connection opened by lttng_session_daemon_connect(). Calls nest,
+ * the connection is closed by the call matching the first
+ * lttng_session_daemon_connect().
+ */
+extern void lttng_session_daemon_disconnect(void);
+
 /*
  * Set the tracing group for the *current* flow of execution.
  *
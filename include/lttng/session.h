@@ -116,6 +116,27 @@ extern int lttng_list_sessions(struct lttng_session **sessions);
 extern int lttng_set_session_shm_path(const char *session_name,
 		const char *shm_path);
 
+/*
+ * Begin a batch of updates of a session's configuration.
+ *
+ * The traced applications are not updated by the following commands on the
+ * session, such as enabling channels and events, until
+ * lttng_end_session_update() is called or the session is started. They are
+ * then updated at once. This is only effective while no application knows
+ * about the session, e.g. when loading a session.
+ *
+ * Return 0 on success else a negative LTTng error code.
+ */
+extern int lttng_begin_session_update(const char *session_name);
+
+/*
+ * End a batch of updates of a session's configuration begun by
+ * lttng_begin_session_update() and update the traced applications.
+ *
+ * Return 0 on success else a negative LTTng error code.
+ */
+extern int lttng_end_session_update(const char *session_name);
+
 /*
  * Add PID to session tracker.
  *
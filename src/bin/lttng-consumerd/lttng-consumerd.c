@@ -54,7 +54,7 @@
 
 /* threads (channel handling, poll, metadata, sessiond) */
 
-static pthread_t channel_thread, data_thread, metadata_thread,
+static pthread_t channel_thread, metadata_thread,
 		sessiond_thread, metadata_timer_thread, health_thread;
 
 /* to count the number of times the user pressed ctrl+c */
@@ -70,6 +70,7 @@ static const char *progname;
 static char command_sock_path[PATH_MAX]; /* Global command socket path */
 static char error_sock_path[PATH_MAX]; /* Global error path */
 static enum lttng_consumer_type opt_type = LTTNG_CONSUMER_KERNEL;
+static unsigned int opt_data_threads;
 
 /* the liblttngconsumerd context */
 static struct lttng_consumer_local_data *ctx;
@@ -180,6 +181,25 @@ static void usage(FILE *fp)
 			" (support not compiled in)"
 #endif
 			);
+	fprintf(fp, "  -t, --data-threads NUM             "
+			"Number of data stream consumption threads. (default: %d)\n",
+			DEFAULT_CONSUMERD_DATA_THREADS);
+}
+
+/*
+ * Parse a number of threads. Return 0 on error.
+ */
+static unsigned int parse_thread_count(const char *str)
+{
+	unsigned long v;
+	char *endptr;
+
+	errno = 0;
+	v = strtoul(str, &endptr, 10);
+	if (errno != 0 || *endptr != '\0' || v == 0 || v > UINT_MAX) {
+		return 0;
+	}
+	return (unsigned int) v;
 }
 
 /*
@@ -199,6 +219,7 @@ static int parse_args(int argc, char **argv)
 		{ "verbose", 0, 0, 'v' },
 		{ "version", 0, 0, 'V' },
 		{ "kernel", 0, 0, 'k' },
+		{ "data-threads", 1, 0, 't' },
 #ifdef HAVE_LIBLTTNG_UST_CTL
 		{ "ust", 0, 0, 'u' },
 #endif
@@ -207,7 +228,7 @@ static int parse_args(int argc, char **argv)
 
 	while (1) {
 		int option_index = 0;
-		c = getopt_long(argc, argv, "dhqvVku" "c:e:g:",
+		c = getopt_long(argc, argv, "dhqvVku" "c:e:g:t:",
 				long_options, &option_index);
 		if (c == -1) {
 			break;
@@ -265,6 +286,14 @@ static int parse_args(int argc, char **argv)
 		case 'k':
 			opt_type = LTTNG_CONSUMER_KERNEL;
 			break;
+		case 't':
+			opt_data_threads = parse_thread_count(optarg);
+			if (!opt_data_threads) {
+				ERR("Invalid number of data threads: %s", optarg);
+				ret = -1;
+				goto end;
+			}
+			break;
 #ifdef HAVE_LIBLTTNG_UST_CTL
 		case 'u':
 # if (CAA_BITS_PER_LONG == 64)
@@ -311,7 +340,9 @@ static void set_ulimit(void)
 int main(int argc, char **argv)
 {
 	int ret = 0, retval = 0;
+	unsigned int i, nb_data_threads_started = 0;
 	void *status;
+	const char *env_snapshot_threads;
 	struct lttng_consumer_local_data *tmp_ctx;
 
 	if (set_signal_handler()) {
@@ -326,6 +357,28 @@ int main(int argc, char **argv)
 		goto exit_options;
 	}
 
+	if (!opt_data_threads) {
+		const char *env_data_threads;
+
+		/*
+		 * The consumer daemon is spawned by the session daemon so the
+		 * environment is the only way to configure it in that case.
+		 */
+		env_data_threads = lttng_secure_getenv(
+				DEFAULT_CONSUMERD_DATA_THREADS_ENV);
+		if (env_data_threads) {
+			opt_data_threads = parse_thread_count(env_data_threads);
+			if (!opt_data_threads) {
+				WARN("Invalid %s value \"%s\". Using default.",
+						DEFAULT_CONSUMERD_DATA_THREADS_ENV,
+						env_data_threads);
+			}
+		}
+		if (!opt_data_threads) {
+			opt_data_threads = DEFAULT_CONSUMERD_DATA_THREADS;
+		}
+	}
+
 	/* Daemonize */
 	if (opt_daemon) {
 		int i;
@@ -432,6 +485,31 @@ int main(int argc, char **argv)
 		goto exit_init_data;
 	}
 
+	if (lttng_consumer_init_data_threads(ctx, opt_data_threads)) {
+		retval = -1;
+		goto exit_init_data;
+	}
+
+	env_snapshot_threads = lttng_secure_getenv(
+			DEFAULT_CONSUMERD_SNAPSHOT_THREADS_ENV);
+	if (env_snapshot_threads) {
+		unsigned int nb_snapshot_threads;
+
+		nb_snapshot_threads = parse_thread_count(env_snapshot_threads);
+		if (nb_snapshot_threads) {
+			ctx->nb_snapshot_threads = nb_snapshot_threads;
+		} else {
+			WARN("Invalid %s value \"%s\". Using default.",
+					DEFAULT_CONSUMERD_SNAPSHOT_THREADS_ENV,
+					env_snapshot_threads);
+		}
+	}
+
+	if (lttng_secure_getenv(DEFAULT_CONSUMERD_ZEROCOPY_ENV)) {
+		DBG("Zero-copy transmission to the relayd requested");
+		ctx->relayd_zerocopy = 1;
+	}
+
 	lttng_consumer_set_command_sock_path(ctx, command_sock_path);
 	if (*error_sock_path == '\0') {
 		switch (opt_type) {
@@ -482,10 +560,10 @@ int main(int argc, char **argv)
 	lttng_consumer_set_error_sock(ctx, ret);
 
 	/*
-	 * Block RT signals used for UST periodical metadata flush and the live
-	 * timer in main, and create a dedicated thread to handle these signals.
+	 * Create the timer wheel handling the UST periodical metadata flush and
+	 * the live timer of all channels. It is driven by a dedicated thread.
 	 */
-	if (consumer_signal_init()) {
+	if (consumer_timer_init()) {
 		retval = -1;
 		goto exit_init_data;
 	}
@@ -538,14 +616,18 @@ int main(int argc, char **argv)
 		goto exit_metadata_thread;
 	}
 
-	/* Create thread to manage the polling/writing of trace data */
-	ret = pthread_create(&data_thread, NULL, consumer_thread_data_poll,
-			(void *) ctx);
-	if (ret) {
-		errno = ret;
-		PERROR("pthread_create");
-		retval = -1;
-		goto exit_data_thread;
+	/* Create threads to manage the polling/writing of trace data */
+	for (i = 0; i < ctx->nb_data_threads; i++) {
+		ret = pthread_create(&ctx->data_threads[i].thread, NULL,
+				consumer_thread_data_poll,
+				(void *) &ctx->data_threads[i]);
+		if (ret) {
+			errno = ret;
+			PERROR("pthread_create");
+			retval = -1;
+			goto exit_data_thread;
+		}
+		nb_data_threads_started++;
 	}
 
 	/* Create the thread to manage the receive of fd */
@@ -594,14 +676,16 @@ exit_metadata_timer_thread:
 		retval = -1;
 	}
 exit_sessiond_thread:
+exit_data_thread:
 
-	ret = pthread_join(data_thread, &status);
-	if (ret) {
-		errno = ret;
-		PERROR("pthread_join data_thread");
-		retval = -1;
+	for (i = 0; i < nb_data_threads_started; i++) {
+		ret = pthread_join(ctx->data_threads[i].thread, &status);
+		if (ret) {
+			errno = ret;
+			PERROR("pthread_join data_thread");
+			retval = -1;
+		}
 	}
-exit_data_thread:
 
 	ret = pthread_join(metadata_thread, &status);
 	if (ret) {
@@ -90,6 +90,7 @@ static void rcu_free_connection(struct rcu_head *head)
 		caa_container_of(head, struct relay_connection, rcu_node);
 
 	lttcomm_destroy_sock(conn->sock);
+	free(conn->index_notification);
 	if (conn->viewer_session) {
 		viewer_session_destroy(conn->viewer_session);
 		conn->viewer_session = NULL;
@@ -125,6 +126,12 @@ static void connection_release(struct urcu_ref *ref)
 	if (conn->viewer_session) {
 		viewer_session_close(conn->viewer_session);
 	}
+	if (conn->index_session) {
+		uatomic_dec(&conn->index_session->index_subscriptions[
+				conn->live_worker_id].subscribers);
+		session_put(conn->index_session);
+		conn->index_session = NULL;
+	}
 	destroy_connection(conn);
 }
 
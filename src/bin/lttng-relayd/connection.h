@@ -46,10 +46,11 @@ enum connection_type {
  *
  * Connections are assumed to be accessed from a single thread. Live
  * connections between the relay and a live client are only accessed
- * from the live worker thread.
+ * from the live worker thread they were dispatched to.
  *
  * The connections between the consumerd/sessiond and the relayd are only
- * handled by the "main" worker thread (as in, the worker thread in main.c).
+ * handled by the "main" worker thread they were dispatched to (as in, one of
+ * the worker threads in main.c).
  *
  * This is why there are no back references to connections from the
  * sessions and session list.
@@ -68,6 +69,30 @@ struct relay_connection {
 	 * connection type.
 	 */
 	struct relay_viewer_session *viewer_session;
+	/*
+	 * Session whose indexes are pushed on this connection. Only ever set
+	 * for RELAY_VIEWER_NOTIFICATION connection type. Holds a reference.
+	 */
+	struct relay_session *index_session;
+	/*
+	 * Index notification the viewer did not read entirely yet, of which
+	 * index_notification_sent bytes out of index_notification_len are
+	 * sent. The rest is sent once the socket is writable, followed by a
+	 * new notification if index_notification_pending is set because
+	 * indexes were received meanwhile. Only ever set for
+	 * RELAY_VIEWER_NOTIFICATION connection type.
+	 */
+	char *index_notification;
+	size_t index_notification_len;
+	size_t index_notification_sent;
+	bool index_notification_pending;
+	/* The socket is polled for writability. */
+	bool index_notification_pollout;
+	/*
+	 * Id of the live worker thread handling the connection. Only valid for
+	 * the viewer connection types.
+	 */
+	unsigned int live_worker_id;
 
 	/*
 	 * Protocol version to use for this connection. Only valid for
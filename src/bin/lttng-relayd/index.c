@@ -273,7 +273,8 @@ void relay_index_put(struct relay_index *index)
 
 /*
  * Try to flush index to disk. Releases self-reference to index once
- * flush succeeds.
+ * flush succeeds. The index may be batched with the other indexes of the
+ * stream before reaching the index file, see stream_write_index().
  *
  * Stream lock must be held by the caller.
  * Return 0 on successful flush, a negative value on error, or positive
@@ -299,12 +300,8 @@ int relay_index_try_flush(struct relay_index *index)
 			index->index_n.key, fd);
 	flushed = true;
 	index->flushed = true;
-	ret = index_write(fd, &index->index_data, sizeof(index->index_data));
-	if (ret == sizeof(index->index_data)) {
-		ret = 0;
-	} else {
-		ret = -1;
-	}
+	ret = stream_write_index(index->stream, index->index_fd,
+			&index->index_data);
 skip:
 	pthread_mutex_unlock(&index->lock);
 
@@ -45,6 +45,7 @@
 #include <common/compat/poll.h>
 #include <common/compat/socket.h>
 #include <common/compat/endian.h>
+#include <common/compat/fcntl.h>
 #include <common/defaults.h>
 #include <common/futex.h>
 #include <common/index/index.h>
@@ -72,17 +73,41 @@
 static struct lttng_uri *live_uri;
 
 /*
- * This pipe is used to inform the worker thread that a command is queued and
- * ready to be processed.
+ * Worker thread serving a subset of the viewer connections. A connection is
+ * handed to a single worker by the dispatcher thread and is only processed by
+ * that worker afterwards, so a viewer doing large reads only delays the
+ * viewers sharing its worker.
  */
-static int live_conn_pipe[2] = { -1, -1 };
+struct live_worker {
+	unsigned int id;
+	pthread_t thread;
+	/*
+	 * This pipe is used to inform the worker thread that a connection is
+	 * queued and ready to be processed.
+	 */
+	int conn_pipe[2];
+	/*
+	 * This pipe is used by the relay worker threads to send the id of a
+	 * session having new indexes to the worker thread.
+	 */
+	int notify_pipe[2];
+	/*
+	 * Number of connections handled by this worker. Incremented by the
+	 * dispatcher thread and decremented by the worker itself.
+	 */
+	unsigned long nb_connections;
+};
+
+static struct live_worker *live_workers;
+static unsigned int live_nb_workers;
+/* Number of live worker threads to join. */
+static unsigned int live_nb_workers_started;
 
 /* Shared between threads */
 static int live_dispatch_thread_exit;
 
 static pthread_t live_listener_thread;
 static pthread_t live_dispatcher_thread;
-static pthread_t live_worker_thread;
 
 /*
  * Relay command queue.
@@ -97,13 +122,99 @@ static pthread_mutex_t last_relay_viewer_session_id_lock =
 		PTHREAD_MUTEX_INITIALIZER;
 
 /*
- * Cleanup the daemon
+ * Allocate the live workers and their pipes.
+ *
+ * Freed in relayd_live_destroy().
+ */
+static
+int create_live_workers(unsigned int nb_workers)
+{
+	int ret;
+	unsigned int i;
+
+	live_workers = zmalloc(nb_workers * sizeof(*live_workers));
+	if (!live_workers) {
+		PERROR("zmalloc live workers");
+		ret = -1;
+		goto end;
+	}
+	live_nb_workers = nb_workers;
+
+	for (i = 0; i < nb_workers; i++) {
+		live_workers[i].id = i;
+		live_workers[i].conn_pipe[0] = -1;
+		live_workers[i].conn_pipe[1] = -1;
+		live_workers[i].notify_pipe[0] = -1;
+		live_workers[i].notify_pipe[1] = -1;
+	}
+
+	for (i = 0; i < nb_workers; i++) {
+		ret = utils_create_pipe_cloexec(live_workers[i].conn_pipe);
+		if (ret < 0) {
+			goto end;
+		}
+		/* Non-blocking so the relay worker threads never wait on it. */
+		ret = utils_create_pipe_cloexec_nonblock(
+				live_workers[i].notify_pipe);
+		if (ret < 0) {
+			goto end;
+		}
+	}
+
+	ret = 0;
+end:
+	return ret;
+}
+
+static
+void destroy_live_workers(void)
+{
+	unsigned int i;
+
+	if (!live_workers) {
+		return;
+	}
+
+	for (i = 0; i < live_nb_workers; i++) {
+		utils_close_pipe(live_workers[i].conn_pipe);
+		utils_close_pipe(live_workers[i].notify_pipe);
+	}
+	live_nb_workers = 0;
+	free(live_workers);
+	live_workers = NULL;
+}
+
+/*
+ * Return the live worker thread currently handling the least connections.
  */
 static
-void cleanup_relayd_live(void)
+struct live_worker *live_select_worker(void)
+{
+	unsigned int i;
+	struct live_worker *worker = &live_workers[0];
+
+	for (i = 1; i < live_nb_workers; i++) {
+		if (uatomic_read(&live_workers[i].nb_connections) <
+				uatomic_read(&worker->nb_connections)) {
+			worker = &live_workers[i];
+		}
+	}
+
+	return worker;
+}
+
+/*
+ * Free the live workers and their pipes, and the live URI.
+ *
+ * The relay worker threads write to the notification pipes of the live
+ * workers, see live_notify_session_indexes(), so this MUST only be called
+ * once they are joined. This is the case even if relayd_live_create() failed.
+ */
+void relayd_live_destroy(void)
 {
 	DBG("Cleaning up");
 
+	destroy_live_workers();
 	free(live_uri);
 }
 
@@ -629,6 +740,7 @@ void *thread_dispatcher(void *data)
 	ssize_t ret;
 	struct cds_wfcq_node *node;
 	struct relay_connection *conn = NULL;
+	struct live_worker *worker;
 
 	DBG("[thread] Live viewer relay dispatcher started");
 
@@ -659,8 +771,11 @@ void *thread_dispatcher(void *data)
 				break;
 			}
 			conn = caa_container_of(node, struct relay_connection, qnode);
-			DBG("Dispatching viewer request waiting on sock %d",
-					conn->sock->fd);
+			worker = live_select_worker();
+			uatomic_inc(&worker->nb_connections);
+			conn->live_worker_id = worker->id;
+			DBG("Dispatching viewer request waiting on sock %d to worker %u",
+					conn->sock->fd, worker->id);
 
 			/*
 			 * Inform worker thread of the new request. This
@@ -668,9 +783,11 @@ void *thread_dispatcher(void *data)
 			 * the data will be read at some point in time
 			 * or wait to the end of the world :)
 			 */
-			ret = lttng_write(live_conn_pipe[1], &conn, sizeof(conn));
+			ret = lttng_write(worker->conn_pipe[1], &conn,
+					sizeof(conn));
 			if (ret < 0) {
 				PERROR("write conn pipe");
+				uatomic_dec(&worker->nb_connections);
 				connection_put(conn);
 				goto error;
 			}
@@ -745,7 +862,8 @@ int viewer_connect(struct relay_connection *conn)
 
 	if (be32toh(msg.type) == LTTNG_VIEWER_CLIENT_COMMAND) {
 		conn->type = RELAY_VIEWER_COMMAND;
-	} else if (be32toh(msg.type) == LTTNG_VIEWER_CLIENT_NOTIFICATION) {
+	} else if (be32toh(msg.type) == LTTNG_VIEWER_CLIENT_NOTIFICATION &&
+			conn->minor >= LTTNG_VIEWER_INDEX_NOTIFICATION_MINOR) {
 		conn->type = RELAY_VIEWER_NOTIFICATION;
 	} else {
 		ERR("Unknown connection type : %u", be32toh(msg.type));
@@ -1133,6 +1251,7 @@ static int try_open_index(struct relay_viewer_stream *vstream,
 			}
 			ret = -1;
 		} else {
+			vstream->index_skipped = 0;
 			ret = 0;
 		}
 		goto end;
@@ -1245,6 +1364,31 @@ index_ready:
 	return 1;
 }
 
+/*
+ * Read the next index of a viewer stream from its index file, skipping the
+ * indexes already sent from the recent index ring.
+ *
+ * Called with rstream lock held.
+ * Return the number of bytes read or a negative value on error.
+ */
+static ssize_t read_index_file(struct relay_viewer_stream *vstream,
+		struct ctf_packet_index *index)
+{
+	if (vstream->index_skipped) {
+		off_t lseek_ret;
+
+		lseek_ret = lseek(vstream->index_fd->fd,
+				vstream->index_skipped * sizeof(*index),
+				SEEK_CUR);
+		if (lseek_ret < 0) {
+			PERROR("lseek index file");
+			return -1;
+		}
+		vstream->index_skipped = 0;
+	}
+	return lttng_read(vstream->index_fd->fd, index, sizeof(*index));
+}
+
 /*
  * Send the next index for a stream.
  *
@@ -1302,6 +1446,18 @@ int viewer_get_next_index(struct relay_connection *conn)
 		goto send_reply;
 	}
 
+	/*
+	 * The viewer has caught up with the indexes written so far: write
+	 * the batched ones instead of asking it to retry.
+	 */
+	if (rstream->index_received_seqcount == vstream->index_sent_seqcount) {
+		ret = stream_flush_indexes(rstream);
+		if (ret < 0) {
+			viewer_index.status = htobe32(LTTNG_VIEWER_INDEX_ERR);
+			goto send_reply;
+		}
+	}
+
 	/* Try to open an index if one is needed for that stream. */
 	ret = try_open_index(vstream, rstream);
 	if (ret < 0) {
@@ -1377,9 +1533,15 @@ int viewer_get_next_index(struct relay_connection *conn)
 		viewer_index.flags |= LTTNG_VIEWER_FLAG_NEW_STREAM;
 	}
 
-	read_ret = lttng_read(vstream->index_fd->fd, &packet_index,
-			sizeof(packet_index));
-	if (read_ret < sizeof(packet_index)) {
+	if (stream_get_recent_index(rstream, vstream->index_sent_seqcount,
+			&packet_index)) {
+		/* The index file position is caught up on the next read. */
+		vstream->index_skipped++;
+		read_ret = sizeof(packet_index);
+	} else {
+		read_ret = read_index_file(vstream, &packet_index);
+	}
+	if (read_ret < (ssize_t) sizeof(packet_index)) {
 		ERR("Relay reading index file %d returned %zd",
 			vstream->index_fd->fd, read_ret);
 		viewer_index.status = htobe32(LTTNG_VIEWER_INDEX_ERR);
@@ -1455,107 +1617,278 @@ error_put:
 }
 
 /*
- * Send the next index for a stream
+ * Send len bytes of a trace file starting at offset on the viewer socket.
+ * sendfile(2) is used so the packet is not copied through user space; what it
+ * cannot send (e.g. unsupported by the system) is read with pread(2) and sent
+ * from a buffer.
  *
  * Return 0 on success or else a negative value.
  */
 static
-int viewer_get_packet(struct relay_connection *conn)
+int send_trace_data(struct lttcomm_sock *sock, int fd, off_t offset,
+		size_t len)
 {
-	int ret, send_data = 0;
+	int ret;
+	ssize_t size_ret;
 	char *data = NULL;
-	uint32_t len = 0;
-	ssize_t read_len;
-	struct lttng_viewer_get_packet get_packet_info;
-	struct lttng_viewer_trace_packet reply;
-	struct relay_viewer_stream *vstream = NULL;
 
-	DBG2("Relay get data packet");
-
-	health_code_update();
+	while (len > 0) {
+		size_ret = lttng_sendfile(sock->fd, fd, &offset, len);
+		if (size_ret < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			break;
+		} else if (size_ret == 0) {
+			ERR("Trace file fd %d truncated at offset %jd", fd,
+					(intmax_t) offset);
+			ret = -1;
+			goto end;
+		}
+		len -= size_ret;
+	}
+	if (!len) {
+		ret = 0;
+		goto end;
+	}
+	if (errno != ENOSYS && errno != EINVAL) {
+		PERROR("sendfile trace file fd %d", fd);
+		ret = -1;
+		goto end;
+	}
 
-	ret = recv_request(conn->sock, &get_packet_info,
-			sizeof(get_packet_info));
-	if (ret < 0) {
+	data = zmalloc(len);
+	if (!data) {
+		PERROR("relay data zmalloc");
+		ret = -1;
 		goto end;
 	}
-	health_code_update();
+	do {
+		size_ret = pread(fd, data, len, offset);
+	} while (size_ret < 0 && errno == EINTR);
+	if (size_ret < (ssize_t) len) {
+		PERROR("Relay reading trace file, fd: %d, offset: %jd", fd,
+				(intmax_t) offset);
+		ret = -1;
+		goto end;
+	}
+	size_ret = send_response(sock, data, len);
+	ret = size_ret < 0 ? -1 : 0;
 
-	/* From this point on, the error label can be reached. */
-	memset(&reply, 0, sizeof(reply));
+end:
+	free(data);
+	return ret;
+}
+
+/*
+ * Prepare the reply to a packet request. When the packet can be sent, the
+ * reply status is LTTNG_VIEWER_GET_PACKET_OK and a reference on the trace file
+ * to send it from is returned in stream_fd, NULL otherwise.
+ *
+ * The data is sent without the stream lock, using positional I/O on our own
+ * reference to the trace file.
+ */
+static
+void prepare_packet_reply(const struct lttng_viewer_get_packet *request,
+		struct lttng_viewer_trace_packet *reply,
+		struct stream_fd **stream_fd)
+{
+	int ret;
+	uint32_t len;
+	uint64_t offset;
+	struct stat st;
+	struct stream_fd *sfd = NULL;
+	struct relay_viewer_stream *vstream;
 
-	vstream = viewer_stream_get_by_id(be64toh(get_packet_info.stream_id));
+	memset(reply, 0, sizeof(*reply));
+
+	vstream = viewer_stream_get_by_id(be64toh(request->stream_id));
 	if (!vstream) {
 		DBG("Client requested packet of unknown stream id %" PRIu64,
-				be64toh(get_packet_info.stream_id));
-		reply.status = htobe32(LTTNG_VIEWER_GET_PACKET_ERR);
-		goto send_reply_nolock;
+				be64toh(request->stream_id));
+		goto error;
 	}
 
 	pthread_mutex_lock(&vstream->stream->lock);
-
-	len = be32toh(get_packet_info.len);
-	data = zmalloc(len);
-	if (!data) {
-		PERROR("relay data zmalloc");
+	sfd = vstream->stream_fd;
+	if (sfd) {
+		stream_fd_get(sfd);
+	}
+	pthread_mutex_unlock(&vstream->stream->lock);
+	viewer_stream_put(vstream);
+	if (!sfd) {
 		goto error;
 	}
 
-	ret = lseek(vstream->stream_fd->fd, be64toh(get_packet_info.offset),
-			SEEK_SET);
+	len = be32toh(request->len);
+	offset = be64toh(request->offset);
+
+	/* The reply status must be known before sending the data. */
+	ret = fstat(sfd->fd, &st);
 	if (ret < 0) {
-		PERROR("lseek fd %d to offset %" PRIu64, vstream->stream_fd->fd,
-			be64toh(get_packet_info.offset));
+		PERROR("fstat trace file fd %d", sfd->fd);
 		goto error;
 	}
-	read_len = lttng_read(vstream->stream_fd->fd, data, len);
-	if (read_len < len) {
-		PERROR("Relay reading trace file, fd: %d, offset: %" PRIu64,
-				vstream->stream_fd->fd,
-				be64toh(get_packet_info.offset));
+	if (offset + len > (uint64_t) st.st_size) {
+		ERR("Relay trace file fd %d too short for offset %" PRIu64
+				" and length %" PRIu32, sfd->fd, offset, len);
 		goto error;
 	}
-	reply.status = htobe32(LTTNG_VIEWER_GET_PACKET_OK);
-	reply.len = htobe32(len);
-	send_data = 1;
-	goto send_reply;
+	reply->status = htobe32(LTTNG_VIEWER_GET_PACKET_OK);
+	reply->len = htobe32(len);
+	*stream_fd = sfd;
+	return;
 
 error:
-	reply.status = htobe32(LTTNG_VIEWER_GET_PACKET_ERR);
-
-send_reply:
-	if (vstream) {
-		pthread_mutex_unlock(&vstream->stream->lock);
+	if (sfd) {
+		stream_fd_put(sfd);
 	}
-send_reply_nolock:
-	reply.flags = htobe32(reply.flags);
+	reply->status = htobe32(LTTNG_VIEWER_GET_PACKET_ERR);
+	*stream_fd = NULL;
+}
+
+/*
+ * Send a prepared packet reply followed by the packet data, if any.
+ *
+ * Return 0 on success or else a negative value.
+ */
+static
+int send_packet(struct lttcomm_sock *sock,
+		const struct lttng_viewer_get_packet *request,
+		struct lttng_viewer_trace_packet *reply,
+		struct stream_fd *stream_fd)
+{
+	int ret;
 
 	health_code_update();
 
-	ret = send_response(conn->sock, &reply, sizeof(reply));
+	ret = send_response(sock, reply, sizeof(*reply));
 	if (ret < 0) {
-		goto end_free;
+		goto end;
 	}
 	health_code_update();
 
-	if (send_data) {
-		health_code_update();
-		ret = send_response(conn->sock, data, len);
+	if (stream_fd) {
+		ret = send_trace_data(sock, stream_fd->fd,
+				be64toh(request->offset), be32toh(reply->len));
 		if (ret < 0) {
-			goto end_free;
+			goto end;
 		}
 		health_code_update();
+		DBG("Sent %u bytes for stream %" PRIu64, be32toh(reply->len),
+				be64toh(request->stream_id));
 	}
+	ret = 0;
 
-	DBG("Sent %u bytes for stream %" PRIu64, len,
-			be64toh(get_packet_info.stream_id));
+end:
+	return ret;
+}
+
+/*
+ * Send the next index for a stream
+ *
+ * Return 0 on success or else a negative value.
+ */
+static
+int viewer_get_packet(struct relay_connection *conn)
+{
+	int ret;
+	struct stream_fd *stream_fd;
+	struct lttng_viewer_get_packet get_packet_info;
+	struct lttng_viewer_trace_packet reply;
+
+	DBG2("Relay get data packet");
+
+	health_code_update();
+
+	ret = recv_request(conn->sock, &get_packet_info,
+			sizeof(get_packet_info));
+	if (ret < 0) {
+		goto end;
+	}
+	health_code_update();
+
+	prepare_packet_reply(&get_packet_info, &reply, &stream_fd);
+	ret = send_packet(conn->sock, &get_packet_info, &reply, stream_fd);
+	if (stream_fd) {
+		stream_fd_put(stream_fd);
+	}
 
-end_free:
-	free(data);
 end:
-	if (vstream) {
-		viewer_stream_put(vstream);
+	return ret;
+}
+
+/*
+ * Send several packets, possibly of different streams, in a single
+ * response. Each packet is preceded by its own reply so the viewer can tell
+ * which ones failed.
+ *
+ * Return 0 on success or else a negative value.
+ */
+static
+int viewer_get_packets(struct relay_connection *conn)
+{
+	int ret;
+	uint32_t i, count;
+	struct lttng_viewer_get_packets request;
+	struct lttng_viewer_get_packet *packets = NULL;
+	struct lttng_viewer_trace_packets response;
+
+	DBG2("Relay get data packets");
+
+	health_code_update();
+
+	ret = recv_request(conn->sock, &request, sizeof(request));
+	if (ret < 0) {
+		goto end;
+	}
+	count = be32toh(request.packets_count);
+	if (count > LTTNG_VIEWER_GET_PACKETS_MAX) {
+		ERR("Viewer requested %" PRIu32 " packets, the maximum is %u",
+				count, LTTNG_VIEWER_GET_PACKETS_MAX);
+		ret = -1;
+		goto end;
+	}
+
+	if (count) {
+		packets = zmalloc(count * sizeof(*packets));
+		if (!packets) {
+			PERROR("relay packets zmalloc");
+			ret = -1;
+			goto end;
+		}
+		ret = recv_request(conn->sock, packets,
+				count * sizeof(*packets));
+		if (ret < 0) {
+			goto end;
+		}
+	}
+	health_code_update();
+
+	memset(&response, 0, sizeof(response));
+	response.packets_count = htobe32(count);
+	ret = send_response(conn->sock, &response, sizeof(response));
+	if (ret < 0) {
+		goto end;
 	}
+
+	for (i = 0; i < count; i++) {
+		struct stream_fd *stream_fd;
+		struct lttng_viewer_trace_packet reply;
+
+		prepare_packet_reply(&packets[i], &reply, &stream_fd);
+		ret = send_packet(conn->sock, &packets[i], &reply, stream_fd);
+		if (stream_fd) {
+			stream_fd_put(stream_fd);
+		}
+		if (ret < 0) {
+			goto end;
+		}
+	}
+	ret = 0;
+
+end:
+	free(packets);
 	return ret;
 }
 
@@ -1736,36 +2069,424 @@ end:
 
 
 /*
- * live_relay_unknown_command: send -1 if received unknown command
+ * Wake up the live worker threads handling viewers subscribed to the indexes
+ * of the session, so they push them the available ones. The wakeups of a
+ * worker are coalesced until it handles the session.
+ *
+ * Called from the relay worker threads, with the stream lock held.
  */
-static
-void live_relay_unknown_command(struct relay_connection *conn)
+void live_notify_session_indexes(struct relay_session *session)
 {
-	struct lttcomm_relayd_generic_reply reply;
+	ssize_t ret;
+	unsigned int i;
+	struct relay_index_subscription *subscriptions;
 
-	memset(&reply, 0, sizeof(reply));
-	reply.ret_code = htobe32(LTTNG_ERR_UNK);
-	(void) send_response(conn->sock, &reply, sizeof(reply));
+	subscriptions = rcu_dereference(session->index_subscriptions);
+	if (!subscriptions) {
+		return;
+	}
+	for (i = 0; i < live_nb_workers; i++) {
+		if (!uatomic_read(&subscriptions[i].subscribers)) {
+			continue;
+		}
+		if (uatomic_cmpxchg(&subscriptions[i].notify_pending, 0, 1) != 0) {
+			continue;
+		}
+		ret = lttng_write(live_workers[i].notify_pipe[1], &session->id,
+				sizeof(session->id));
+		if (ret != sizeof(session->id)) {
+			DBG("Failed to queue index notification of session %" PRIu64 " to live worker %u",
+					session->id, i);
+			uatomic_set(&subscriptions[i].notify_pending, 0);
+		}
+	}
 }
 
 /*
- * Process the commands received on the control socket
+ * Return the index subscriptions of a session, allocating them on its first
+ * subscription. Live workers may subscribe to the session concurrently, only
+ * the first allocation is kept.
+ *
+ * Return the subscriptions or NULL on ENOMEM.
  */
 static
-int process_control(struct lttng_viewer_cmd *recv_hdr,
-		struct relay_connection *conn)
+struct relay_index_subscription *get_index_subscriptions(
+		struct relay_session *session)
 {
-	int ret = 0;
-	uint32_t msg_value;
+	struct relay_index_subscription *subscriptions, *old;
 
-	msg_value = be32toh(recv_hdr->cmd);
+	subscriptions = rcu_dereference(session->index_subscriptions);
+	if (subscriptions) {
+		return subscriptions;
+	}
 
-	/*
-	 * Make sure we've done the version check before any command other then a
-	 * new client connection.
-	 */
-	if (msg_value != LTTNG_VIEWER_CONNECT && !conn->version_check_done) {
-		ERR("Viewer conn value %" PRIu32 " before version check", msg_value);
+	subscriptions = zmalloc(live_nb_workers * sizeof(*subscriptions));
+	if (!subscriptions) {
+		PERROR("zmalloc index subscriptions");
+		return NULL;
+	}
+	/* Implies a full barrier, publishing the zeroed subscriptions. */
+	old = uatomic_cmpxchg(&session->index_subscriptions, NULL,
+			subscriptions);
+	if (old) {
+		free(subscriptions);
+		return old;
+	}
+	return subscriptions;
+}
+
+/*
+ * Send what is left of the index notification of a connection without
+ * blocking. The rest is kept for later if the viewer socket is full.
+ *
+ * Return 0 on success or else a negative value, in which case the connection
+ * must be closed.
+ */
+static
+int flush_index_notification(struct relay_connection *conn)
+{
+	ssize_t ret;
+
+	while (conn->index_notification_sent < conn->index_notification_len) {
+		health_code_update();
+		ret = conn->sock->ops->sendmsg(conn->sock,
+				conn->index_notification +
+					conn->index_notification_sent,
+				conn->index_notification_len -
+					conn->index_notification_sent,
+				MSG_DONTWAIT);
+		if (ret < 0) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK) {
+				DBG("Viewer socket %d full, index notification deferred",
+						conn->sock->fd);
+				return 0;
+			}
+			return -1;
+		}
+		conn->index_notification_sent += ret;
+	}
+	health_code_update();
+
+	free(conn->index_notification);
+	conn->index_notification = NULL;
+	conn->index_notification_len = 0;
+	conn->index_notification_sent = 0;
+	return 0;
+}
+
+/*
+ * Push the list of the streams of the subscribed session having an index (or
+ * an inactivity beacon not notified yet) available for the viewer. Nothing is
+ * sent when no stream is ready, unless the session is closed, in which case
+ * the subscription ends.
+ *
+ * A viewer not reading fast enough is never waited for: if the previous
+ * notification is not entirely sent yet, this one is deferred until the
+ * socket is writable, see resume_index_notification().
+ *
+ * Return 0 on success or else a negative value, in which case the connection
+ * must be closed.
+ */
+static
+int send_index_notification(struct relay_connection *conn)
+{
+	int ret;
+	struct relay_session *session = conn->index_session;
+	struct lttng_viewer_index_notification *notification;
+	struct lttng_ht_iter iter;
+	struct ctf_trace *ctf_trace;
+	uint64_t *stream_ids;
+	uint32_t count = 0, alloc_count = SESSION_BUF_DEFAULT_COUNT;
+	size_t len;
+	bool closed;
+
+	if (!session) {
+		ret = 0;
+		goto end;
+	}
+	if (conn->index_notification) {
+		conn->index_notification_pending = true;
+		ret = 0;
+		goto end;
+	}
+	conn->index_notification_pending = false;
+
+	notification = zmalloc(sizeof(*notification) +
+			alloc_count * sizeof(uint64_t));
+	if (!notification) {
+		ret = -1;
+		goto end;
+	}
+
+	pthread_mutex_lock(&session->lock);
+	closed = session->connection_closed;
+	pthread_mutex_unlock(&session->lock);
+
+	rcu_read_lock();
+	cds_lfht_for_each_entry(session->ctf_traces_ht->ht, &iter.iter,
+			ctf_trace, node.node) {
+		struct relay_stream *rstream;
+
+		if (!ctf_trace_get(ctf_trace)) {
+			continue;
+		}
+		cds_list_for_each_entry_rcu(rstream, &ctf_trace->stream_list,
+				stream_node) {
+			struct relay_viewer_stream *vstream;
+			bool ready, beacon;
+
+			health_code_update();
+
+			if (rstream->is_metadata) {
+				continue;
+			}
+			vstream = viewer_stream_get_by_id(rstream->stream_handle);
+			if (!vstream) {
+				continue;
+			}
+			pthread_mutex_lock(&rstream->lock);
+			if (rstream->index_received_seqcount ==
+					vstream->index_sent_seqcount) {
+				(void) stream_flush_indexes(rstream);
+			}
+			/* A beacon is only listed in a single notification. */
+			beacon = rstream->beacon_ts_end != -1ULL &&
+				rstream->beacon_ts_end !=
+					vstream->beacon_ts_end_notified;
+			if (beacon) {
+				vstream->beacon_ts_end_notified =
+						rstream->beacon_ts_end;
+			}
+			ready = rstream->index_received_seqcount >
+					vstream->index_sent_seqcount || beacon;
+			pthread_mutex_unlock(&rstream->lock);
+			viewer_stream_put(vstream);
+			if (!ready) {
+				continue;
+			}
+
+			if (count == alloc_count) {
+				struct lttng_viewer_index_notification *newbuf;
+
+				alloc_count <<= 1;
+				newbuf = realloc(notification, sizeof(*notification) +
+						alloc_count * sizeof(uint64_t));
+				if (!newbuf) {
+					ctf_trace_put(ctf_trace);
+					rcu_read_unlock();
+					ret = -1;
+					goto end_free;
+				}
+				notification = newbuf;
+			}
+			stream_ids = (uint64_t *) notification->stream_ids;
+			stream_ids[count++] = htobe64(rstream->stream_handle);
+		}
+		ctf_trace_put(ctf_trace);
+	}
+	rcu_read_unlock();
+
+	if (!count && !closed) {
+		ret = 0;
+		goto end_free;
+	}
+
+	notification->status = htobe32(closed ?
+			LTTNG_VIEWER_INDEX_NOTIFICATION_HUP :
+			LTTNG_VIEWER_INDEX_NOTIFICATION_OK);
+	notification->streams_count = htobe32(count);
+	len = sizeof(*notification) + count * sizeof(uint64_t);
+
+	DBG("Index notification of %" PRIu32 " streams queued for session %" PRIu64,
+			count, session->id);
+	conn->index_notification = (char *) notification;
+	conn->index_notification_len = len;
+	conn->index_notification_sent = 0;
+	notification = NULL;
+
+	if (closed) {
+		uatomic_dec(&session->index_subscriptions[
+				conn->live_worker_id].subscribers);
+		session_put(session);
+		conn->index_session = NULL;
+	}
+
+	ret = flush_index_notification(conn);
+
+end_free:
+	free(notification);
+end:
+	return ret;
+}
+
+/*
+ * Send the rest of the index notification of a connection once its socket is
+ * writable, followed by the notification deferred meanwhile, if any.
+ *
+ * Return 0 on success or else a negative value, in which case the connection
+ * must be closed.
+ */
+static
+int resume_index_notification(struct relay_connection *conn)
+{
+	int ret;
+
+	ret = flush_index_notification(conn);
+	if (ret < 0) {
+		goto end;
+	}
+	if (!conn->index_notification && conn->index_notification_pending) {
+		ret = send_index_notification(conn);
+	}
+end:
+	return ret;
+}
+
+/*
+ * Poll the socket of a notification connection for writability only while an
+ * index notification is left to send on it.
+ *
+ * Return 0 on success or else a negative value.
+ */
+static
+int update_index_notification_poll(struct lttng_poll_event *events,
+		struct relay_connection *conn)
+{
+	int ret;
+	bool pollout = conn->index_notification != NULL;
+
+	if (pollout == conn->index_notification_pollout) {
+		ret = 0;
+		goto end;
+	}
+
+	ret = lttng_poll_del(events, conn->sock->fd);
+	if (ret < 0) {
+		goto end;
+	}
+	ret = lttng_poll_add(events, conn->sock->fd,
+			LPOLLIN | LPOLLRDHUP | (pollout ? LPOLLOUT : 0));
+	if (ret < 0) {
+		goto end;
+	}
+	conn->index_notification_pollout = pollout;
+end:
+	return ret;
+}
+
+/*
+ * Subscribe a notification connection to the indexes of a session.
+ *
+ * Return 0 on success or else a negative value.
+ */
+static
+int viewer_subscribe_indexes(struct relay_connection *conn)
+{
+	int ret;
+	struct lttng_viewer_subscribe_indexes_request request;
+	struct lttng_viewer_subscribe_indexes_response response;
+	struct relay_session *session = NULL;
+	struct relay_index_subscription *subscriptions;
+	uint64_t session_id;
+
+	DBG("Viewer subscribe indexes received");
+
+	health_code_update();
+
+	ret = recv_request(conn->sock, &request, sizeof(request));
+	if (ret < 0) {
+		goto end;
+	}
+	session_id = be64toh(request.session_id);
+
+	health_code_update();
+
+	memset(&response, 0, sizeof(response));
+
+	if (conn->type != RELAY_VIEWER_NOTIFICATION) {
+		response.status = htobe32(LTTNG_VIEWER_SUBSCRIBE_ERR);
+		goto send_reply;
+	}
+
+	session = session_get_by_id(session_id);
+	if (!session) {
+		DBG("Relay session %" PRIu64 " not found", session_id);
+		response.status = htobe32(LTTNG_VIEWER_SUBSCRIBE_UNK);
+		goto send_reply;
+	}
+	if (!session->live_timer) {
+		response.status = htobe32(LTTNG_VIEWER_SUBSCRIBE_NOT_LIVE);
+		session_put(session);
+		session = NULL;
+		goto send_reply;
+	}
+	subscriptions = get_index_subscriptions(session);
+	if (!subscriptions) {
+		response.status = htobe32(LTTNG_VIEWER_SUBSCRIBE_ERR);
+		session_put(session);
+		session = NULL;
+		goto send_reply;
+	}
+
+	/* A connection follows a single session at a time. */
+	if (conn->index_session) {
+		uatomic_dec(&conn->index_session->index_subscriptions[
+				conn->live_worker_id].subscribers);
+		session_put(conn->index_session);
+	}
+	/* Keep the reference for the subscription. */
+	conn->index_session = session;
+	/* Only the live worker handling this connection is notified. */
+	uatomic_inc(&subscriptions[conn->live_worker_id].subscribers);
+	response.status = htobe32(LTTNG_VIEWER_SUBSCRIBE_OK);
+
+send_reply:
+	health_code_update();
+	ret = send_response(conn->sock, &response, sizeof(response));
+	if (ret < 0) {
+		goto end;
+	}
+	health_code_update();
+
+	/* Push the indexes that were available before the subscription. */
+	if (session) {
+		ret = send_index_notification(conn);
+	}
+end:
+	return ret;
+}
+
+/*
+ * live_relay_unknown_command: send -1 if received unknown command
+ */
+static
+void live_relay_unknown_command(struct relay_connection *conn)
+{
+	struct lttcomm_relayd_generic_reply reply;
+
+	memset(&reply, 0, sizeof(reply));
+	reply.ret_code = htobe32(LTTNG_ERR_UNK);
+	(void) send_response(conn->sock, &reply, sizeof(reply));
+}
+
+/*
+ * Process the commands received on the control socket
+ */
+static
+int process_control(struct lttng_viewer_cmd *recv_hdr,
+		struct relay_connection *conn)
+{
+	int ret = 0;
+	uint32_t msg_value;
+
+	msg_value = be32toh(recv_hdr->cmd);
+
+	/*
+	 * Make sure we've done the version check before any command other then a
+	 * new client connection.
+	 */
+	if (msg_value != LTTNG_VIEWER_CONNECT && !conn->version_check_done) {
+		ERR("Viewer conn value %" PRIu32 " before version check", msg_value);
 		ret = -1;
 		goto end;
 	}
@@ -1795,7 +2516,20 @@ int process_control(struct lttng_viewer_cmd *recv_hdr,
 	case LTTNG_VIEWER_CREATE_SESSION:
 		ret = viewer_create_session(conn);
 		break;
+	case LTTNG_VIEWER_SUBSCRIBE_INDEXES:
+		if (conn->minor < LTTNG_VIEWER_INDEX_NOTIFICATION_MINOR) {
+			goto unknown_command;
+		}
+		ret = viewer_subscribe_indexes(conn);
+		break;
+	case LTTNG_VIEWER_GET_PACKETS:
+		if (conn->minor < LTTNG_VIEWER_GET_PACKETS_MINOR) {
+			goto unknown_command;
+		}
+		ret = viewer_get_packets(conn);
+		break;
 	default:
+	unknown_command:
 		ERR("Received unknown viewer command (%u)",
 				be32toh(recv_hdr->cmd));
 		live_relay_unknown_command(conn);
@@ -1821,7 +2555,69 @@ void cleanup_connection_pollfd(struct lttng_poll_event *events, int pollfd)
 }
 
 /*
- * This thread does the actual work
+ * Close a connection handled by the given worker and put its "create"
+ * ownership reference.
+ */
+static
+void close_connection(struct live_worker *worker,
+		struct lttng_poll_event *events, int pollfd,
+		struct relay_connection *conn)
+{
+	cleanup_connection_pollfd(events, pollfd);
+	connection_put(conn);
+	uatomic_dec(&worker->nb_connections);
+}
+
+/*
+ * Push the indexes of the session read from the notification pipe to its
+ * subscribed connections. Connections failing to receive it are closed, the
+ * ones not reading fast enough get it once their socket is writable.
+ *
+ * Return 0 on success or else a negative value.
+ */
+static
+int handle_index_notification(struct live_worker *worker,
+		struct lttng_poll_event *events,
+		struct lttng_ht *viewer_connections_ht)
+{
+	ssize_t ret;
+	uint64_t session_id;
+	struct relay_session *session;
+	struct relay_connection *conn;
+	struct lttng_ht_iter iter;
+
+	ret = lttng_read(worker->notify_pipe[0], &session_id,
+			sizeof(session_id));
+	if (ret < sizeof(session_id)) {
+		return -1;
+	}
+
+	session = session_get_by_id(session_id);
+	if (!session) {
+		return 0;
+	}
+	/* Indexes received from now on need a new notification. */
+	uatomic_set(&session->index_subscriptions[worker->id].notify_pending, 0);
+
+	rcu_read_lock();
+	cds_lfht_for_each_entry(viewer_connections_ht->ht, &iter.iter, conn,
+			sock_n.node) {
+		if (conn->index_session != session) {
+			continue;
+		}
+		if (send_index_notification(conn) < 0 ||
+				update_index_notification_poll(events, conn) < 0) {
+			close_connection(worker, events, conn->sock->fd, conn);
+		}
+	}
+	rcu_read_unlock();
+	session_put(session);
+	return 0;
+}
+
+/*
+ * This thread does the actual work for the connections handed to the given
+ * live_worker.
  */
 static
 void *thread_worker(void *data)
@@ -1833,8 +2629,9 @@ void *thread_worker(void *data)
 	struct lttng_ht_iter iter;
 	struct lttng_viewer_cmd recv_hdr;
 	struct relay_connection *destroy_conn;
+	struct live_worker *worker = data;
 
-	DBG("[thread] Live viewer relay worker started");
+	DBG("[thread] Live viewer relay worker %u started", worker->id);
 
 	rcu_register_thread();
 
@@ -1850,12 +2647,18 @@ void *thread_worker(void *data)
 		goto viewer_connections_ht_error;
 	}
 
-	ret = create_thread_poll_set(&events, 2);
+	ret = create_thread_poll_set(&events, 3);
 	if (ret < 0) {
 		goto error_poll_create;
 	}
 
-	ret = lttng_poll_add(&events, live_conn_pipe[0], LPOLLIN | LPOLLRDHUP);
+	ret = lttng_poll_add(&events, worker->conn_pipe[0], LPOLLIN | LPOLLRDHUP);
+	if (ret < 0) {
+		goto error;
+	}
+
+	ret = lttng_poll_add(&events, worker->notify_pipe[0],
+			LPOLLIN | LPOLLRDHUP);
 	if (ret < 0) {
 		goto error;
 	}
@@ -1908,11 +2711,11 @@ restart:
 			}
 
 			/* Inspect the relay conn pipe for new connection. */
-			if (pollfd == live_conn_pipe[0]) {
+			if (pollfd == worker->conn_pipe[0]) {
 				if (revents & LPOLLIN) {
 					struct relay_connection *conn;
 
-					ret = lttng_read(live_conn_pipe[0],
+					ret = lttng_read(worker->conn_pipe[0],
 							&conn, sizeof(conn));
 					if (ret < 0) {
 						goto error;
@@ -1928,6 +2731,20 @@ restart:
 					ERR("Unexpected poll events %u for sock %d", revents, pollfd);
 					goto error;
 				}
+			} else if (pollfd == worker->notify_pipe[0]) {
+				if (revents & LPOLLIN) {
+					ret = handle_index_notification(worker,
+							&events, viewer_connections_ht);
+					if (ret < 0) {
+						goto error;
+					}
+				} else if (revents & (LPOLLERR | LPOLLHUP | LPOLLRDHUP)) {
+					ERR("Relay live notification pipe error");
+					goto error;
+				} else {
+					ERR("Unexpected poll events %u for sock %d", revents, pollfd);
+					goto error;
+				}
 			} else {
 				/* Connection activity. */
 				struct relay_connection *conn;
@@ -1937,30 +2754,47 @@ restart:
 					continue;
 				}
 
+				/* The viewer can read its index notifications again. */
+				if (revents & LPOLLOUT) {
+					ret = resume_index_notification(conn);
+					if (ret == 0) {
+						ret = update_index_notification_poll(
+								&events, conn);
+					}
+					if (ret < 0) {
+						close_connection(worker, &events,
+								pollfd, conn);
+						connection_put(conn);
+						continue;
+					}
+				}
+
 				if (revents & LPOLLIN) {
 					ret = conn->sock->ops->recvmsg(conn->sock, &recv_hdr,
 							sizeof(recv_hdr), 0);
 					if (ret <= 0) {
 						/* Connection closed. */
-						cleanup_connection_pollfd(&events, pollfd);
-						/* Put "create" ownership reference. */
-						connection_put(conn);
+						close_connection(worker, &events,
+								pollfd, conn);
 						DBG("Viewer control conn closed with %d", pollfd);
 					} else {
 						ret = process_control(&recv_hdr, conn);
+						if (ret >= 0) {
+							ret = update_index_notification_poll(
+									&events, conn);
+						}
 						if (ret < 0) {
 							/* Clear the session on error. */
-							cleanup_connection_pollfd(&events, pollfd);
-							/* Put "create" ownership reference. */
-							connection_put(conn);
+							close_connection(worker,
+									&events, pollfd,
+									conn);
 							DBG("Viewer connection closed with %d", pollfd);
 						}
 					}
 				} else if (revents & (LPOLLERR | LPOLLHUP | LPOLLRDHUP)) {
-					cleanup_connection_pollfd(&events, pollfd);
-					/* Put "create" ownership reference. */
-					connection_put(conn);
-				} else {
+					close_connection(worker, &events, pollfd,
+							conn);
+				} else if (!(revents & LPOLLOUT)) {
 					ERR("Unexpected poll events %u for sock %d", revents, pollfd);
 					connection_put(conn);
 					goto error;
@@ -1987,8 +2821,6 @@ error:
 error_poll_create:
 	lttng_ht_destroy(viewer_connections_ht);
 viewer_connections_ht_error:
-	/* Close relay conn pipes */
-	utils_close_pipe(live_conn_pipe);
 	if (err) {
 		DBG("Viewer worker thread exited with error");
 	}
@@ -2007,12 +2839,28 @@ error_testpoint:
 }
 
 /*
- * Create the relay command pipe to wake thread_manage_apps.
- * Closed in cleanup().
+ * Join the live worker threads started so far.
+ *
+ * Return 0 on success or else a negative value.
  */
-static int create_conn_pipe(void)
+static
+int join_live_workers(void)
 {
-	return utils_create_pipe_cloexec(live_conn_pipe);
+	int ret, retval = 0;
+	unsigned int i;
+	void *status;
+
+	for (i = 0; i < live_nb_workers_started; i++) {
+		ret = pthread_join(live_workers[i].thread, &status);
+		if (ret) {
+			errno = ret;
+			PERROR("pthread_join live worker");
+			retval = -1;
+		}
+	}
+	live_nb_workers_started = 0;
+
+	return retval;
 }
 
 int relayd_live_join(void)
@@ -2027,10 +2875,7 @@ int relayd_live_join(void)
 		retval = -1;
 	}
 
-	ret = pthread_join(live_worker_thread, &status);
-	if (ret) {
-		errno = ret;
-		PERROR("pthread_join live worker");
+	if (join_live_workers()) {
 		retval = -1;
 	}
 
@@ -2041,17 +2886,16 @@ int relayd_live_join(void)
 		retval = -1;
 	}
 
-	cleanup_relayd_live();
-
 	return retval;
 }
 
 /*
  * main
  */
-int relayd_live_create(struct lttng_uri *uri)
+int relayd_live_create(struct lttng_uri *uri, unsigned int nb_workers)
 {
 	int ret = 0, retval = 0;
+	unsigned int i;
 	void *status;
 	int is_root;
 
@@ -2072,8 +2916,8 @@ int relayd_live_create(struct lttng_uri *uri)
 		}
 	}
 
-	/* Setup the thread apps communication pipe. */
-	if (create_conn_pipe()) {
+	/* Setup the worker threads communication pipes. */
+	if (create_live_workers(nb_workers)) {
 		retval = -1;
 		goto exit_init_data;
 	}
@@ -2097,14 +2941,17 @@ int relayd_live_create(struct lttng_uri *uri)
 		goto exit_dispatcher_thread;
 	}
 
-	/* Setup the worker thread */
-	ret = pthread_create(&live_worker_thread, NULL,
-			thread_worker, NULL);
-	if (ret) {
-		errno = ret;
-		PERROR("pthread_create viewer worker");
-		retval = -1;
-		goto exit_worker_thread;
+	/* Setup the worker threads */
+	for (i = 0; i < live_nb_workers; i++) {
+		ret = pthread_create(&live_workers[i].thread, NULL,
+				thread_worker, &live_workers[i]);
+		if (ret) {
+			errno = ret;
+			PERROR("pthread_create viewer worker");
+			retval = -1;
+			goto exit_worker_thread;
+		}
+		live_nb_workers_started++;
 	}
 
 	/* Setup the listener thread */
@@ -2128,14 +2975,10 @@ int relayd_live_create(struct lttng_uri *uri)
 	 */
 
 exit_listener_thread:
-
-	ret = pthread_join(live_worker_thread, &status);
-	if (ret) {
-		errno = ret;
-		PERROR("pthread_join live worker");
+exit_worker_thread:
+	if (join_live_workers()) {
 		retval = -1;
 	}
-exit_worker_thread:
 
 	ret = pthread_join(live_dispatcher_thread, &status);
 	if (ret) {
@@ -2146,7 +2989,5 @@ exit_worker_thread:
 exit_dispatcher_thread:
 
 exit_init_data:
-	cleanup_relayd_live();
-
 	return retval;
 }
@@ -24,10 +24,14 @@
 
 #include "lttng-relayd.h"
 
-int relayd_live_create(struct lttng_uri *live_uri);
+struct relay_session;
+
+int relayd_live_create(struct lttng_uri *live_uri, unsigned int nb_workers);
 int relayd_live_stop(void);
 int relayd_live_join(void);
+void relayd_live_destroy(void);
 
 struct relay_viewer_stream *live_find_viewer_stream_by_id(uint64_t stream_id);
+void live_notify_session_indexes(struct relay_session *session);
 
 #endif /* LTTNG_RELAYD_LIVE_H */
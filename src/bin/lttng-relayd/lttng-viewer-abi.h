@@ -31,6 +31,23 @@
 #define LTTNG_VIEWER_NAME_MAX		255
 #define LTTNG_VIEWER_HOST_NAME_MAX	64
 
+/*
+ * Minimum minor version of the protocol, as negotiated by
+ * LTTNG_VIEWER_CONNECT, implementing the LTTNG_VIEWER_CLIENT_NOTIFICATION
+ * connections and the LTTNG_VIEWER_SUBSCRIBE_INDEXES command. A relay daemon
+ * replying with an older minor version closes the connection on them.
+ */
+#define LTTNG_VIEWER_INDEX_NOTIFICATION_MINOR	8
+
+/*
+ * Minimum minor version of the protocol implementing the
+ * LTTNG_VIEWER_GET_PACKETS command.
+ */
+#define LTTNG_VIEWER_GET_PACKETS_MINOR		8
+
+/* Maximum number of packets requested by a LTTNG_VIEWER_GET_PACKETS. */
+#define LTTNG_VIEWER_GET_PACKETS_MAX	128
+
 /* Flags in reply to get_next_index and get_packet. */
 enum {
 	/* New metadata is required to read this packet. */
@@ -48,6 +65,8 @@ enum lttng_viewer_command {
 	LTTNG_VIEWER_GET_METADATA	= 6,
 	LTTNG_VIEWER_GET_NEW_STREAMS	= 7,
 	LTTNG_VIEWER_CREATE_SESSION	= 8,
+	LTTNG_VIEWER_SUBSCRIBE_INDEXES	= 9,
+	LTTNG_VIEWER_GET_PACKETS	= 10,
 };
 
 enum lttng_viewer_attach_return_code {
@@ -105,6 +124,18 @@ enum lttng_viewer_create_session_return_code {
 	LTTNG_VIEWER_CREATE_SESSION_ERR		= 2,
 };
 
+enum lttng_viewer_subscribe_indexes_return_code {
+	LTTNG_VIEWER_SUBSCRIBE_OK		= 1,
+	LTTNG_VIEWER_SUBSCRIBE_UNK		= 2, /* The session ID is unknown. */
+	LTTNG_VIEWER_SUBSCRIBE_NOT_LIVE		= 3, /* The session is not live. */
+	LTTNG_VIEWER_SUBSCRIBE_ERR		= 4, /* Not a notification connection. */
+};
+
+enum lttng_viewer_index_notification_status {
+	LTTNG_VIEWER_INDEX_NOTIFICATION_OK	= 1, /* Streams have indexes. */
+	LTTNG_VIEWER_INDEX_NOTIFICATION_HUP	= 2, /* Session closed, last one. */
+};
+
 struct lttng_viewer_session {
 	uint64_t id;
 	uint32_t live_timer;
@@ -199,6 +230,22 @@ struct lttng_viewer_trace_packet {
 	char data[];
 } __attribute__((__packed__));
 
+/*
+ * LTTNG_VIEWER_GET_PACKETS payload, followed by packets_count
+ * struct lttng_viewer_get_packet (at most LTTNG_VIEWER_GET_PACKETS_MAX).
+ */
+struct lttng_viewer_get_packets {
+	uint32_t packets_count;
+} __attribute__((__packed__));
+
+/*
+ * Followed, for each requested packet in order, by a struct
+ * lttng_viewer_trace_packet and its data.
+ */
+struct lttng_viewer_trace_packets {
+	uint32_t packets_count;
+} __attribute__((__packed__));
+
 /*
  * LTTNG_VIEWER_GET_METADATA payload.
  */
@@ -232,4 +279,32 @@ struct lttng_viewer_create_session_response {
 	uint32_t status;
 } __attribute__((__packed__));
 
+/*
+ * LTTNG_VIEWER_SUBSCRIBE_INDEXES payload. Only accepted on a
+ * LTTNG_VIEWER_CLIENT_NOTIFICATION connection, which then receives a
+ * struct lttng_viewer_index_notification whenever indexes of the session
+ * become available, instead of polling every stream with
+ * LTTNG_VIEWER_GET_NEXT_INDEX.
+ */
+struct lttng_viewer_subscribe_indexes_request {
+	uint64_t session_id;
+} __attribute__((__packed__));
+
+struct lttng_viewer_subscribe_indexes_response {
+	/* enum lttng_viewer_subscribe_indexes_return_code */
+	uint32_t status;
+} __attribute__((__packed__));
+
+/*
+ * Pushed on a subscribed notification connection. Lists the streams for which
+ * LTTNG_VIEWER_GET_NEXT_INDEX has an index or an inactivity beacon to return.
+ */
+struct lttng_viewer_index_notification {
+	/* enum lttng_viewer_index_notification_status */
+	uint32_t status;
+	uint32_t streams_count;
+	/* uint64_t stream ids */
+	char stream_ids[];
+} __attribute__((__packed__));
+
 #endif /* LTTNG_VIEWER_ABI_H */
@@ -102,17 +102,87 @@ const char * const config_section_name = "relayd";
 int thread_quit_pipe[2] = { -1, -1 };
 
 /*
- * This pipe is used to inform the worker thread that a command is queued and
- * ready to be processed.
+ * Worker thread processing the commands and data of a subset of the
+ * sessiond/consumerd connections. A connection is handed to a single worker by
+ * the dispatcher thread and is only processed by that worker afterwards.
  */
-static int relay_conn_pipe[2] = { -1, -1 };
+struct relay_worker {
+	unsigned int id;
+	pthread_t thread;
+	/*
+	 * This pipe is used to inform the worker thread that a connection is
+	 * queued and ready to be processed.
+	 */
+	int conn_pipe[2];
+	/*
+	 * Number of connections handled by this worker. Incremented by the
+	 * dispatcher thread and decremented by the worker itself.
+	 */
+	unsigned long nb_connections;
+	/* Buffer used to receive the trace data and metadata. */
+	char *data_buffer;
+	unsigned int data_buffer_size;
+	/*
+	 * Pipe used to splice the trace data from the data sockets to the trace
+	 * files without copying it to user space. Set to -1 when the trace data
+	 * is received in data_buffer instead. splice_pending is the number of
+	 * bytes of the packet being received that are held in the pipe.
+	 */
+	int splice_pipe[2];
+	size_t splice_pipe_size;
+	size_t splice_pending;
+};
+
+/*
+ * Control connection waiting for the data connection of the same peer. Used by
+ * the dispatcher to try handing both connections of a consumer to the same
+ * worker, which avoids contention on the stream locks between workers.
+ *
+ * This is a best-effort heuristic: connections are only paired by peer
+ * address since nothing identifies the consumer before the first command.
+ * Consumers connecting concurrently from the same host (or from behind the same
+ * NAT) can be cross-paired. The stream locks keep this correct, the streams of
+ * such consumers are merely processed by two workers.
+ *
+ * Only accessed by the dispatcher thread.
+ */
+struct relay_conn_pairing {
+	int family;
+	union {
+		struct in_addr sin_addr;
+		struct in6_addr sin6_addr;
+	} addr;
+	struct relay_worker *worker;
+	struct cds_list_head list;
+};
+
+/*
+ * Maximum number of control connections waiting for their data connection.
+ * The oldest one is forgotten once this is reached.
+ */
+#define RELAY_MAX_CONN_PAIRINGS		64
+
+/*
+ * Capacity requested for the splice pipe of the workers. Only the packets that
+ * fit in the pipe are spliced, they are entirely received before the stream
+ * lock is taken. Larger packets are received in the worker's buffer.
+ */
+#define RELAY_SPLICE_PIPE_SIZE		(1024 * 1024)
+
+/* Capacity of a pipe when it can't be queried. */
+#define RELAY_DEFAULT_PIPE_SIZE		(64 * 1024)
+
+static unsigned int opt_worker_threads = DEFAULT_RELAYD_WORKER_THREADS;
+static unsigned int opt_live_worker_threads = DEFAULT_RELAYD_LIVE_WORKER_THREADS;
+
+static struct relay_worker *relay_workers;
+static unsigned int relay_nb_workers;
 
 /* Shared between threads */
 static int dispatch_thread_exit;
 
 static pthread_t listener_thread;
 static pthread_t dispatcher_thread;
-static pthread_t worker_thread;
 static pthread_t health_thread;
 
 /*
@@ -130,10 +200,6 @@ static uint64_t last_relay_stream_id;
  */
 static struct relay_conn_queue relay_conn_queue;
 
-/* buffer allocated at startup, used to store the trace data */
-static char *data_buffer;
-static unsigned int data_buffer_size;
-
 /* Global relay stream hash table. */
 struct lttng_ht *relay_streams_ht;
 
@@ -157,6 +223,8 @@ static struct option long_options[] = {
 	{ "output", 1, 0, 'o', },
 	{ "verbose", 0, 0, 'v', },
 	{ "config", 1, 0, 'f' },
+	{ "worker-threads", 1, 0, 'w', },
+	{ "live-worker-threads", 1, 0, 'W', },
 	{ NULL, 0, 0, 0, },
 };
 
@@ -175,6 +243,13 @@ static void usage(void)
 	fprintf(stderr, "  -D, --data-port URL       Data port listening.\n");
 	fprintf(stderr, "  -L, --live-port URL       Live view port listening.\n");
 	fprintf(stderr, "  -o, --output PATH         Output path for traces. Must use an absolute path.\n");
+	fprintf(stderr, "  -w, --worker-threads NUM  Number of threads handling the control and data\n");
+	fprintf(stderr, "                            connections. (default: %d)\n",
+			DEFAULT_RELAYD_WORKER_THREADS);
+	fprintf(stderr, "  -W, --live-worker-threads NUM\n");
+	fprintf(stderr, "                            Number of threads handling the live viewer\n");
+	fprintf(stderr, "                            connections. (default: %d)\n",
+			DEFAULT_RELAYD_LIVE_WORKER_THREADS);
 	fprintf(stderr, "  -v, --verbose             Verbose mode. Activate DBG() macro.\n");
 	fprintf(stderr, "  -g, --group NAME          Specify the tracing group name. (default: tracing)\n");
 	fprintf(stderr, "  -f  --config              Load daemon configuration file\n");
@@ -278,6 +353,36 @@ static int set_option(int opt, const char *arg, const char *optname)
 			}
 		}
 		break;
+	case 'w':
+	{
+		unsigned long v;
+		char *endptr;
+
+		errno = 0;
+		v = strtoul(arg, &endptr, 10);
+		if (errno != 0 || *endptr != '\0' || v == 0 || v > UINT_MAX) {
+			ERR("Invalid number of worker threads: %s", arg);
+			ret = -1;
+			goto end;
+		}
+		opt_worker_threads = (unsigned int) v;
+		break;
+	}
+	case 'W':
+	{
+		unsigned long v;
+		char *endptr;
+
+		errno = 0;
+		v = strtoul(arg, &endptr, 10);
+		if (errno != 0 || *endptr != '\0' || v == 0 || v > UINT_MAX) {
+			ERR("Invalid number of live worker threads: %s", arg);
+			ret = -1;
+			goto end;
+		}
+		opt_live_worker_threads = (unsigned int) v;
+		break;
+	}
 	case 'v':
 		/* Verbose level can increase using multiple -v */
 		if (arg) {
@@ -492,6 +597,95 @@ static void print_global_objects(void)
 	rcu_unregister_thread();
 }
 
+/*
+ * Create the splice pipe of a worker and grow it so most packets fit in it.
+ * The worker receives the trace data in its buffer if this fails or if splice
+ * is not available on this platform.
+ */
+static void relay_splice_pipe_init(struct relay_worker *worker)
+{
+#ifdef __linux__
+	int ret;
+
+	ret = utils_create_pipe_cloexec(worker->splice_pipe);
+	if (ret < 0) {
+		WARN("Worker %u splice pipe creation failed, splice disabled",
+				worker->id);
+		worker->splice_pipe[0] = worker->splice_pipe[1] = -1;
+		return;
+	}
+
+	worker->splice_pipe_size = RELAY_DEFAULT_PIPE_SIZE;
+#if defined(F_SETPIPE_SZ) && defined(F_GETPIPE_SZ)
+	/* Best effort, the size is capped by /proc/sys/fs/pipe-max-size. */
+	(void) fcntl(worker->splice_pipe[1], F_SETPIPE_SZ, RELAY_SPLICE_PIPE_SIZE);
+	ret = fcntl(worker->splice_pipe[1], F_GETPIPE_SZ);
+	if (ret > 0) {
+		worker->splice_pipe_size = ret;
+	}
+#endif /* F_SETPIPE_SZ && F_GETPIPE_SZ */
+#else
+	/* The compat splice() of the other platforms is not implemented. */
+	DBG("Splice not available, worker %u copies the trace data", worker->id);
+	worker->splice_pipe[0] = worker->splice_pipe[1] = -1;
+#endif /* __linux__ */
+}
+
+/*
+ * Allocate the worker threads data and their connection pipes.
+ * Freed in relayd_cleanup().
+ */
+static int create_relay_workers(unsigned int nb_workers)
+{
+	int ret;
+	unsigned int i;
+
+	relay_workers = zmalloc(nb_workers * sizeof(*relay_workers));
+	if (!relay_workers) {
+		PERROR("zmalloc relay workers");
+		ret = -1;
+		goto end;
+	}
+	relay_nb_workers = nb_workers;
+
+	for (i = 0; i < nb_workers; i++) {
+		relay_workers[i].id = i;
+		relay_workers[i].conn_pipe[0] = -1;
+		relay_workers[i].conn_pipe[1] = -1;
+		relay_workers[i].splice_pipe[0] = -1;
+		relay_workers[i].splice_pipe[1] = -1;
+	}
+
+	for (i = 0; i < nb_workers; i++) {
+		ret = utils_create_pipe_cloexec(relay_workers[i].conn_pipe);
+		if (ret < 0) {
+			goto end;
+		}
+		relay_splice_pipe_init(&relay_workers[i]);
+	}
+
+	ret = 0;
+end:
+	return ret;
+}
+
+static void destroy_relay_workers(void)
+{
+	unsigned int i;
+
+	if (!relay_workers) {
+		return;
+	}
+
+	for (i = 0; i < relay_nb_workers; i++) {
+		utils_close_pipe(relay_workers[i].conn_pipe);
+		utils_close_pipe(relay_workers[i].splice_pipe);
+	}
+	free(relay_workers);
+	relay_workers = NULL;
+	relay_nb_workers = 0;
+}
+
 /*
  * Cleanup the daemon
  */
@@ -514,9 +708,12 @@ static void relayd_cleanup(void)
 	/* Close thread quit pipes */
 	utils_close_pipe(thread_quit_pipe);
 
+	/* Close the worker threads connection pipes */
+	destroy_relay_workers();
+
 	uri_free(control_uri);
 	uri_free(data_uri);
-	/* Live URI is freed in the live thread. */
+	/* Live URI is freed by relayd_live_destroy(). */
 
 	if (tracing_group_name_override) {
 		free((void *) tracing_group_name);
@@ -956,6 +1153,116 @@ error_sock_control:
 	return NULL;
 }
 
+/*
+ * Return the worker thread currently handling the least connections.
+ */
+static struct relay_worker *relay_select_worker(void)
+{
+	unsigned int i;
+	struct relay_worker *worker = &relay_workers[0];
+
+	for (i = 1; i < relay_nb_workers; i++) {
+		if (uatomic_read(&relay_workers[i].nb_connections) <
+				uatomic_read(&worker->nb_connections)) {
+			worker = &relay_workers[i];
+		}
+	}
+
+	return worker;
+}
+
+/*
+ * Fill the peer address of a pairing from an accepted socket.
+ *
+ * Return 0 on success or -1 if the address family is not supported.
+ */
+static int relay_conn_pairing_set_peer(struct relay_conn_pairing *pairing,
+		struct lttcomm_sock *sock)
+{
+	pairing->family = sock->sockaddr.addr.sin.sin_family;
+	switch (pairing->family) {
+	case AF_INET:
+		pairing->addr.sin_addr = sock->sockaddr.addr.sin.sin_addr;
+		break;
+	case AF_INET6:
+		pairing->addr.sin6_addr = sock->sockaddr.addr.sin6.sin6_addr;
+		break;
+	default:
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * Select the worker thread of a new connection.
+ *
+ * The session daemon connects the control socket of a consumer and then its
+ * data socket. A data connection is thus handed to the worker of the oldest
+ * control connection of the same peer still waiting for its data connection so
+ * the control commands and the data of a stream are usually processed by the
+ * same thread; see struct relay_conn_pairing for the limits of this pairing.
+ * Other connections go to the least loaded worker.
+ */
+static struct relay_worker *relay_dispatch_select_worker(
+		struct cds_list_head *pairings, unsigned int *nb_pairings,
+		struct relay_connection *conn)
+{
+	struct relay_worker *worker = NULL;
+	struct relay_conn_pairing peer, *pairing, *tmp;
+
+	if (relay_nb_workers == 1) {
+		return &relay_workers[0];
+	}
+
+	if (relay_conn_pairing_set_peer(&peer, conn->sock)) {
+		goto end;
+	}
+
+	if (conn->type == RELAY_DATA) {
+		cds_list_for_each_entry_safe(pairing, tmp, pairings, list) {
+			size_t len = pairing->family == AF_INET ?
+					sizeof(pairing->addr.sin_addr) :
+					sizeof(pairing->addr.sin6_addr);
+
+			if (pairing->family != peer.family ||
+					memcmp(&pairing->addr, &peer.addr, len)) {
+				continue;
+			}
+			worker = pairing->worker;
+			cds_list_del(&pairing->list);
+			free(pairing);
+			(*nb_pairings)--;
+			goto end;
+		}
+	} else if (conn->type == RELAY_CONTROL) {
+		worker = relay_select_worker();
+
+		if (*nb_pairings == RELAY_MAX_CONN_PAIRINGS) {
+			/* Forget the oldest one. */
+			pairing = cds_list_first_entry(pairings,
+					struct relay_conn_pairing, list);
+			cds_list_del(&pairing->list);
+		} else {
+			pairing = zmalloc(sizeof(*pairing));
+			if (!pairing) {
+				PERROR("zmalloc relay connection pairing");
+				goto end;
+			}
+			(*nb_pairings)++;
+		}
+		*pairing = peer;
+		pairing->worker = worker;
+		cds_list_add_tail(&pairing->list, pairings);
+	}
+
+end:
+	if (!worker) {
+		worker = relay_select_worker();
+	}
+	return worker;
+}
+
 /*
  * This thread manages the dispatching of the requests to worker threads
  */
@@ -963,8 +1270,14 @@ static void *relay_thread_dispatcher(void *data)
 {
 	int err = -1;
 	ssize_t ret;
+	unsigned int nb_pairings = 0;
 	struct cds_wfcq_node *node;
 	struct relay_connection *new_conn = NULL;
+	struct relay_worker *worker;
+	struct relay_conn_pairing *pairing, *tmp;
+	struct cds_list_head pairings;
+
+	CDS_INIT_LIST_HEAD(&pairings);
 
 	DBG("[thread] Relay dispatcher started");
 
@@ -995,7 +1308,12 @@ static void *relay_thread_dispatcher(void *data)
 			}
 			new_conn = caa_container_of(node, struct relay_connection, qnode);
 
-			DBG("Dispatching request waiting on sock %d", new_conn->sock->fd);
+			worker = relay_dispatch_select_worker(&pairings, &nb_pairings,
+					new_conn);
+			uatomic_inc(&worker->nb_connections);
+
+			DBG("Dispatching request waiting on sock %d to worker %u",
+					new_conn->sock->fd, worker->id);
 
 			/*
 			 * Inform worker thread of the new request. This
@@ -1003,9 +1321,11 @@ static void *relay_thread_dispatcher(void *data)
 			 * the data will be read at some point in time
 			 * or wait to the end of the world :)
 			 */
-			ret = lttng_write(relay_conn_pipe[1], &new_conn, sizeof(new_conn));
+			ret = lttng_write(worker->conn_pipe[1], &new_conn,
+					sizeof(new_conn));
 			if (ret < 0) {
 				PERROR("write connection pipe");
+				uatomic_dec(&worker->nb_connections);
 				connection_put(new_conn);
 				goto error;
 			}
@@ -1021,6 +1341,10 @@ static void *relay_thread_dispatcher(void *data)
 	err = 0;
 
 error:
+	cds_list_for_each_entry_safe(pairing, tmp, &pairings, list) {
+		cds_list_del(&pairing->list);
+		free(pairing);
+	}
 error_testpoint:
 	if (err) {
 		health_error();
@@ -1372,36 +1696,189 @@ static int relay_start(struct lttcomm_relayd_hdr *recv_hdr,
  */
 static int write_padding_to_file(int fd, uint32_t size)
 {
-	ssize_t ret = 0;
-	char *zeros;
+	int ret = 0;
+	off_t offset;
 
 	if (size == 0) {
 		goto end;
 	}
 
-	zeros = zmalloc(size);
-	if (zeros == NULL) {
-		PERROR("zmalloc zeros for padding");
+	/*
+	 * Trace files are only ever appended to, so the padding is added by
+	 * extending the file which reads back as zeros without writing them.
+	 */
+	offset = lseek(fd, size, SEEK_CUR);
+	if (offset < 0) {
+		PERROR("lseek padding");
 		ret = -1;
 		goto end;
 	}
 
-	ret = lttng_write(fd, zeros, size);
-	if (ret < size) {
-		PERROR("write padding to file");
+	ret = ftruncate(fd, offset);
+	if (ret < 0) {
+		PERROR("ftruncate padding");
+		goto end;
 	}
 
-	free(zeros);
-
 end:
 	return ret;
 }
 
+/*
+ * Make sure the receive buffer of a worker can hold at least size bytes.
+ *
+ * Return the buffer or NULL on allocation error.
+ */
+static char *relay_worker_get_buffer(struct relay_worker *worker,
+		size_t size)
+{
+	if (worker->data_buffer_size < size) {
+		char *tmp_data_ptr;
+
+		tmp_data_ptr = realloc(worker->data_buffer, size);
+		if (!tmp_data_ptr) {
+			ERR("Allocating data buffer");
+			/* In case the realloc fails, we can free the memory */
+			free(worker->data_buffer);
+			worker->data_buffer = NULL;
+			worker->data_buffer_size = 0;
+			return NULL;
+		}
+		worker->data_buffer = tmp_data_ptr;
+		worker->data_buffer_size = size;
+	}
+
+	return worker->data_buffer;
+}
+
+/*
+ * Discard the content of the splice pipe of a worker after an error. The pipe
+ * is replaced and splice is disabled for this worker if that fails.
+ */
+static void relay_splice_reset(struct relay_worker *worker)
+{
+	int ret;
+
+	if (worker->splice_pending == 0) {
+		return;
+	}
+
+	utils_close_pipe(worker->splice_pipe);
+	worker->splice_pipe[0] = worker->splice_pipe[1] = -1;
+	worker->splice_pending = 0;
+
+	ret = utils_create_pipe_cloexec(worker->splice_pipe);
+	if (ret < 0) {
+		ERR("Worker %u splice pipe creation failed, splice disabled",
+				worker->id);
+		worker->splice_pipe[0] = worker->splice_pipe[1] = -1;
+	}
+}
+
+/*
+ * Move len bytes of trace data from the socket of a data connection to the
+ * splice pipe of a worker. The pipe must have room for them.
+ *
+ * Return 0 on success else a negative value.
+ */
+static int relay_splice_recv(struct relay_worker *worker,
+		struct relay_connection *conn, size_t len)
+{
+	ssize_t ret;
+
+	assert(worker->splice_pending + len <= worker->splice_pipe_size);
+
+	while (len > 0) {
+		ret = splice(conn->sock->fd, NULL, worker->splice_pipe[1], NULL,
+				len, SPLICE_F_MOVE | SPLICE_F_MORE);
+		if (ret < 0 && errno == EINTR) {
+			continue;
+		} else if (ret <= 0) {
+			if (ret == 0) {
+				/* Orderly shutdown. Not necessary to print an error. */
+				DBG("Socket %d did an orderly shutdown", conn->sock->fd);
+			} else {
+				PERROR("splice socket %d to pipe", conn->sock->fd);
+			}
+			return -1;
+		}
+		worker->splice_pending += ret;
+		len -= ret;
+	}
+
+	return 0;
+}
+
+/*
+ * Write the packet held in the splice pipe of the worker to fd. Fall back on
+ * copying the data through the worker's buffer if the file does not support
+ * splice or if splice is not implemented. Nothing is received from the
+ * network here since this is called with the stream lock held.
+ *
+ * Return 0 on success else a negative value.
+ */
+static int relay_splice_data(struct relay_worker *worker, int fd)
+{
+	ssize_t ret;
+	size_t left;
+	char *data_buffer;
+
+	while (worker->splice_pending > 0) {
+		ret = splice(worker->splice_pipe[0], NULL, fd, NULL,
+				worker->splice_pending, SPLICE_F_MOVE | SPLICE_F_MORE);
+		if (ret < 0 && errno == EINTR) {
+			continue;
+		} else if (ret < 0 && (errno == EINVAL || errno == ENOSYS)) {
+			WARN("Splice to trace file not supported, worker %u falls back on copying trace data",
+					worker->id);
+			goto fallback;
+		} else if (ret <= 0) {
+			PERROR("splice pipe to file");
+			ret = -1;
+			goto error;
+		}
+		worker->splice_pending -= ret;
+	}
+
+	return 0;
+
+fallback:
+	left = worker->splice_pending;
+	data_buffer = relay_worker_get_buffer(worker, left);
+	if (!data_buffer) {
+		ret = -1;
+		goto error;
+	}
+
+	ret = lttng_read(worker->splice_pipe[0], data_buffer, left);
+	if (ret < (ssize_t) left) {
+		PERROR("read splice pipe");
+		ret = -1;
+		goto error;
+	}
+	worker->splice_pending = 0;
+
+	/* Use the copy path for the next packets. */
+	utils_close_pipe(worker->splice_pipe);
+	worker->splice_pipe[0] = worker->splice_pipe[1] = -1;
+
+	ret = lttng_write(fd, data_buffer, left);
+	if (ret < (ssize_t) left) {
+		ERR("Relay error writing data to file");
+		return -1;
+	}
+	return 0;
+
+error:
+	relay_splice_reset(worker);
+	return ret;
+}
+
 /*
  * relay_recv_metadata: receive the metadata for the session.
  */
 static int relay_recv_metadata(struct lttcomm_relayd_hdr *recv_hdr,
-		struct relay_connection *conn)
+		struct relay_connection *conn, struct relay_worker *worker)
 {
 	int ret = 0;
 	ssize_t size_ret;
@@ -1409,6 +1886,7 @@ static int relay_recv_metadata(struct lttcomm_relayd_hdr *recv_hdr,
 	struct lttcomm_relayd_metadata_payload *metadata_struct;
 	struct relay_stream *metadata_stream;
 	uint64_t data_size, payload_size;
+	char *data_buffer;
 
 	if (!session) {
 		ERR("Metadata sent before version check");
@@ -1424,19 +1902,10 @@ static int relay_recv_metadata(struct lttcomm_relayd_hdr *recv_hdr,
 	}
 	payload_size -= sizeof(struct lttcomm_relayd_metadata_payload);
 
-	if (data_buffer_size < data_size) {
-		/* In case the realloc fails, we can free the memory */
-		char *tmp_data_ptr;
-
-		tmp_data_ptr = realloc(data_buffer, data_size);
-		if (!tmp_data_ptr) {
-			ERR("Allocating data buffer");
-			free(data_buffer);
-			ret = -1;
-			goto end;
-		}
-		data_buffer = tmp_data_ptr;
-		data_buffer_size = data_size;
+	data_buffer = relay_worker_get_buffer(worker, data_size);
+	if (!data_buffer) {
+		ret = -1;
+		goto end;
 	}
 	memset(data_buffer, 0, data_size);
 	DBG2("Relay receiving metadata, waiting for %" PRIu64 " bytes", data_size);
@@ -1600,6 +2069,10 @@ static int relay_data_pending(struct lttcomm_relayd_hdr *recv_hdr,
 	if (((int64_t) (stream->prev_seq - last_net_seq_num)) >= 0) {
 		/* Data has in fact been written and is NOT pending */
 		ret = 0;
+		/* Write the batched indexes of the data along with it. */
+		if (stream_flush_indexes(stream) < 0) {
+			ret = 1;
+		}
 	} else {
 		/* Data still being streamed thus pending */
 		ret = 1;
@@ -1847,6 +2320,39 @@ end_no_session:
 	return ret;
 }
 
+/*
+ * Handle the live beacon of an idle stream.
+ *
+ * Called with the stream lock held.
+ *
+ * Return 0 on success else a negative value.
+ */
+static int handle_live_beacon(struct relay_stream *stream, uint64_t ts_end)
+{
+	int ret;
+
+	DBG("Received live beacon for stream %" PRIu64, stream->stream_handle);
+
+	/* Publish the batched indexes on every live timer tick. */
+	ret = stream_flush_indexes(stream);
+	if (ret < 0) {
+		goto end;
+	}
+
+	/*
+	 * Only flag a stream inactive when it has already received data and
+	 * no indexes are in flight.
+	 */
+	if (stream->index_received_seqcount > 0
+			&& stream->indexes_in_flight == 0) {
+		stream->beacon_ts_end = ts_end;
+		live_notify_session_indexes(stream->trace->session);
+	}
+	ret = 0;
+end:
+	return ret;
+}
+
 /*
  * Receive an index for a specific stream.
  *
@@ -1898,19 +2404,8 @@ static int relay_recv_index(struct lttcomm_relayd_hdr *recv_hdr,
 
 	/* Live beacon handling */
 	if (index_info.packet_size == 0) {
-		DBG("Received live beacon for stream %" PRIu64,
-				stream->stream_handle);
-
-		/*
-		 * Only flag a stream inactive when it has already
-		 * received data and no indexes are in flight.
-		 */
-		if (stream->index_received_seqcount > 0
-				&& stream->indexes_in_flight == 0) {
-			stream->beacon_ts_end =
-				be64toh(index_info.timestamp_end);
-		}
-		ret = 0;
+		ret = handle_live_beacon(stream,
+				be64toh(index_info.timestamp_end));
 		goto end_stream_put;
 	} else {
 		stream->beacon_ts_end = -1ULL;
@@ -1932,13 +2427,10 @@ static int relay_recv_index(struct lttcomm_relayd_hdr *recv_hdr,
 		goto end_stream_put;
 	}
 	ret = relay_index_try_flush(index);
-	if (ret == 0) {
-		tracefile_array_commit_seq(stream->tfa);
-		stream->index_received_seqcount++;
-	} else if (ret > 0) {
+	if (ret > 0) {
 		/* no flush. */
 		ret = 0;
-	} else {
+	} else if (ret < 0) {
 		ERR("relay_index_try_flush error %d", ret);
 		relay_index_put(index);
 		ret = -1;
@@ -1966,6 +2458,100 @@ end_no_session:
 	return ret;
 }
 
+/*
+ * Receive the live beacons of the idle streams of a channel.
+ *
+ * Return 0 on success else a negative value.
+ */
+static int relay_recv_beacons(struct lttcomm_relayd_hdr *recv_hdr,
+		struct relay_connection *conn, struct relay_worker *worker)
+{
+	int ret = 0, send_ret;
+	ssize_t size_ret;
+	uint32_t i, count;
+	uint64_t data_size;
+	struct lttcomm_relayd_beacons *beacons;
+	struct lttcomm_relayd_generic_reply reply;
+
+	DBG("Relay receiving live beacons");
+
+	if (!conn->session || conn->version_check_done == 0) {
+		ERR("Trying to send beacons before version check");
+		ret = -1;
+		goto end_no_session;
+	}
+
+	data_size = be64toh(recv_hdr->data_size);
+	if (data_size < sizeof(*beacons)) {
+		ERR("Incorrect data size");
+		ret = -1;
+		goto end_no_session;
+	}
+
+	beacons = (struct lttcomm_relayd_beacons *)
+			relay_worker_get_buffer(worker, data_size);
+	if (!beacons) {
+		ret = -1;
+		goto end_no_session;
+	}
+	size_ret = conn->sock->ops->recvmsg(conn->sock, beacons, data_size, 0);
+	if (size_ret < 0 || size_ret != data_size) {
+		if (size_ret == 0) {
+			/* Orderly shutdown. Not necessary to print an error. */
+			DBG("Socket %d did an orderly shutdown", conn->sock->fd);
+		} else {
+			ERR("Relay didn't receive the whole beacons batch");
+		}
+		ret = -1;
+		goto end_no_session;
+	}
+
+	count = be32toh(beacons->count);
+	if ((data_size - sizeof(*beacons)) / sizeof(beacons->beacons[0]) != count
+			|| (data_size - sizeof(*beacons)) % sizeof(beacons->beacons[0])) {
+		ERR("Incorrect beacons count %" PRIu32 " for data size %" PRIu64,
+				count, data_size);
+		ret = -1;
+		goto end;
+	}
+
+	for (i = 0; i < count; i++) {
+		struct relay_stream *stream;
+
+		stream = stream_get_by_id(be64toh(beacons->beacons[i].relay_stream_id));
+		if (!stream) {
+			/* The stream may have been closed since. */
+			DBG("Beacon for unknown stream %" PRIu64,
+					be64toh(beacons->beacons[i].relay_stream_id));
+			continue;
+		}
+		pthread_mutex_lock(&stream->lock);
+		ret = handle_live_beacon(stream,
+				be64toh(beacons->beacons[i].timestamp_end));
+		pthread_mutex_unlock(&stream->lock);
+		stream_put(stream);
+		if (ret < 0) {
+			goto end;
+		}
+	}
+
+end:
+	memset(&reply, 0, sizeof(reply));
+	if (ret < 0) {
+		reply.ret_code = htobe32(LTTNG_ERR_UNK);
+	} else {
+		reply.ret_code = htobe32(LTTNG_OK);
+	}
+	send_ret = conn->sock->ops->sendmsg(conn->sock, &reply, sizeof(reply), 0);
+	if (send_ret < 0) {
+		ERR("Relay sending beacons reply");
+		ret = send_ret;
+	}
+
+end_no_session:
+	return ret;
+}
+
 /*
  * Receive the streams_sent message.
  *
@@ -2012,7 +2598,7 @@ end_no_session:
  * Process the commands received on the control socket
  */
 static int relay_process_control(struct lttcomm_relayd_hdr *recv_hdr,
-		struct relay_connection *conn)
+		struct relay_connection *conn, struct relay_worker *worker)
 {
 	int ret = 0;
 
@@ -2027,7 +2613,7 @@ static int relay_process_control(struct lttcomm_relayd_hdr *recv_hdr,
 		ret = relay_start(recv_hdr, conn);
 		break;
 	case RELAYD_SEND_METADATA:
-		ret = relay_recv_metadata(recv_hdr, conn);
+		ret = relay_recv_metadata(recv_hdr, conn, worker);
 		break;
 	case RELAYD_VERSION:
 		ret = relay_send_version(recv_hdr, conn);
@@ -2053,6 +2639,9 @@ static int relay_process_control(struct lttcomm_relayd_hdr *recv_hdr,
 	case RELAYD_STREAMS_SENT:
 		ret = relay_streams_sent(recv_hdr, conn);
 		break;
+	case RELAYD_SEND_BEACONS:
+		ret = relay_recv_beacons(recv_hdr, conn, worker);
+		break;
 	case RELAYD_UPDATE_SYNC_INFO:
 	default:
 		ERR("Received unknown command (%u)", be32toh(recv_hdr->cmd));
@@ -2135,13 +2724,10 @@ static int handle_index_data(struct relay_stream *stream, uint64_t net_seq_num,
 	}
 
 	ret = relay_index_try_flush(index);
-	if (ret == 0) {
-		tracefile_array_commit_seq(stream->tfa);
-		stream->index_received_seqcount++;
-	} else if (ret > 0) {
+	if (ret > 0) {
 		/* No flush. */
 		ret = 0;
-	} else {
+	} else if (ret < 0) {
 		/* Put self-ref for this index due to error. */
 		relay_index_put(index);
 		ret = -1;
@@ -2153,7 +2739,8 @@ end:
 /*
  * relay_process_data: Process the data received on the data socket
  */
-static int relay_process_data(struct relay_connection *conn)
+static int relay_process_data(struct relay_connection *conn,
+		struct relay_worker *worker)
 {
 	int ret = 0, rotate_index = 0;
 	ssize_t size_ret;
@@ -2163,7 +2750,8 @@ static int relay_process_data(struct relay_connection *conn)
 	uint64_t net_seq_num;
 	uint32_t data_size;
 	struct relay_session *session;
-	bool new_stream = false, close_requested = false;
+	bool new_stream = false, close_requested = false, use_splice;
+	char *data_buffer = NULL;
 
 	ret = conn->sock->ops->recvmsg(conn->sock, &data_hdr,
 			sizeof(struct lttcomm_relayd_data_hdr), 0);
@@ -2187,35 +2775,43 @@ static int relay_process_data(struct relay_connection *conn)
 	}
 	session = stream->trace->session;
 	data_size = be32toh(data_hdr.data_size);
-	if (data_buffer_size < data_size) {
-		char *tmp_data_ptr;
+	net_seq_num = be64toh(data_hdr.net_seq_num);
 
-		tmp_data_ptr = realloc(data_buffer, data_size);
-		if (!tmp_data_ptr) {
-			ERR("Allocating data buffer");
-			free(data_buffer);
+	DBG3("Receiving data of size %u for stream id %" PRIu64 " seqnum %" PRIu64,
+		data_size, stream_id, net_seq_num);
+
+	/*
+	 * The whole packet is received before taking the stream lock so a slow
+	 * peer never holds it. Packets that don't fit in the splice pipe are
+	 * received in the worker's buffer.
+	 */
+	use_splice = worker->splice_pipe[0] >= 0 &&
+			data_size <= worker->splice_pipe_size;
+	if (use_splice) {
+		/* Spliced to the trace file once the output is known. */
+		ret = relay_splice_recv(worker, conn, data_size);
+		if (ret < 0) {
+			relay_splice_reset(worker);
+			goto end_stream_put;
+		}
+	} else {
+		data_buffer = relay_worker_get_buffer(worker, data_size);
+		if (!data_buffer) {
 			ret = -1;
 			goto end_stream_put;
 		}
-		data_buffer = tmp_data_ptr;
-		data_buffer_size = data_size;
-	}
-	memset(data_buffer, 0, data_size);
 
-	net_seq_num = be64toh(data_hdr.net_seq_num);
-
-	DBG3("Receiving data of size %u for stream id %" PRIu64 " seqnum %" PRIu64,
-		data_size, stream_id, net_seq_num);
-	ret = conn->sock->ops->recvmsg(conn->sock, data_buffer, data_size, 0);
-	if (ret <= 0) {
-		if (ret == 0) {
-			/* Orderly shutdown. Not necessary to print an error. */
-			DBG("Socket %d did an orderly shutdown", conn->sock->fd);
-		} else {
-			ERR("Socket %d error %d", conn->sock->fd, ret);
+		ret = conn->sock->ops->recvmsg(conn->sock, data_buffer, data_size, 0);
+		if (ret <= 0) {
+			if (ret == 0) {
+				/* Orderly shutdown. Not necessary to print an error. */
+				DBG("Socket %d did an orderly shutdown", conn->sock->fd);
+			} else {
+				ERR("Socket %d error %d", conn->sock->fd, ret);
+			}
+			ret = -1;
+			goto end_stream_put;
 		}
-		ret = -1;
-		goto end_stream_put;
 	}
 
 	pthread_mutex_lock(&stream->lock);
@@ -2226,6 +2822,12 @@ static int relay_process_data(struct relay_connection *conn)
 			stream->tracefile_size) {
 		uint64_t old_id, new_id;
 
+		/* Batched indexes belong to the current index file. */
+		ret = stream_flush_indexes(stream);
+		if (ret < 0) {
+			goto end_stream_unlock;
+		}
+
 		old_id = tracefile_array_get_file_index_head(stream->tfa);
 		tracefile_array_file_rotate(stream->tfa);
 
@@ -2263,15 +2865,22 @@ static int relay_process_data(struct relay_connection *conn)
 	}
 
 	/* Write data to stream output fd. */
-	size_ret = lttng_write(stream->stream_fd->fd, data_buffer, data_size);
-	if (size_ret < data_size) {
-		ERR("Relay error writing data to file");
-		ret = -1;
-		goto end_stream_unlock;
+	if (use_splice) {
+		ret = relay_splice_data(worker, stream->stream_fd->fd);
+		if (ret < 0) {
+			goto end_stream_unlock;
+		}
+	} else {
+		size_ret = lttng_write(stream->stream_fd->fd, data_buffer, data_size);
+		if (size_ret < data_size) {
+			ERR("Relay error writing data to file");
+			ret = -1;
+			goto end_stream_unlock;
+		}
 	}
 
-	DBG2("Relay wrote %zd bytes to tracefile for stream id %" PRIu64,
-			size_ret, stream->stream_handle);
+	DBG2("Relay wrote %u bytes to tracefile for stream id %" PRIu64,
+			data_size, stream->stream_handle);
 
 	ret = write_padding_to_file(stream->stream_fd->fd,
 			be32toh(data_hdr.padding_size));
@@ -2291,6 +2900,10 @@ static int relay_process_data(struct relay_connection *conn)
 end_stream_unlock:
 	close_requested = stream->close_requested;
 	pthread_mutex_unlock(&stream->lock);
+	if (ret < 0) {
+		/* Drop the part of the packet left in the splice pipe. */
+		relay_splice_reset(worker);
+	}
 	if (close_requested) {
 		try_stream_close(stream);
 	}
@@ -2318,8 +2931,9 @@ static void cleanup_connection_pollfd(struct lttng_poll_event *events, int pollf
 	}
 }
 
-static void relay_thread_close_connection(struct lttng_poll_event *events,
-		int pollfd, struct relay_connection *conn)
+static void relay_thread_close_connection(struct relay_worker *worker,
+		struct lttng_poll_event *events, int pollfd,
+		struct relay_connection *conn)
 {
 	const char *type_str;
 
@@ -2341,11 +2955,13 @@ static void relay_thread_close_connection(struct lttng_poll_event *events,
 	}
 	cleanup_connection_pollfd(events, pollfd);
 	connection_put(conn);
+	uatomic_dec(&worker->nb_connections);
 	DBG("%s connection closed with %d", type_str, pollfd);
 }
 
 /*
- * This thread does the actual work
+ * This thread does the actual work for the connections handed to the given
+ * relay_worker.
  */
 static void *relay_thread_worker(void *data)
 {
@@ -2356,8 +2972,9 @@ static void *relay_thread_worker(void *data)
 	struct lttng_ht_iter iter;
 	struct lttcomm_relayd_hdr recv_hdr;
 	struct relay_connection *destroy_conn = NULL;
+	struct relay_worker *worker = data;
 
-	DBG("[thread] Relay worker started");
+	DBG("[thread] Relay worker %u started", worker->id);
 
 	rcu_register_thread();
 
@@ -2380,7 +2997,7 @@ static void *relay_thread_worker(void *data)
 		goto error_poll_create;
 	}
 
-	ret = lttng_poll_add(&events, relay_conn_pipe[0], LPOLLIN | LPOLLRDHUP);
+	ret = lttng_poll_add(&events, worker->conn_pipe[0], LPOLLIN | LPOLLRDHUP);
 	if (ret < 0) {
 		goto error;
 	}
@@ -2436,18 +3053,20 @@ restart:
 			}
 
 			/* Inspect the relay conn pipe for new connection */
-			if (pollfd == relay_conn_pipe[0]) {
+			if (pollfd == worker->conn_pipe[0]) {
 				if (revents & LPOLLIN) {
 					struct relay_connection *conn;
 
-					ret = lttng_read(relay_conn_pipe[0], &conn, sizeof(conn));
+					ret = lttng_read(worker->conn_pipe[0], &conn,
+							sizeof(conn));
 					if (ret < 0) {
 						goto error;
 					}
 					lttng_poll_add(&events, conn->sock->fd,
 							LPOLLIN | LPOLLRDHUP);
 					connection_ht_add(relay_connections_ht, conn);
-					DBG("Connection socket %d added", conn->sock->fd);
+					DBG("Connection socket %d added to worker %u",
+							conn->sock->fd, worker->id);
 				} else if (revents & (LPOLLERR | LPOLLHUP | LPOLLRDHUP)) {
 					ERR("Relay connection pipe error");
 					goto error;
@@ -2480,19 +3099,20 @@ restart:
 							&recv_hdr, sizeof(recv_hdr), 0);
 					if (ret <= 0) {
 						/* Connection closed */
-						relay_thread_close_connection(&events, pollfd,
-								ctrl_conn);
+						relay_thread_close_connection(worker, &events,
+								pollfd, ctrl_conn);
 					} else {
-						ret = relay_process_control(&recv_hdr, ctrl_conn);
+						ret = relay_process_control(&recv_hdr, ctrl_conn,
+								worker);
 						if (ret < 0) {
 							/* Clear the session on error. */
-							relay_thread_close_connection(&events,
-									pollfd, ctrl_conn);
+							relay_thread_close_connection(worker,
+									&events, pollfd, ctrl_conn);
 						}
 						seen_control = 1;
 					}
 				} else if (revents & (LPOLLERR | LPOLLHUP | LPOLLRDHUP)) {
-					relay_thread_close_connection(&events,
+					relay_thread_close_connection(worker, &events,
 							pollfd, ctrl_conn);
 					if (last_seen_data_fd == pollfd) {
 						last_seen_data_fd = last_notdel_data_fd;
@@ -2544,7 +3164,7 @@ restart:
 			}
 
 			/* Skip the command pipe. It's handled in the first loop. */
-			if (pollfd == relay_conn_pipe[0]) {
+			if (pollfd == worker->conn_pipe[0]) {
 				continue;
 			}
 
@@ -2559,11 +3179,11 @@ restart:
 			assert(data_conn->type == RELAY_DATA);
 
 			if (revents & LPOLLIN) {
-				ret = relay_process_data(data_conn);
+				ret = relay_process_data(data_conn, worker);
 				/* Connection closed */
 				if (ret < 0) {
-					relay_thread_close_connection(&events, pollfd,
-							data_conn);
+					relay_thread_close_connection(worker, &events,
+							pollfd, data_conn);
 					/*
 					 * Every goto restart call sets the last seen fd where
 					 * here we don't really care since we gracefully
@@ -2576,7 +3196,7 @@ restart:
 					goto restart;
 				}
 			} else if (revents & (LPOLLERR | LPOLLHUP | LPOLLRDHUP)) {
-				relay_thread_close_connection(&events, pollfd,
+				relay_thread_close_connection(worker, &events, pollfd,
 						data_conn);
 			} else {
 				ERR("Unknown poll events %u for data sock %d",
@@ -2603,8 +3223,8 @@ error:
 		 * No need to grab another ref, because we own
 		 * destroy_conn.
 		 */
-		relay_thread_close_connection(&events, destroy_conn->sock->fd,
-				destroy_conn);
+		relay_thread_close_connection(worker, &events,
+				destroy_conn->sock->fd, destroy_conn);
 	}
 	rcu_read_unlock();
 
@@ -2612,13 +3232,13 @@ error:
 error_poll_create:
 	lttng_ht_destroy(relay_connections_ht);
 relay_connections_ht_error:
-	/* Close relay conn pipes */
-	utils_close_pipe(relay_conn_pipe);
 	if (err) {
 		DBG("Thread exited with error");
 	}
-	DBG("Worker thread cleanup complete");
-	free(data_buffer);
+	DBG("Worker thread %u cleanup complete", worker->id);
+	free(worker->data_buffer);
+	worker->data_buffer = NULL;
+	worker->data_buffer_size = 0;
 error_testpoint:
 	if (err) {
 		health_error();
@@ -2630,25 +3250,13 @@ error_testpoint:
 	return NULL;
 }
 
-/*
- * Create the relay command pipe to wake thread_manage_apps.
- * Closed in cleanup().
- */
-static int create_relay_conn_pipe(void)
-{
-	int ret;
-
-	ret = utils_create_pipe_cloexec(relay_conn_pipe);
-
-	return ret;
-}
-
 /*
  * main
  */
 int main(int argc, char **argv)
 {
 	int ret = 0, retval = 0;
+	unsigned int i, nb_workers_started = 0;
 	void *status;
 
 	/* Parse arguments */
@@ -2725,8 +3333,8 @@ int main(int argc, char **argv)
 		}
 	}
 
-	/* Setup the thread apps communication pipe. */
-	if (create_relay_conn_pipe()) {
+	/* Setup the worker threads communication pipes. */
+	if (create_relay_workers(opt_worker_threads)) {
 		retval = -1;
 		goto exit_init_data;
 	}
@@ -2791,14 +3399,17 @@ int main(int argc, char **argv)
 		goto exit_dispatcher_thread;
 	}
 
-	/* Setup the worker thread */
-	ret = pthread_create(&worker_thread, NULL,
-			relay_thread_worker, NULL);
-	if (ret) {
-		errno = ret;
-		PERROR("pthread_create worker");
-		retval = -1;
-		goto exit_worker_thread;
+	/* Setup the worker threads */
+	for (i = 0; i < relay_nb_workers; i++) {
+		ret = pthread_create(&relay_workers[i].thread, NULL,
+				relay_thread_worker, &relay_workers[i]);
+		if (ret) {
+			errno = ret;
+			PERROR("pthread_create worker");
+			retval = -1;
+			goto exit_worker_thread;
+		}
+		nb_workers_started++;
 	}
 
 	/* Setup the listener thread */
@@ -2811,7 +3422,7 @@ int main(int argc, char **argv)
 		goto exit_listener_thread;
 	}
 
-	ret = relayd_live_create(live_uri);
+	ret = relayd_live_create(live_uri, opt_live_worker_threads);
 	if (ret) {
 		ERR("Starting live viewer threads");
 		retval = -1;
@@ -2837,14 +3448,19 @@ exit_live:
 	}
 
 exit_listener_thread:
-	ret = pthread_join(worker_thread, &status);
-	if (ret) {
-		errno = ret;
-		PERROR("pthread_join worker_thread");
-		retval = -1;
+exit_worker_thread:
+	for (i = 0; i < nb_workers_started; i++) {
+		ret = pthread_join(relay_workers[i].thread, &status);
+		if (ret) {
+			errno = ret;
+			PERROR("pthread_join worker_thread");
+			retval = -1;
+		}
 	}
 
-exit_worker_thread:
+	/* The relay workers no longer notify the live workers. */
+	relayd_live_destroy();
+
 	ret = pthread_join(dispatcher_thread, &status);
 	if (ret) {
 		errno = ret;
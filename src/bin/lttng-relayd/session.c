@@ -25,6 +25,7 @@
 #include "ctf-trace.h"
 #include "session.h"
 #include "stream.h"
+#include "live.h"
 
 /* Global session id used in the session creation. */
 static uint64_t last_relay_session_id;
@@ -138,6 +139,7 @@ static void rcu_destroy_session(struct rcu_head *rcu_head)
 	 * don't hold the RCU read-side lock while calling it.
 	 */
 	lttng_ht_destroy(session->ctf_traces_ht);
+	free(session->index_subscriptions);
 	free(session);
 }
 
@@ -201,6 +203,8 @@ unlock:
 	if (ret) {
 		return ret;
 	}
+	/* Let subscribed viewers know the session hung up. */
+	live_notify_session_indexes(session);
 
 	rcu_read_lock();
 	cds_lfht_for_each_entry(session->ctf_traces_ht->ht,
@@ -29,6 +29,17 @@
 #include <lttng/constant.h>
 #include <common/hashtable/hashtable.h>
 
+/*
+ * Index subscriptions to a session of the viewer notification connections
+ * handled by one live worker thread. Accessed with uatomic.
+ */
+struct relay_index_subscription {
+	/* Number of subscribed connections. */
+	unsigned long subscribers;
+	/* Whether a notification is already queued to the live worker. */
+	unsigned long notify_pending;
+};
+
 /*
  * Represents a session for the relay point of view
  */
@@ -90,6 +101,13 @@ struct relay_session {
 	 */
 	unsigned long new_streams;
 
+	/*
+	 * Index subscriptions, indexed by the id of the live worker thread
+	 * handling the subscribed connections. Allocated by the first
+	 * subscription, NULL until then.
+	 */
+	struct relay_index_subscription *index_subscriptions;
+
 	/*
 	 * Node in the global session hash table.
 	 */
@@ -28,6 +28,7 @@
 #include "index.h"
 #include "stream.h"
 #include "viewer-stream.h"
+#include "live.h"
 
 /* Should be called with RCU read-side lock held. */
 bool stream_get(struct relay_stream *stream)
@@ -152,6 +153,16 @@ struct relay_stream *stream_create(struct ctf_trace *trace,
 		stream->is_metadata = 1;
 	}
 
+	if (session->live_timer && !stream->is_metadata) {
+		stream->index_ring = zmalloc(DEFAULT_RELAYD_LIVE_INDEX_RING_ENTRIES *
+				sizeof(*stream->index_ring));
+		if (!stream->index_ring) {
+			PERROR("relay stream index ring zmalloc");
+			ret = -1;
+			goto end;
+		}
+	}
+
 	stream->in_recv_list = true;
 
 	/*
@@ -262,6 +273,7 @@ static void stream_destroy(struct relay_stream *stream)
 	if (stream->tfa) {
 		tracefile_array_destroy(stream->tfa);
 	}
+	free(stream->index_ring);
 	free(stream->path_name);
 	free(stream->channel_name);
 	free(stream);
@@ -411,6 +423,7 @@ void try_stream_close(struct relay_stream *stream)
 	/*
 	 * We received all the indexes we can expect.
 	 */
+	(void) stream_flush_indexes(stream);
 	stream_unpublish(stream);
 	stream->closed = true;
 	/* Relay indexes are only used by the "consumer/sessiond" end. */
@@ -420,6 +433,114 @@ void try_stream_close(struct relay_stream *stream)
 	stream_put(stream);
 }
 
+/*
+ * Make indexes written to the index file available to live viewers, keeping
+ * a copy of them in the recent index ring.
+ *
+ * Called with the stream lock held.
+ */
+static void stream_commit_indexes(struct relay_stream *stream,
+		const struct ctf_packet_index *indexes, unsigned int count)
+{
+	unsigned int i;
+
+	for (i = 0; i < count; i++) {
+		if (stream->index_ring) {
+			stream->index_ring[stream->index_received_seqcount %
+					DEFAULT_RELAYD_LIVE_INDEX_RING_ENTRIES] =
+				indexes[i];
+		}
+		tracefile_array_commit_seq(stream->tfa);
+		stream->index_received_seqcount++;
+	}
+}
+
+/*
+ * Copy the index of sequence number seq from the recent index ring.
+ *
+ * Called with the stream lock held.
+ * Return true if the index is still in the ring, false if it must be read
+ * from the index file.
+ */
+bool stream_get_recent_index(struct relay_stream *stream, uint64_t seq,
+		struct ctf_packet_index *index)
+{
+	if (!stream->index_ring || seq >= stream->index_received_seqcount ||
+			stream->index_received_seqcount - seq >
+				DEFAULT_RELAYD_LIVE_INDEX_RING_ENTRIES) {
+		return false;
+	}
+	*index = stream->index_ring[seq % DEFAULT_RELAYD_LIVE_INDEX_RING_ENTRIES];
+	return true;
+}
+
+/*
+ * Write an index to the given index file. Indexes of the current index file
+ * of the stream are batched; the ones belonging to a previous index file
+ * (tracefile rotation) are written immediately.
+ *
+ * Called with the stream lock held.
+ * Return 0 on success or else a negative value.
+ */
+int stream_write_index(struct relay_stream *stream,
+		struct stream_fd *index_fd, struct ctf_packet_index *index)
+{
+	int ret;
+	const struct ctf_packet_index *written;
+
+	if (index_fd == stream->index_fd) {
+		ret = index_buffer_add(&stream->index_buffer, index_fd->fd,
+				index);
+		/* A flushed buffer keeps its entries until the next add. */
+		written = stream->index_buffer.entries;
+	} else {
+		ssize_t size_ret;
+
+		size_ret = index_write(index_fd->fd, index, sizeof(*index));
+		ret = size_ret == sizeof(*index) ? 1 : -1;
+		written = index;
+	}
+	if (ret < 0) {
+		goto end;
+	}
+	stream_commit_indexes(stream, written, ret);
+	/* Batched or not, subscribed viewers can fetch it now. */
+	live_notify_session_indexes(stream->trace->session);
+	ret = 0;
+
+end:
+	return ret;
+}
+
+/*
+ * Write the buffered indexes of a stream to its current index file. Must be
+ * done before the index file is rotated or closed, and whenever the indexes
+ * must become visible to viewers.
+ *
+ * Called with the stream lock held.
+ * Return 0 on success or else a negative value.
+ */
+int stream_flush_indexes(struct relay_stream *stream)
+{
+	int ret;
+
+	if (!stream->index_fd) {
+		ret = 0;
+		goto end;
+	}
+
+	ret = index_buffer_flush(&stream->index_buffer, stream->index_fd->fd);
+	if (ret < 0) {
+		ERR("Flushing indexes of stream %" PRIu64, stream->stream_handle);
+		goto end;
+	}
+	stream_commit_indexes(stream, stream->index_buffer.entries, ret);
+	ret = 0;
+
+end:
+	return ret;
+}
+
 static void print_stream_indexes(struct relay_stream *stream)
 {
 	struct lttng_ht_iter iter;
@@ -26,6 +26,7 @@
 #include <urcu/list.h>
 
 #include <common/hashtable/hashtable.h>
+#include <common/index/index.h>
 
 #include "session.h"
 #include "stream-fd.h"
@@ -60,6 +61,17 @@ struct relay_stream {
 	struct stream_fd *stream_fd;
 	/* FD on which to write the index data. */
 	struct stream_fd *index_fd;
+	/*
+	 * Indexes not yet written to index_fd. They are only counted in
+	 * index_received_seqcount once written.
+	 */
+	struct index_buffer index_buffer;
+	/*
+	 * Most recent indexes written to index_fd, at their sequence number
+	 * modulo DEFAULT_RELAYD_LIVE_INDEX_RING_ENTRIES. Only allocated for
+	 * the data streams of live sessions.
+	 */
+	struct ctf_packet_index *index_ring;
 
 	char *path_name;
 	char *channel_name;
@@ -146,6 +158,11 @@ struct relay_stream *stream_get_by_id(uint64_t stream_id);
 bool stream_get(struct relay_stream *stream);
 void stream_put(struct relay_stream *stream);
 void try_stream_close(struct relay_stream *stream);
+int stream_write_index(struct relay_stream *stream,
+		struct stream_fd *index_fd, struct ctf_packet_index *index);
+int stream_flush_indexes(struct relay_stream *stream);
+bool stream_get_recent_index(struct relay_stream *stream, uint64_t seq,
+		struct ctf_packet_index *index);
 void stream_publish(struct relay_stream *stream);
 void print_relay_streams(void);
 
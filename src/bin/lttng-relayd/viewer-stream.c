@@ -68,6 +68,7 @@ struct relay_viewer_stream *viewer_stream_create(struct relay_stream *stream,
 		goto error;
 	}
 	vstream->stream = stream;
+	vstream->beacon_ts_end_notified = -1ULL;
 
 	pthread_mutex_lock(&stream->lock);
 
@@ -309,6 +310,7 @@ int viewer_stream_rotate(struct relay_viewer_stream *vstream)
 		stream_fd_put(vstream->index_fd);
 		vstream->index_fd = NULL;
 	}
+	vstream->index_skipped = 0;
 	if (vstream->stream_fd) {
 		stream_fd_put(vstream->stream_fd);
 		vstream->stream_fd = NULL;
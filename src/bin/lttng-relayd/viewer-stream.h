@@ -68,6 +68,17 @@ struct relay_viewer_stream {
 	 * updated when catching up with the producer.
 	 */
 	uint64_t index_sent_seqcount;
+	/*
+	 * Indexes sent from the stream's recent index ring since the last
+	 * read of index_fd. The file position is moved past them before the
+	 * next read.
+	 */
+	uint64_t index_skipped;
+	/*
+	 * End timestamp of the last inactivity beacon of the stream listed in
+	 * an index notification, -1ULL if none. Protected by the stream lock.
+	 */
+	uint64_t beacon_ts_end_notified;
 
 	/* Indicates if this stream has been sent to a viewer client. */
 	bool sent_flag;
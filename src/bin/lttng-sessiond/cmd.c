@@ -19,6 +19,7 @@
 #define _LGPL_SOURCE
 #include <assert.h>
 #include <inttypes.h>
+#include <unistd.h>
 #include <urcu/list.h>
 #include <urcu/uatomic.h>
 
@@ -2041,6 +2042,20 @@ ssize_t cmd_list_syscalls(struct lttng_event **events)
 	return syscall_table_list(events);
 }
 
+/*
+ * Report that every PID is tracked, as a single -1 entry, for a domain which
+ * is not created yet.
+ */
+static ssize_t list_all_tracked_pids(int32_t **pids)
+{
+	*pids = zmalloc(sizeof(**pids));
+	if (!*pids) {
+		return -1;
+	}
+	(*pids)[0] = -1;
+	return 1;
+}
+
 /*
  * Command LTTNG_LIST_TRACKER_PIDS processed by the client thread.
  *
@@ -2058,7 +2073,11 @@ ssize_t cmd_list_tracker_pids(struct ltt_session *session,
 		struct ltt_kernel_session *ksess;
 
 		ksess = session->kernel_session;
-		nr_pids = kernel_list_tracker_pids(ksess, pids);
+		if (ksess) {
+			nr_pids = kernel_list_tracker_pids(ksess, pids);
+		} else {
+			nr_pids = list_all_tracked_pids(pids);
+		}
 		if (nr_pids < 0) {
 			ret = LTTNG_ERR_KERN_LIST_FAIL;
 			goto error;
@@ -2070,7 +2089,11 @@ ssize_t cmd_list_tracker_pids(struct ltt_session *session,
 		struct ltt_ust_session *usess;
 
 		usess = session->ust_session;
-		nr_pids = trace_ust_list_tracker_pids(usess, pids);
+		if (usess) {
+			nr_pids = trace_ust_list_tracker_pids(usess, pids);
+		} else {
+			nr_pids = list_all_tracked_pids(pids);
+		}
 		if (nr_pids < 0) {
 			ret = LTTNG_ERR_UST_LIST_FAIL;
 			goto error;
@@ -2092,6 +2115,22 @@ error:
 	return -ret;
 }
 
+/*
+ * Create on the applications the UST domain of a session updated while their
+ * update was deferred.
+ */
+static void apply_deferred_app_update(struct ltt_ust_session *usess)
+{
+	if (!usess || !usess->app_update_deferred) {
+		return;
+	}
+
+	DBG("Applying deferred application update of UST session %" PRIu64,
+			usess->id);
+	usess->app_update_deferred = 0;
+	ust_app_global_update_all(usess);
+}
+
 /*
  * Command LTTNG_START_TRACE processed by the client thread.
  *
@@ -2141,6 +2180,9 @@ int cmd_start_trace(struct ltt_session *session)
 
 	/* Flag session that trace should start automatically */
 	if (usess) {
+		/* The applications must know about the session to start it. */
+		apply_deferred_app_update(usess);
+
 		/*
 		 * Even though the start trace might fail, flag this session active so
 		 * other application coming in are started by default.
@@ -2315,23 +2357,40 @@ error:
 }
 
 /*
- * Command LTTNG_CREATE_SESSION processed by the client thread.
+ * Destroy a session which create_session() failed to set up, releasing its
+ * lock and reference. The session list lock is acquired before the session
+ * lock, hence the latter being released in between.
  */
-int cmd_create_session_uri(char *name, struct lttng_uri *uris,
-		size_t nb_uri, lttng_sock_cred *creds, unsigned int live_timer)
+static void destroy_new_session(struct ltt_session *session)
+{
+	session_unlock(session);
+	session_lock_list();
+	session_lock(session);
+	session_destroy(session);
+	session_unlock(session);
+	session_unlock_list();
+	session_put(session);
+}
+
+/*
+ * Create a tracing session along with its default consumer output.
+ *
+ * The session is published in the session list by session_create() but is
+ * returned locked, so the commands looking it up without the session list
+ * lock wait for the caller to complete its setup. The caller releases the
+ * session with session_unlock() and session_put().
+ */
+static int create_session(char *name, struct lttng_uri *uris,
+		size_t nb_uri, lttng_sock_cred *creds, unsigned int live_timer,
+		struct ltt_session **session_out)
 {
 	int ret;
 	struct ltt_session *session;
 
-	assert(name);
-	assert(creds);
-
 	/*
-	 * Verify if the session already exist
-	 *
-	 * XXX: There is no need for the session lock list here since the caller
-	 * (process_client_msg) is holding it. We might want to change that so a
-	 * single command does not lock the entire session list.
+	 * Verify if the session already exist. The session creation commands are
+	 * serialized by the client thread so no other session of that name can
+	 * be created concurrently.
 	 */
 	session = session_find_by_name(name);
 	if (session != NULL) {
@@ -2346,15 +2405,10 @@ int cmd_create_session_uri(char *name, struct lttng_uri *uris,
 		goto session_error;
 	}
 
-	/*
-	 * Get the newly created session pointer back
-	 *
-	 * XXX: There is no need for the session lock list here since the caller
-	 * (process_client_msg) is holding it. We might want to change that so a
-	 * single command does not lock the entire session list.
-	 */
-	session = session_find_by_name(name);
+	/* Get the newly created session pointer back */
+	session = session_get_by_name(name);
 	assert(session);
+	session_lock(session);
 
 	session->live_timer = live_timer;
 	/* Create default consumer output for the session not yet created. */
@@ -2376,16 +2430,40 @@ int cmd_create_session_uri(char *name, struct lttng_uri *uris,
 	}
 
 	session->consumer->enabled = 1;
+	*session_out = session;
 
 	return LTTNG_OK;
 
 consumer_error:
-	session_destroy(session);
+	destroy_new_session(session);
 session_error:
 find_error:
 	return ret;
 }
 
+/*
+ * Command LTTNG_CREATE_SESSION processed by the client thread.
+ */
+int cmd_create_session_uri(char *name, struct lttng_uri *uris,
+		size_t nb_uri, lttng_sock_cred *creds, unsigned int live_timer)
+{
+	int ret;
+	struct ltt_session *session;
+
+	assert(name);
+	assert(creds);
+
+	ret = create_session(name, uris, nb_uri, creds, live_timer, &session);
+	if (ret != LTTNG_OK) {
+		goto error;
+	}
+	session_unlock(session);
+	session_put(session);
+
+error:
+	return ret;
+}
+
 /*
  * Command LTTNG_CREATE_SESSION_SNAPSHOT processed by the client thread.
  */
@@ -2403,15 +2481,11 @@ int cmd_create_session_snapshot(char *name, struct lttng_uri *uris,
 	 * Create session in no output mode with URIs set to NULL. The uris we've
 	 * received are for a default snapshot output if one.
 	 */
-	ret = cmd_create_session_uri(name, NULL, 0, creds, 0);
+	ret = create_session(name, NULL, 0, creds, 0, &session);
 	if (ret != LTTNG_OK) {
 		goto error;
 	}
 
-	/* Get the newly created session pointer back. This should NEVER fail. */
-	session = session_find_by_name(name);
-	assert(session);
-
 	/* Flag session for snapshot mode. */
 	session->snapshot_mode = 1;
 
@@ -2442,12 +2516,14 @@ int cmd_create_session_snapshot(char *name, struct lttng_uri *uris,
 	rcu_read_unlock();
 
 end:
+	session_unlock(session);
+	session_put(session);
 	return LTTNG_OK;
 
 error_snapshot:
 	snapshot_output_destroy(new_output);
 error_snapshot_alloc:
-	session_destroy(session);
+	destroy_new_session(session);
 error:
 	return ret;
 }
@@ -2823,58 +2899,101 @@ error:
 }
 
 /*
- * Using the session list, filled a lttng_session array to send back to the
- * client for session listing.
+ * Fill a lttng_session structure from a session for the session listing.
  *
- * The session list lock MUST be acquired before calling this function. Use
- * session_lock_list() and session_unlock_list().
+ * The session lock MUST be acquired before calling this function.
  */
-void cmd_list_lttng_sessions(struct lttng_session *sessions, uid_t uid,
+static int list_lttng_session(struct lttng_session *listed,
+		struct ltt_session *session)
+{
+	int ret;
+	struct ltt_kernel_session *ksess = session->kernel_session;
+	struct ltt_ust_session *usess = session->ust_session;
+
+	if (session->consumer->type == CONSUMER_DST_NET ||
+			(ksess && ksess->consumer->type == CONSUMER_DST_NET) ||
+			(usess && usess->consumer->type == CONSUMER_DST_NET)) {
+		ret = build_network_session_path(listed->path,
+				sizeof(listed->path), session);
+	} else {
+		ret = snprintf(listed->path, sizeof(listed->path), "%s",
+				session->consumer->dst.trace_path);
+	}
+	if (ret < 0) {
+		PERROR("snprintf session path");
+		return ret;
+	}
+
+	strncpy(listed->name, session->name, NAME_MAX);
+	listed->name[NAME_MAX - 1] = '\0';
+	listed->enabled = session->active;
+	listed->snapshot_mode = session->snapshot_mode;
+	listed->live_timer_interval = session->live_timer;
+	return 0;
+}
+
+/*
+ * Command LTTNG_LIST_SESSIONS processed by the client thread.
+ *
+ * Fill a lttng_session array, allocated in sessions, with the sessions the
+ * user can control. The session list lock is not needed, each session is
+ * only locked while it is listed.
+ */
+ssize_t cmd_list_lttng_sessions(struct lttng_session **sessions, uid_t uid,
 		gid_t gid)
 {
 	int ret;
-	unsigned int i = 0;
-	struct ltt_session *session;
-	struct ltt_session_list *list = session_get_list();
+	ssize_t nb_sessions, i, nb_listed = 0;
+	struct ltt_session **all_sessions;
+	struct lttng_session *listed = NULL;
 
 	DBG("Getting all available session for UID %d GID %d",
 			uid, gid);
-	/*
-	 * Iterate over session list and append data after the control struct in
-	 * the buffer.
-	 */
-	cds_list_for_each_entry(session, &list->head, list) {
-		/*
-		 * Only list the sessions the user can control.
-		 */
-		if (!session_access_ok(session, uid, gid)) {
-			continue;
+
+	nb_sessions = session_get_all(&all_sessions);
+	if (nb_sessions < 0) {
+		ret = LTTNG_ERR_NOMEM;
+		goto error;
+	}
+
+	if (nb_sessions > 0) {
+		listed = zmalloc(nb_sessions * sizeof(*listed));
+		if (!listed) {
+			ret = LTTNG_ERR_NOMEM;
+			goto error_alloc;
 		}
+	}
 
-		struct ltt_kernel_session *ksess = session->kernel_session;
-		struct ltt_ust_session *usess = session->ust_session;
+	for (i = 0; i < nb_sessions; i++) {
+		struct ltt_session *session = all_sessions[i];
 
-		if (session->consumer->type == CONSUMER_DST_NET ||
-				(ksess && ksess->consumer->type == CONSUMER_DST_NET) ||
-				(usess && usess->consumer->type == CONSUMER_DST_NET)) {
-			ret = build_network_session_path(sessions[i].path,
-					sizeof(sessions[i].path), session);
-		} else {
-			ret = snprintf(sessions[i].path, sizeof(sessions[i].path), "%s",
-					session->consumer->dst.trace_path);
+		session_lock(session);
+		/*
+		 * Skip the destroyed sessions and those not yet set up by their
+		 * creation command. Only list the sessions the user can control.
+		 */
+		if (session->destroyed || !session->consumer ||
+				!session_access_ok(session, uid, gid)) {
+			session_unlock(session);
+			continue;
 		}
+		ret = list_lttng_session(&listed[nb_listed], session);
+		session_unlock(session);
 		if (ret < 0) {
-			PERROR("snprintf session path");
 			continue;
 		}
-
-		strncpy(sessions[i].name, session->name, NAME_MAX);
-		sessions[i].name[NAME_MAX - 1] = '\0';
-		sessions[i].enabled = session->active;
-		sessions[i].snapshot_mode = session->snapshot_mode;
-		sessions[i].live_timer_interval = session->live_timer;
-		i++;
+		nb_listed++;
 	}
+
+	session_put_all(all_sessions, nb_sessions);
+	*sessions = listed;
+	return nb_listed;
+
+error_alloc:
+	session_put_all(all_sessions, nb_sessions);
+error:
+	/* Return negative value to differentiate return code */
+	return -ret;
 }
 
 /*
@@ -2933,6 +3052,75 @@ error:
 	return ret;
 }
 
+/*
+ * Command LTTNG_WAIT_DATA_PENDING replying once the data of the session is no
+ * longer pending, sparing the client a data pending request each time it
+ * polls. While data is pending, the reply is deferred to the data pending
+ * waiter thread which calls this function again periodically.
+ *
+ * The session lock MUST be held.
+ *
+ * Return 1 if data is still pending, LTTNG_OK once it is not or else a
+ * LTTNG_ERR code.
+ */
+int cmd_wait_data_pending(struct ltt_session *session)
+{
+	int ret;
+
+	assert(session);
+
+	ret = cmd_data_pending(session);
+	if (ret == 0) {
+		ret = LTTNG_OK;
+	} else if (ret < 0) {
+		ret = LTTNG_ERR_UNK;
+	}
+
+	return ret;
+}
+
+/*
+ * Command LTTNG_BEGIN_SESSION_UPDATE from the lttng ctl library.
+ *
+ * Defer the update of the applications for the UST domain of the session
+ * until cmd_end_session_update() or the session is started, so that a batch
+ * of commands, such as those loading a session configuration, only updates
+ * each application once. This is only possible while no application knows
+ * about the UST domain, otherwise the applications are updated by each
+ * command as usual.
+ *
+ * Return LTTNG_OK on success or else a LTTNG_ERR code.
+ */
+int cmd_begin_session_update(struct ltt_session *session)
+{
+	struct ltt_ust_session *usess;
+
+	assert(session);
+
+	usess = session->ust_session;
+	session->update_batched = 1;
+	if (usess && !usess->active && !ust_app_has_session(usess)) {
+		usess->app_update_deferred = 1;
+	}
+
+	return LTTNG_OK;
+}
+
+/*
+ * Command LTTNG_END_SESSION_UPDATE from the lttng ctl library.
+ *
+ * Return LTTNG_OK on success or else a LTTNG_ERR code.
+ */
+int cmd_end_session_update(struct ltt_session *session)
+{
+	assert(session);
+
+	session->update_batched = 0;
+	apply_deferred_app_update(session->ust_session);
+
+	return LTTNG_OK;
+}
+
 /*
  * Command LTTNG_SNAPSHOT_ADD_OUTPUT from the lttng ctl library.
  *
@@ -84,7 +84,7 @@ ssize_t cmd_list_channels(enum lttng_domain_type domain,
 		struct ltt_session *session, struct lttng_channel **channels);
 ssize_t cmd_list_domains(struct ltt_session *session,
 		struct lttng_domain **domains);
-void cmd_list_lttng_sessions(struct lttng_session *sessions, uid_t uid,
+ssize_t cmd_list_lttng_sessions(struct lttng_session **sessions, uid_t uid,
 		gid_t gid);
 ssize_t cmd_list_tracepoint_fields(enum lttng_domain_type domain,
 		struct lttng_event_field **fields);
@@ -99,6 +99,9 @@ ssize_t cmd_list_tracker_pids(struct ltt_session *session,
 int cmd_calibrate(enum lttng_domain_type domain,
 		struct lttng_calibrate *calibrate);
 int cmd_data_pending(struct ltt_session *session);
+int cmd_wait_data_pending(struct ltt_session *session);
+int cmd_begin_session_update(struct ltt_session *session);
+int cmd_end_session_update(struct ltt_session *session);
 
 /* Snapshot */
 int cmd_snapshot_add_output(struct ltt_session *session,
@@ -44,11 +44,20 @@ extern int kernel_tracer_fd;
  */
 struct command_ctx {
 	int ust_sock;
+	/* Client socket, owned by the worker processing the command. */
+	int sock;
+	/* Node in the client command queue. */
+	struct cds_list_head node;
 	unsigned int lttng_msg_size;
 	struct ltt_session *session;
 	struct lttcomm_lttng_msg *llm;
 	struct lttcomm_session_msg *lsm;
 	lttng_sock_cred creds;
+	/*
+	 * Set by a LTTNG_WAIT_DATA_PENDING command whose reply is deferred to
+	 * the data pending waiter thread.
+	 */
+	unsigned int wait_data_pending:1;
 };
 
 struct ust_command {
@@ -110,6 +119,12 @@ extern long page_size;
  */
 extern unsigned int agent_tcp_port;
 
+/*
+ * Global set once in main(). Number of threads sending a session command to
+ * the registered applications concurrently.
+ */
+extern unsigned int app_cmd_threads;
+
 /*
  * Section name to look for in the daemon configuration file.
  */
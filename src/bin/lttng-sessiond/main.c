@@ -234,6 +234,52 @@ static struct ust_cmd_queue ust_cmd_queue;
  */
 static struct ltt_session_list *session_list_ptr;
 
+/*
+ * Client commands received by the client thread, waiting for a client worker
+ * thread to process them.
+ */
+static struct client_cmd_queue {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	struct cds_list_head head;
+	/* Set when the client thread quits so the workers exit. */
+	int quit;
+} client_cmd_queue = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.cond = PTHREAD_COND_INITIALIZER,
+	.head = CDS_LIST_HEAD_INIT(client_cmd_queue.head),
+};
+
+/*
+ * Client connections handed back by the client workers to the client thread
+ * once they replied to a command, so the next one is received on them.
+ */
+static int client_conn_pipe[2] = { -1, -1 };
+
+/*
+ * LTTNG_WAIT_DATA_PENDING commands whose session had data pending when a
+ * client worker processed them. The data pending waiter thread checks them
+ * again periodically and replies once the data is available, so they do not
+ * hold up a client worker.
+ */
+static struct data_pending_wait_queue {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	struct cds_list_head head;
+	/* Set when the client thread quits so the waiter exits. */
+	int quit;
+} data_pending_wait_queue = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.cond = PTHREAD_COND_INITIALIZER,
+	.head = CDS_LIST_HEAD_INIT(data_pending_wait_queue.head),
+};
+
+/*
+ * Serializes the client commands which are not safe to run concurrently, that
+ * is all of them except those listed by is_concurrent_client_cmd().
+ */
+static pthread_mutex_t client_cmd_lock = PTHREAD_MUTEX_INITIALIZER;
+
 int ust_consumerd64_fd = -1;
 int ust_consumerd32_fd = -1;
 
@@ -295,6 +341,7 @@ struct health_app *health_sessiond;
 
 /* Agent TCP port for registration. Used by the agent thread. */
 unsigned int agent_tcp_port = DEFAULT_AGENT_TCP_PORT;
+unsigned int app_cmd_threads = DEFAULT_APP_CMD_THREADS;
 
 /* Am I root or not. */
 int is_root;			/* Set to 1 if the daemon is running as root */
@@ -2878,6 +2925,8 @@ static int create_ust_session(struct ltt_session *session,
 	lus->output_traces = session->output_traces;
 	lus->snapshot_mode = session->snapshot_mode;
 	lus->live_timer_interval = session->live_timer;
+	/* No application knows about this session yet. */
+	lus->app_update_deferred = session->update_batched;
 	session->ust_session = lus;
 	if (session->shm_path[0]) {
 		strncpy(lus->root_shm_path, session->shm_path,
@@ -2955,25 +3004,32 @@ error:
 }
 
 /*
- * Count number of session permitted by uid/gid.
+ * Return 1 if a client command can be processed concurrently with the other
+ * client commands, else 0.
+ *
+ * These commands only read or act on the sessions they target, which they
+ * look up without holding the session list lock, and hold only the lock of
+ * the session they are accessing while they execute. This way, listings and
+ * data pending queries are not held up by a slow command on another session.
+ * None of them needs a domain to be set up, the listings simply report an
+ * empty domain when the session has none.
  */
-static unsigned int lttng_sessions_count(uid_t uid, gid_t gid)
+static int is_concurrent_client_cmd(enum lttcomm_sessiond_command cmd_type)
 {
-	unsigned int i = 0;
-	struct ltt_session *session;
-
-	DBG("Counting number of available session for UID %d GID %d",
-			uid, gid);
-	cds_list_for_each_entry(session, &session_list_ptr->head, list) {
-		/*
-		 * Only list the sessions the user can control.
-		 */
-		if (!session_access_ok(session, uid, gid)) {
-			continue;
-		}
-		i++;
+	switch (cmd_type) {
+	case LTTNG_LIST_SESSIONS:
+	case LTTNG_LIST_DOMAINS:
+	case LTTNG_LIST_CHANNELS:
+	case LTTNG_LIST_EVENTS:
+	case LTTNG_LIST_TRACKER_PIDS:
+	case LTTNG_DATA_PENDING:
+	case LTTNG_WAIT_DATA_PENDING:
+	case LTTNG_SNAPSHOT_LIST_OUTPUT:
+	case LTTNG_SNAPSHOT_RECORD:
+		return 1;
+	default:
+		return 0;
 	}
-	return i;
 }
 
 /*
@@ -2993,6 +3049,7 @@ static int process_client_msg(struct command_ctx *cmd_ctx, int sock,
 	int ret = LTTNG_OK;
 	int need_tracing_session = 1;
 	int need_domain;
+	int concurrent, cmd_locked = 0, list_locked = 0;
 
 	DBG("Processing client command %d", cmd_ctx->lsm->cmd_type);
 
@@ -3007,9 +3064,15 @@ static int process_client_msg(struct command_ctx *cmd_ctx, int sock,
 	case LTTNG_DESTROY_SESSION:
 	case LTTNG_LIST_SESSIONS:
 	case LTTNG_LIST_DOMAINS:
+	case LTTNG_LIST_CHANNELS:
+	case LTTNG_LIST_EVENTS:
+	case LTTNG_LIST_TRACKER_PIDS:
 	case LTTNG_START_TRACE:
 	case LTTNG_STOP_TRACE:
 	case LTTNG_DATA_PENDING:
+	case LTTNG_WAIT_DATA_PENDING:
+	case LTTNG_BEGIN_SESSION_UPDATE:
+	case LTTNG_END_SESSION_UPDATE:
 	case LTTNG_SNAPSHOT_ADD_OUTPUT:
 	case LTTNG_SNAPSHOT_DEL_OUTPUT:
 	case LTTNG_SNAPSHOT_LIST_OUTPUT:
@@ -3022,6 +3085,12 @@ static int process_client_msg(struct command_ctx *cmd_ctx, int sock,
 		need_domain = 1;
 	}
 
+	concurrent = is_concurrent_client_cmd(cmd_ctx->lsm->cmd_type);
+	if (!concurrent) {
+		pthread_mutex_lock(&client_cmd_lock);
+		cmd_locked = 1;
+	}
+
 	if (opt_no_kernel && need_domain
 			&& cmd_ctx->lsm->domain.type == LTTNG_DOMAIN_KERNEL) {
 		if (!is_root) {
@@ -3083,18 +3152,25 @@ static int process_client_msg(struct command_ctx *cmd_ctx, int sock,
 	default:
 		DBG("Getting session %s by name", cmd_ctx->lsm->session.name);
 		/*
-		 * We keep the session list lock across _all_ commands
-		 * for now, because the per-session lock does not
-		 * handle teardown properly.
+		 * The commands which are not concurrent keep the session list
+		 * lock across their execution since they may act on other
+		 * sessions or on the daemon's global state.
 		 */
-		session_lock_list();
-		cmd_ctx->session = session_find_by_name(cmd_ctx->lsm->session.name);
+		if (!concurrent) {
+			session_lock_list();
+			list_locked = 1;
+		}
+		cmd_ctx->session = session_get_by_name(cmd_ctx->lsm->session.name);
 		if (cmd_ctx->session == NULL) {
 			ret = LTTNG_ERR_SESS_NOT_FOUND;
 			goto error;
-		} else {
-			/* Acquire lock for the session */
-			session_lock(cmd_ctx->session);
+		}
+		/* Acquire lock for the session */
+		session_lock(cmd_ctx->session);
+		if (cmd_ctx->session->destroyed) {
+			/* Destroyed while the session list lock was not held. */
+			ret = LTTNG_ERR_SESS_NOT_FOUND;
+			goto error;
 		}
 		break;
 	}
@@ -3807,10 +3883,11 @@ error_add_context:
 	}
 	case LTTNG_DESTROY_SESSION:
 	{
+		/*
+		 * The reference held by the command context keeps the session
+		 * alive until it is unlocked and put below.
+		 */
 		ret = cmd_destroy_session(cmd_ctx->session, kernel_poll_pipe[1]);
-
-		/* Set session to NULL so we do not unlock it after free. */
-		cmd_ctx->session = NULL;
 		break;
 	}
 	case LTTNG_LIST_DOMAINS:
@@ -3898,25 +3975,30 @@ error_add_context:
 	}
 	case LTTNG_LIST_SESSIONS:
 	{
-		unsigned int nr_sessions;
+		ssize_t nr_sessions;
+		struct lttng_session *sessions = NULL;
 
-		session_lock_list();
-		nr_sessions = lttng_sessions_count(
+		nr_sessions = cmd_list_lttng_sessions(&sessions,
 				LTTNG_SOCK_GET_UID_CRED(&cmd_ctx->creds),
 				LTTNG_SOCK_GET_GID_CRED(&cmd_ctx->creds));
+		if (nr_sessions < 0) {
+			/* Return value is a negative lttng_error_code. */
+			ret = -nr_sessions;
+			goto error;
+		}
 
-		ret = setup_lttng_msg(cmd_ctx, sizeof(struct lttng_session) * nr_sessions);
+		ret = setup_lttng_msg(cmd_ctx,
+				nr_sessions * sizeof(struct lttng_session));
 		if (ret < 0) {
-			session_unlock_list();
+			free(sessions);
 			goto setup_error;
 		}
 
-		/* Filled the session array */
-		cmd_list_lttng_sessions((struct lttng_session *)(cmd_ctx->llm->payload),
-			LTTNG_SOCK_GET_UID_CRED(&cmd_ctx->creds),
-			LTTNG_SOCK_GET_GID_CRED(&cmd_ctx->creds));
+		/* Copy session list into message payload */
+		memcpy(cmd_ctx->llm->payload, sessions,
+				nr_sessions * sizeof(struct lttng_session));
 
-		session_unlock_list();
+		free(sessions);
 
 		ret = LTTNG_OK;
 		break;
@@ -3977,6 +4059,26 @@ error_add_context:
 		*cmd_ctx->llm->payload = (uint8_t) pending_ret;
 		break;
 	}
+	case LTTNG_WAIT_DATA_PENDING:
+	{
+		ret = cmd_wait_data_pending(cmd_ctx->session);
+		if (ret == 1) {
+			/* Replied by the data pending waiter thread. */
+			cmd_ctx->wait_data_pending = 1;
+			ret = LTTNG_OK;
+		}
+		break;
+	}
+	case LTTNG_BEGIN_SESSION_UPDATE:
+	{
+		ret = cmd_begin_session_update(cmd_ctx->session);
+		break;
+	}
+	case LTTNG_END_SESSION_UPDATE:
+	{
+		ret = cmd_end_session_update(cmd_ctx->session);
+		break;
+	}
 	case LTTNG_SNAPSHOT_ADD_OUTPUT:
 	{
 		struct lttcomm_lttng_output_id reply;
@@ -4145,11 +4247,16 @@ error:
 setup_error:
 	if (cmd_ctx->session) {
 		session_unlock(cmd_ctx->session);
+		session_put(cmd_ctx->session);
+		cmd_ctx->session = NULL;
 	}
-	if (need_tracing_session) {
+	if (list_locked) {
 		session_unlock_list();
 	}
 init_setup_error:
+	if (cmd_locked) {
+		pthread_mutex_unlock(&client_cmd_lock);
+	}
 	assert(!rcu_read_ongoing());
 	return ret;
 }
@@ -4349,21 +4456,403 @@ error:
 	return NULL;
 }
 
+/*
+ * Send the reply of a processed client command back to the client.
+ *
+ * The connection is then handed back to the client thread for the next
+ * command of the client, unless the command failed.
+ */
+static void reply_client_cmd(struct command_ctx *cmd_ctx, int sock_error)
+{
+	int ret;
+
+	DBG("Sending response (size: %d, retcode: %s (%d))",
+			cmd_ctx->lttng_msg_size,
+			lttng_strerror(-cmd_ctx->llm->ret_code),
+			cmd_ctx->llm->ret_code);
+	ret = send_unix_sock(cmd_ctx->sock, cmd_ctx->llm,
+			cmd_ctx->lttng_msg_size);
+	if (ret < 0) {
+		ERR("Failed to send data back to client");
+		goto close;
+	}
+
+	/*
+	 * A failed command may not have received all the var. len. data sent by
+	 * the client, so the connection can't be reused.
+	 */
+	if (sock_error || cmd_ctx->llm->ret_code != LTTNG_OK) {
+		goto close;
+	}
+
+	ret = send_socket_to_thread(client_conn_pipe[1], cmd_ctx->sock);
+	if (ret < 0) {
+		goto close;
+	}
+	goto end;
+
+close:
+	/* End of transmission */
+	ret = close(cmd_ctx->sock);
+	if (ret) {
+		PERROR("close");
+	}
+end:
+	clean_command_ctx(&cmd_ctx);
+}
+
+/*
+ * Queue a LTTNG_WAIT_DATA_PENDING command for the data pending waiter thread.
+ */
+static void data_pending_wait_queue_push(struct command_ctx *cmd_ctx)
+{
+	pthread_mutex_lock(&data_pending_wait_queue.lock);
+	cds_list_add_tail(&cmd_ctx->node, &data_pending_wait_queue.head);
+	pthread_cond_signal(&data_pending_wait_queue.cond);
+	pthread_mutex_unlock(&data_pending_wait_queue.lock);
+}
+
+/*
+ * Process a client command and send the reply back to the client, unless it
+ * is deferred to the data pending waiter thread.
+ */
+static void handle_client_cmd(struct command_ctx *cmd_ctx)
+{
+	int ret, sock_error = 0;
+
+	rcu_thread_online();
+	/*
+	 * This function dispatch the work to the kernel or userspace tracer
+	 * libs and fill the lttcomm_lttng_msg data structure of all the needed
+	 * informations for the client. The command context struct contains
+	 * everything this function may needs.
+	 */
+	ret = process_client_msg(cmd_ctx, cmd_ctx->sock, &sock_error);
+	rcu_thread_offline();
+	if (ret < 0) {
+		/*
+		 * TODO: Inform client somehow of the fatal error. At
+		 * this point, ret < 0 means that a zmalloc failed
+		 * (ENOMEM). Error detected but still accept
+		 * command, unless a socket error has been
+		 * detected.
+		 */
+		ret = close(cmd_ctx->sock);
+		if (ret) {
+			PERROR("close");
+		}
+		clean_command_ctx(&cmd_ctx);
+		return;
+	}
+
+	if (cmd_ctx->wait_data_pending) {
+		data_pending_wait_queue_push(cmd_ctx);
+		return;
+	}
+
+	reply_client_cmd(cmd_ctx, sock_error);
+}
+
+/*
+ * Check again the session of a deferred LTTNG_WAIT_DATA_PENDING command.
+ *
+ * Return 1 if data is still pending, else the return code of the command.
+ */
+static int check_data_pending(struct command_ctx *cmd_ctx)
+{
+	int ret;
+	struct ltt_session *session;
+
+	session = session_get_by_name(cmd_ctx->lsm->session.name);
+	if (!session) {
+		return LTTNG_ERR_SESS_NOT_FOUND;
+	}
+
+	session_lock(session);
+	if (session->destroyed) {
+		ret = LTTNG_ERR_SESS_NOT_FOUND;
+	} else {
+		ret = cmd_wait_data_pending(session);
+	}
+	session_unlock(session);
+	session_put(session);
+	return ret;
+}
+
+/*
+ * Data pending waiter thread, replying to the LTTNG_WAIT_DATA_PENDING commands
+ * once the data of their session is no longer pending. Their sessions are
+ * checked every DEFAULT_DATA_AVAILABILITY_WAIT_TIME usec.
+ */
+static void *thread_data_pending_waiter(void *data)
+{
+	int ret;
+	struct timespec deadline;
+	struct command_ctx *cmd_ctx, *tmp;
+	CDS_LIST_HEAD(waiting);
+
+	DBG("[thread] Data pending waiter started");
+
+	rcu_register_thread();
+	rcu_thread_offline();
+
+	pthread_mutex_lock(&data_pending_wait_queue.lock);
+	while (!data_pending_wait_queue.quit) {
+		if (cds_list_empty(&data_pending_wait_queue.head)) {
+			pthread_cond_wait(&data_pending_wait_queue.cond,
+					&data_pending_wait_queue.lock);
+			continue;
+		}
+
+		/* Leave the consumers time to extract the data before checking. */
+		ret = clock_gettime(CLOCK_REALTIME, &deadline);
+		if (ret < 0) {
+			PERROR("clock_gettime");
+			break;
+		}
+		deadline.tv_nsec += DEFAULT_DATA_AVAILABILITY_WAIT_TIME * 1000UL;
+		deadline.tv_sec += deadline.tv_nsec / 1000000000UL;
+		deadline.tv_nsec %= 1000000000UL;
+		do {
+			ret = pthread_cond_timedwait(&data_pending_wait_queue.cond,
+					&data_pending_wait_queue.lock, &deadline);
+		} while (ret != ETIMEDOUT && !data_pending_wait_queue.quit);
+		if (data_pending_wait_queue.quit) {
+			break;
+		}
+
+		cds_list_splice(&data_pending_wait_queue.head, &waiting);
+		CDS_INIT_LIST_HEAD(&data_pending_wait_queue.head);
+		pthread_mutex_unlock(&data_pending_wait_queue.lock);
+
+		rcu_thread_online();
+		cds_list_for_each_entry_safe(cmd_ctx, tmp, &waiting, node) {
+			ret = check_data_pending(cmd_ctx);
+			if (ret == 1) {
+				continue;
+			}
+			cds_list_del(&cmd_ctx->node);
+			cmd_ctx->llm->ret_code = ret;
+			reply_client_cmd(cmd_ctx, 0);
+		}
+		rcu_thread_offline();
+
+		pthread_mutex_lock(&data_pending_wait_queue.lock);
+		cds_list_splice(&waiting, &data_pending_wait_queue.head);
+		CDS_INIT_LIST_HEAD(&waiting);
+	}
+	pthread_mutex_unlock(&data_pending_wait_queue.lock);
+
+	DBG("Data pending waiter thread dying");
+
+	rcu_unregister_thread();
+	return NULL;
+}
+
+/*
+ * Stop the data pending waiter thread and drop the commands it did not reply
+ * to. The client workers, which queue them, MUST be stopped before.
+ */
+static void stop_data_pending_waiter(pthread_t waiter)
+{
+	int ret;
+	struct command_ctx *cmd_ctx, *tmp;
+
+	pthread_mutex_lock(&data_pending_wait_queue.lock);
+	data_pending_wait_queue.quit = 1;
+	pthread_cond_broadcast(&data_pending_wait_queue.cond);
+	pthread_mutex_unlock(&data_pending_wait_queue.lock);
+
+	ret = pthread_join(waiter, NULL);
+	if (ret) {
+		errno = ret;
+		PERROR("pthread_join data pending waiter");
+	}
+
+	cds_list_for_each_entry_safe(cmd_ctx, tmp, &data_pending_wait_queue.head,
+			node) {
+		cds_list_del(&cmd_ctx->node);
+		ret = close(cmd_ctx->sock);
+		if (ret) {
+			PERROR("close");
+		}
+		clean_command_ctx(&cmd_ctx);
+	}
+}
+
+/*
+ * Queue a client command for the client worker threads.
+ */
+static void client_cmd_queue_push(struct command_ctx *cmd_ctx)
+{
+	pthread_mutex_lock(&client_cmd_queue.lock);
+	cds_list_add_tail(&cmd_ctx->node, &client_cmd_queue.head);
+	pthread_cond_signal(&client_cmd_queue.cond);
+	pthread_mutex_unlock(&client_cmd_queue.lock);
+}
+
+/*
+ * Wait for a queued client command.
+ *
+ * Return the command or NULL if the client thread is quitting.
+ */
+static struct command_ctx *client_cmd_queue_pop(void)
+{
+	struct command_ctx *cmd_ctx = NULL;
+
+	pthread_mutex_lock(&client_cmd_queue.lock);
+	while (cds_list_empty(&client_cmd_queue.head) &&
+			!client_cmd_queue.quit) {
+		pthread_cond_wait(&client_cmd_queue.cond, &client_cmd_queue.lock);
+	}
+	if (!client_cmd_queue.quit) {
+		cmd_ctx = cds_list_first_entry(&client_cmd_queue.head,
+				struct command_ctx, node);
+		cds_list_del(&cmd_ctx->node);
+	}
+	pthread_mutex_unlock(&client_cmd_queue.lock);
+	return cmd_ctx;
+}
+
+/*
+ * Client worker thread, processing the commands queued by the client thread.
+ * Several of them run so a slow command does not hold up the others, see
+ * is_concurrent_client_cmd().
+ */
+static void *thread_client_worker(void *data)
+{
+	struct command_ctx *cmd_ctx;
+
+	DBG("[thread] Client worker started");
+
+	rcu_register_thread();
+	rcu_thread_offline();
+
+	while ((cmd_ctx = client_cmd_queue_pop())) {
+		handle_client_cmd(cmd_ctx);
+	}
+
+	DBG("Client worker thread dying");
+
+	rcu_thread_online();
+	rcu_unregister_thread();
+	return NULL;
+}
+
+/*
+ * Stop the client worker threads and drop the commands they did not process.
+ */
+static void stop_client_workers(pthread_t *workers, unsigned int nb_workers)
+{
+	int ret;
+	unsigned int i;
+	struct command_ctx *cmd_ctx, *tmp;
+
+	pthread_mutex_lock(&client_cmd_queue.lock);
+	client_cmd_queue.quit = 1;
+	pthread_cond_broadcast(&client_cmd_queue.cond);
+	pthread_mutex_unlock(&client_cmd_queue.lock);
+
+	for (i = 0; i < nb_workers; i++) {
+		ret = pthread_join(workers[i], NULL);
+		if (ret) {
+			errno = ret;
+			PERROR("pthread_join client worker");
+		}
+	}
+
+	cds_list_for_each_entry_safe(cmd_ctx, tmp, &client_cmd_queue.head,
+			node) {
+		cds_list_del(&cmd_ctx->node);
+		ret = close(cmd_ctx->sock);
+		if (ret) {
+			PERROR("close");
+		}
+		clean_command_ctx(&cmd_ctx);
+	}
+}
+
+/*
+ * Receive a command on a client connection and queue it for the client
+ * workers. The worker processing the command owns the connection until it
+ * hands it back. The connection is closed if the client sent no command.
+ *
+ * Return 0 on success else a negative value on a fatal error.
+ */
+static int recv_client_cmd(int sock)
+{
+	int ret;
+	struct command_ctx *cmd_ctx;
+
+	/* Allocate context command to process the client request */
+	cmd_ctx = zmalloc(sizeof(struct command_ctx));
+	if (cmd_ctx == NULL) {
+		PERROR("zmalloc cmd_ctx");
+		ret = -ENOMEM;
+		goto error;
+	}
+
+	/* Allocate data buffer for reception */
+	cmd_ctx->lsm = zmalloc(sizeof(struct lttcomm_session_msg));
+	if (cmd_ctx->lsm == NULL) {
+		PERROR("zmalloc cmd_ctx->lsm");
+		ret = -ENOMEM;
+		goto error;
+	}
+
+	cmd_ctx->llm = NULL;
+	cmd_ctx->session = NULL;
+
+	health_code_update();
+
+	/*
+	 * Data is received from the lttng client. The struct
+	 * lttcomm_session_msg (lsm) contains the command and data request of
+	 * the client.
+	 */
+	DBG("Receiving data from client ...");
+	ret = lttcomm_recv_creds_unix_sock(sock, cmd_ctx->lsm,
+			sizeof(struct lttcomm_session_msg), &cmd_ctx->creds);
+	if (ret <= 0) {
+		DBG("Nothing recv() from client... continuing");
+		ret = 0;
+		goto error;
+	}
+
+	health_code_update();
+
+	// TODO: Validate cmd_ctx including sanity check for
+	// security purpose.
+
+	cmd_ctx->sock = sock;
+	client_cmd_queue_push(cmd_ctx);
+	return 0;
+
+error:
+	if (close(sock)) {
+		PERROR("close");
+	}
+	clean_command_ctx(&cmd_ctx);
+	return ret;
+}
+
 /*
  * This thread manage all clients request using the unix client socket for
  * communication.
  */
 static void *thread_manage_clients(void *data)
 {
-	int sock = -1, ret, i, pollfd, err = -1;
-	int sock_error;
+	int sock = -1, ret, i, pollfd, err = -1, accept_client;
 	uint32_t revents, nb_fd;
-	struct command_ctx *cmd_ctx = NULL;
 	struct lttng_poll_event events;
+	pthread_t workers[DEFAULT_CLIENT_CMD_THREADS], waiter;
+	unsigned int nb_workers = 0, waiter_started = 0;
 
 	DBG("[thread] Manage client started");
 
 	rcu_register_thread();
+	/* The commands are processed under RCU by the client workers. */
+	rcu_thread_offline();
 
 	health_register(health_sessiond, HEALTH_SESSIOND_TYPE_CMD);
 
@@ -4375,10 +4864,11 @@ static void *thread_manage_clients(void *data)
 	}
 
 	/*
-	 * Pass 2 as size here for the thread quit pipe and client_sock. Nothing
-	 * more will be added to this poll set.
+	 * Pass 3 as size here for the thread quit pipe, client_sock and the
+	 * client connection pipe. The idle client connections are added to this
+	 * poll set as they are handed back by the client workers.
 	 */
-	ret = sessiond_set_thread_pollset(&events, 2);
+	ret = sessiond_set_thread_pollset(&events, 3);
 	if (ret < 0) {
 		goto error_create_poll;
 	}
@@ -4389,6 +4879,35 @@ static void *thread_manage_clients(void *data)
 		goto error;
 	}
 
+	ret = utils_create_pipe_cloexec(client_conn_pipe);
+	if (ret < 0) {
+		goto error;
+	}
+
+	ret = lttng_poll_add(&events, client_conn_pipe[0], LPOLLIN | LPOLLERR);
+	if (ret < 0) {
+		goto error;
+	}
+
+	ret = pthread_create(&waiter, NULL, thread_data_pending_waiter, NULL);
+	if (ret) {
+		errno = ret;
+		PERROR("pthread_create data pending waiter");
+		goto error;
+	}
+	waiter_started = 1;
+
+	for (nb_workers = 0; nb_workers < DEFAULT_CLIENT_CMD_THREADS;
+			nb_workers++) {
+		ret = pthread_create(&workers[nb_workers], NULL,
+				thread_client_worker, NULL);
+		if (ret) {
+			errno = ret;
+			PERROR("pthread_create client worker");
+			goto error;
+		}
+	}
+
 	sessiond_notify_ready();
 	ret = sem_post(&load_info->message_thread_ready);
 	if (ret) {
@@ -4426,6 +4945,7 @@ static void *thread_manage_clients(void *data)
 		}
 
 		nb_fd = ret;
+		accept_client = 0;
 
 		for (i = 0; i < nb_fd; i++) {
 			/* Fetch once the poll data */
@@ -4449,6 +4969,7 @@ static void *thread_manage_clients(void *data)
 			/* Event on the registration socket */
 			if (pollfd == client_sock) {
 				if (revents & LPOLLIN) {
+					accept_client = 1;
 					continue;
 				} else if (revents & (LPOLLERR | LPOLLHUP | LPOLLRDHUP)) {
 					ERR("Client socket poll error");
@@ -4458,6 +4979,59 @@ static void *thread_manage_clients(void *data)
 					goto error;
 				}
 			}
+
+			/* A client worker handed back a client connection. */
+			if (pollfd == client_conn_pipe[0]) {
+				if (revents & LPOLLIN) {
+					ssize_t size_ret;
+
+					size_ret = lttng_read(client_conn_pipe[0], &sock,
+							sizeof(sock));
+					if (size_ret < sizeof(sock)) {
+						PERROR("read client connection pipe");
+						goto error;
+					}
+
+					ret = lttng_poll_add(&events, sock,
+							LPOLLIN | LPOLLRDHUP);
+					if (ret < 0) {
+						goto error;
+					}
+					sock = -1;
+				} else if (revents & (LPOLLERR | LPOLLHUP | LPOLLRDHUP)) {
+					ERR("Client connection pipe error");
+					goto error;
+				} else {
+					ERR("Unexpected poll events %u for sock %d", revents, pollfd);
+					goto error;
+				}
+				continue;
+			}
+
+			/*
+			 * Next command of a client, or hang up. The connection leaves
+			 * the poll set while a worker owns it.
+			 */
+			ret = lttng_poll_del(&events, pollfd);
+			if (ret < 0) {
+				goto error;
+			}
+			if (revents & LPOLLIN) {
+				ret = recv_client_cmd(pollfd);
+				if (ret < 0) {
+					goto error;
+				}
+			} else {
+				DBG("Client connection %d hung up", pollfd);
+				ret = close(pollfd);
+				if (ret) {
+					PERROR("close");
+				}
+			}
+		}
+
+		if (!accept_client) {
+			continue;
 		}
 
 		DBG("Wait for client response");
@@ -4481,109 +5055,53 @@ static void *thread_manage_clients(void *data)
 			goto error;
 		}
 
-		/* Allocate context command to process the client request */
-		cmd_ctx = zmalloc(sizeof(struct command_ctx));
-		if (cmd_ctx == NULL) {
-			PERROR("zmalloc cmd_ctx");
-			goto error;
-		}
-
-		/* Allocate data buffer for reception */
-		cmd_ctx->lsm = zmalloc(sizeof(struct lttcomm_session_msg));
-		if (cmd_ctx->lsm == NULL) {
-			PERROR("zmalloc cmd_ctx->lsm");
-			goto error;
-		}
-
-		cmd_ctx->llm = NULL;
-		cmd_ctx->session = NULL;
-
-		health_code_update();
-
-		/*
-		 * Data is received from the lttng client. The struct
-		 * lttcomm_session_msg (lsm) contains the command and data request of
-		 * the client.
-		 */
-		DBG("Receiving data from client ...");
-		ret = lttcomm_recv_creds_unix_sock(sock, cmd_ctx->lsm,
-				sizeof(struct lttcomm_session_msg), &cmd_ctx->creds);
-		if (ret <= 0) {
-			DBG("Nothing recv() from client... continuing");
-			ret = close(sock);
-			if (ret) {
-				PERROR("close");
-			}
-			sock = -1;
-			clean_command_ctx(&cmd_ctx);
-			continue;
-		}
-
-		health_code_update();
-
-		// TODO: Validate cmd_ctx including sanity check for
-		// security purpose.
-
-		rcu_thread_online();
-		/*
-		 * This function dispatch the work to the kernel or userspace tracer
-		 * libs and fill the lttcomm_lttng_msg data structure of all the needed
-		 * informations for the client. The command context struct contains
-		 * everything this function may needs.
-		 */
-		ret = process_client_msg(cmd_ctx, sock, &sock_error);
-		rcu_thread_offline();
+		/* The connection is closed on error. */
+		ret = recv_client_cmd(sock);
+		sock = -1;
 		if (ret < 0) {
-			ret = close(sock);
-			if (ret) {
-				PERROR("close");
-			}
-			sock = -1;
-			/*
-			 * TODO: Inform client somehow of the fatal error. At
-			 * this point, ret < 0 means that a zmalloc failed
-			 * (ENOMEM). Error detected but still accept
-			 * command, unless a socket error has been
-			 * detected.
-			 */
-			clean_command_ctx(&cmd_ctx);
-			continue;
+			goto error;
 		}
 
 		health_code_update();
+	}
 
-		DBG("Sending response (size: %d, retcode: %s (%d))",
-				cmd_ctx->lttng_msg_size,
-				lttng_strerror(-cmd_ctx->llm->ret_code),
-				cmd_ctx->llm->ret_code);
-		ret = send_unix_sock(sock, cmd_ctx->llm, cmd_ctx->lttng_msg_size);
-		if (ret < 0) {
-			ERR("Failed to send data back to client");
-		}
+exit:
+error:
+	stop_client_workers(workers, nb_workers);
+	if (waiter_started) {
+		stop_data_pending_waiter(waiter);
+	}
 
-		/* End of transmission */
+	if (sock >= 0) {
 		ret = close(sock);
 		if (ret) {
 			PERROR("close");
 		}
-		sock = -1;
-
-		clean_command_ctx(&cmd_ctx);
-
-		health_code_update();
 	}
 
-exit:
-error:
-	if (sock >= 0) {
-		ret = close(sock);
+	/*
+	 * Close the connections handed back by the workers since the last poll.
+	 * The idle ones of the poll set are left to the process exit.
+	 */
+	if (client_conn_pipe[0] >= 0) {
+		ret = close(client_conn_pipe[1]);
 		if (ret) {
 			PERROR("close");
 		}
+		client_conn_pipe[1] = -1;
+		while (lttng_read(client_conn_pipe[0], &sock, sizeof(sock)) ==
+				sizeof(sock)) {
+			ret = close(sock);
+			if (ret) {
+				PERROR("close");
+			}
+		}
+		sock = -1;
+		utils_close_pipe(client_conn_pipe);
+		client_conn_pipe[0] = -1;
 	}
 
 	lttng_poll_clean(&events);
-	clean_command_ctx(&cmd_ctx);
 
 error_listen:
 error_create_poll:
@@ -4604,6 +5122,7 @@ error_create_poll:
 
 	DBG("Client thread dying");
 
+	rcu_thread_online();
 	rcu_unregister_thread();
 
 	/*
@@ -5520,7 +6039,7 @@ int main(int argc, char **argv)
 {
 	int ret = 0, retval = 0;
 	void *status;
-	const char *home_path, *env_app_timeout;
+	const char *home_path, *env_app_timeout, *env_app_cmd_threads;
 
 	init_kernel_workarounds();
 
@@ -5960,6 +6479,19 @@ int main(int argc, char **argv)
 		app_socket_timeout = DEFAULT_APP_SOCKET_RW_TIMEOUT;
 	}
 
+	/* Check for the application command threads env variable. */
+	env_app_cmd_threads = getenv(DEFAULT_APP_CMD_THREADS_ENV);
+	if (env_app_cmd_threads) {
+		int nb_threads = atoi(env_app_cmd_threads);
+
+		if (nb_threads > 0) {
+			app_cmd_threads = nb_threads;
+		} else {
+			WARN("Invalid %s value, using %u threads",
+					DEFAULT_APP_CMD_THREADS_ENV, app_cmd_threads);
+		}
+	}
+
 	ret = write_pidfile();
 	if (ret) {
 		ERR("Error in write_pidfile");
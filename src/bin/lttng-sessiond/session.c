@@ -23,6 +23,7 @@
 #include <string.h>
 #include <sys/stat.h>
 #include <urcu.h>
+#include <urcu/rculist.h>
 #include <dirent.h>
 #include <sys/types.h>
 
@@ -51,6 +52,14 @@ static struct ltt_session_list ltt_session_list = {
 	.next_uuid = 0,
 };
 
+/*
+ * Session indexes by name and by id. Allocated by the first session added to
+ * the list and only updated with the session list lock held. Lookups are done
+ * under the RCU read-side lock.
+ */
+static struct lttng_ht *ltt_sessions_ht_by_name;
+static struct lttng_ht *ltt_sessions_ht_by_id;
+
 /* These characters are forbidden in a session name. Used by validate_name. */
 static const char *forbidden_name_chars = "/";
 
@@ -88,29 +97,92 @@ error:
 }
 
 /*
- * Add a ltt_session structure to the global list.
+ * Allocate the session indexes if not already done.
  *
  * The caller MUST acquire the session list lock before.
- * Returns the unique identifier for the session.
+ * Return 0 on success else -1 on ENOMEM.
  */
-static uint64_t add_session_list(struct ltt_session *ls)
+static int session_ht_alloc(void)
 {
+	struct lttng_ht *ht_by_name, *ht_by_id;
+
+	if (ltt_sessions_ht_by_name) {
+		return 0;
+	}
+
+	ht_by_name = lttng_ht_new(0, LTTNG_HT_TYPE_STRING);
+	if (!ht_by_name) {
+		goto error;
+	}
+	ht_by_id = lttng_ht_new(0, LTTNG_HT_TYPE_U64);
+	if (!ht_by_id) {
+		lttng_ht_destroy(ht_by_name);
+		goto error;
+	}
+
+	rcu_assign_pointer(ltt_sessions_ht_by_id, ht_by_id);
+	rcu_assign_pointer(ltt_sessions_ht_by_name, ht_by_name);
+	return 0;
+
+error:
+	return -1;
+}
+
+/*
+ * Add a ltt_session structure to the global list and index it by name and id.
+ *
+ * The caller MUST acquire the session list lock before.
+ * Returns 0 on success else -1 on ENOMEM.
+ */
+static int add_session_list(struct ltt_session *ls)
+{
+	int ret;
+
 	assert(ls);
 
-	cds_list_add(&ls->list, &ltt_session_list.head);
-	return ltt_session_list.next_uuid++;
+	ret = session_ht_alloc();
+	if (ret < 0) {
+		goto end;
+	}
+
+	ls->id = ltt_session_list.next_uuid++;
+	lttng_ht_node_init_str(&ls->node_by_name, ls->name);
+	lttng_ht_node_init_u64(&ls->node_by_id, ls->id);
+
+	rcu_read_lock();
+	/* Session names are not unique until the create command checks them. */
+	lttng_ht_add_str(ltt_sessions_ht_by_name, &ls->node_by_name);
+	lttng_ht_add_unique_u64(ltt_sessions_ht_by_id, &ls->node_by_id);
+	rcu_read_unlock();
+
+	cds_list_add_rcu(&ls->list, &ltt_session_list.head);
+
+end:
+	return ret;
 }
 
 /*
- * Delete a ltt_session structure to the global list.
+ * Delete a ltt_session structure from the global list and its indexes.
  *
  * The caller MUST acquire the session list lock before.
  */
 static void del_session_list(struct ltt_session *ls)
 {
+	int ret;
+	struct lttng_ht_iter iter;
+
 	assert(ls);
 
-	cds_list_del(&ls->list);
+	rcu_read_lock();
+	iter.iter.node = &ls->node_by_name.node;
+	ret = lttng_ht_del(ltt_sessions_ht_by_name, &iter);
+	assert(!ret);
+	iter.iter.node = &ls->node_by_id.node;
+	ret = lttng_ht_del(ltt_sessions_ht_by_id, &iter);
+	assert(!ret);
+	rcu_read_unlock();
+
+	cds_list_del_rcu(&ls->list);
 }
 
 /*
@@ -164,26 +236,207 @@ void session_unlock(struct ltt_session *session)
  */
 struct ltt_session *session_find_by_name(const char *name)
 {
-	struct ltt_session *iter;
+	struct lttng_ht *ht;
+	struct lttng_ht_iter iter;
+	struct lttng_ht_node_str *node;
+	struct ltt_session *session = NULL;
 
 	assert(name);
 
 	DBG2("Trying to find session by name %s", name);
 
-	cds_list_for_each_entry(iter, &ltt_session_list.head, list) {
-		if (strncmp(iter->name, name, NAME_MAX) == 0) {
-			goto found;
+	rcu_read_lock();
+	ht = rcu_dereference(ltt_sessions_ht_by_name);
+	if (!ht) {
+		goto end;
+	}
+	lttng_ht_lookup(ht, (void *) name, &iter);
+	node = lttng_ht_iter_get_node_str(&iter);
+	if (!node) {
+		goto end;
+	}
+	session = caa_container_of(node, struct ltt_session, node_by_name);
+
+end:
+	rcu_read_unlock();
+	return session;
+}
+
+/*
+ * Return a ltt_session structure ptr that matches id. If no session found,
+ * NULL is returned. This must be called with the session lock held using
+ * session_lock_list and session_unlock_list.
+ */
+struct ltt_session *session_find_by_id(uint64_t id)
+{
+	struct lttng_ht *ht;
+	struct lttng_ht_iter iter;
+	struct lttng_ht_node_u64 *node;
+	struct ltt_session *session = NULL;
+
+	DBG2("Trying to find session by id %" PRIu64, id);
+
+	rcu_read_lock();
+	ht = rcu_dereference(ltt_sessions_ht_by_id);
+	if (!ht) {
+		goto end;
+	}
+	lttng_ht_lookup(ht, &id, &iter);
+	node = lttng_ht_iter_get_node_u64(&iter);
+	if (!node) {
+		goto end;
+	}
+	session = caa_container_of(node, struct ltt_session, node_by_id);
+
+end:
+	rcu_read_unlock();
+	return session;
+}
+
+/*
+ * Take a reference on a session, unless its last reference was already put.
+ *
+ * Return 1 on success else 0.
+ */
+static int session_get(struct ltt_session *session)
+{
+	long ref, old;
+
+	ref = uatomic_read(&session->ref);
+	for (;;) {
+		if (ref == 0) {
+			return 0;
+		}
+		old = uatomic_cmpxchg(&session->ref, ref, ref + 1);
+		if (old == ref) {
+			return 1;
+		}
+		ref = old;
+	}
+}
+
+static void session_free_rcu(struct rcu_head *head)
+{
+	struct ltt_session *session =
+		caa_container_of(head, struct ltt_session, rcu_node);
+
+	pthread_mutex_destroy(&session->lock);
+	free(session);
+}
+
+/*
+ * Find a session by name and take a reference on it. Unlike
+ * session_find_by_name(), the session list lock does not need to be held. The
+ * reference must be released with session_put() and the session ignored if
+ * it is flagged as destroyed once its lock is acquired.
+ *
+ * Return the session or NULL if not found.
+ */
+struct ltt_session *session_get_by_name(const char *name)
+{
+	struct lttng_ht *ht;
+	struct lttng_ht_iter iter;
+	struct lttng_ht_node_str *node;
+	struct ltt_session *session = NULL;
+
+	assert(name);
+
+	DBG2("Trying to get session by name %s", name);
+
+	rcu_read_lock();
+	ht = rcu_dereference(ltt_sessions_ht_by_name);
+	if (!ht) {
+		goto end;
+	}
+	lttng_ht_lookup(ht, (void *) name, &iter);
+	while ((node = lttng_ht_iter_get_node_str(&iter)) != NULL) {
+		session = caa_container_of(node, struct ltt_session, node_by_name);
+		if (session_get(session)) {
+			goto end;
+		}
+		cds_lfht_next_duplicate(ht->ht, ht->match_fct, (void *) name,
+				&iter.iter);
+	}
+	session = NULL;
+
+end:
+	rcu_read_unlock();
+	return session;
+}
+
+/*
+ * Release a reference on a session, freeing it after a grace period if it was
+ * the last one.
+ */
+void session_put(struct ltt_session *session)
+{
+	assert(session);
+
+	if (uatomic_sub_return(&session->ref, 1) == 0) {
+		call_rcu(&session->rcu_node, session_free_rcu);
+	}
+}
+
+/*
+ * Release the references taken by session_get_all() and free the array.
+ */
+void session_put_all(struct ltt_session **sessions, size_t count)
+{
+	size_t i;
+
+	for (i = 0; i < count; i++) {
+		session_put(sessions[i]);
+	}
+	free(sessions);
+}
+
+/*
+ * Take a reference on every session of the session list, without holding the
+ * session list lock. The array of sessions is allocated and returned in
+ * sessions, and must be released with session_put_all(). As for
+ * session_get_by_name(), a session flagged as destroyed once its lock is
+ * acquired must be ignored.
+ *
+ * Return the number of sessions or -1 on ENOMEM.
+ */
+ssize_t session_get_all(struct ltt_session ***sessions)
+{
+	struct ltt_session *session, **array = NULL, **new_array;
+	size_t count = 0, alloc_count = 0;
+
+	assert(sessions);
+
+	rcu_read_lock();
+	cds_list_for_each_entry_rcu(session, &ltt_session_list.head, list) {
+		if (count == alloc_count) {
+			alloc_count = alloc_count ? alloc_count << 1 : 16;
+			new_array = realloc(array, alloc_count * sizeof(*array));
+			if (!new_array) {
+				PERROR("realloc session array");
+				goto error;
+			}
+			array = new_array;
 		}
+		if (!session_get(session)) {
+			/* Last reference put, the session is being freed. */
+			continue;
+		}
+		array[count++] = session;
 	}
+	rcu_read_unlock();
 
-	iter = NULL;
+	*sessions = array;
+	return count;
 
-found:
-	return iter;
+error:
+	rcu_read_unlock();
+	session_put_all(array, count);
+	return -1;
 }
 
 /*
- * Delete session from the session list and free the memory.
+ * Delete session from the session list and release the list's reference on
+ * it. The memory is freed once the last reference is put.
  *
  * Return -1 if no session is found.  On success, return 1;
  * Should *NOT* be called with RCU read-side lock held.
@@ -195,11 +448,14 @@ int session_destroy(struct ltt_session *session)
 
 	DBG("Destroying session %s", session->name);
 	del_session_list(session);
-	pthread_mutex_destroy(&session->lock);
+	session->destroyed = 1;
 
 	consumer_output_put(session->consumer);
+	session->consumer = NULL;
 	snapshot_destroy(&session->snapshot);
-	free(session);
+
+	/* Release the reference of the session list. */
+	session_put(session);
 
 	return LTTNG_OK;
 }
@@ -254,6 +510,7 @@ int session_create(char *name, uid_t uid, gid_t gid)
 
 	/* Init lock */
 	pthread_mutex_init(&new_session->lock, NULL);
+	new_session->ref = 1;
 
 	new_session->uid = uid;
 	new_session->gid = gid;
@@ -266,8 +523,13 @@ int session_create(char *name, uid_t uid, gid_t gid)
 
 	/* Add new session to the session list */
 	session_lock_list();
-	new_session->id = add_session_list(new_session);
+	ret = add_session_list(new_session);
 	session_unlock_list();
+	if (ret < 0) {
+		snapshot_destroy(&new_session->snapshot);
+		ret = LTTNG_ERR_NOMEM;
+		goto error;
+	}
 
 	/*
 	 * Consumer is let to NULL since the create_session_uri command will set it
@@ -40,7 +40,9 @@ struct ltt_session_list {
 	 * next_uuid. All public functions in session.c acquire this
 	 * lock and release it before returning. If none of those
 	 * functions are used, the lock MUST be acquired in order to
-	 * iterate or/and do any actions on that list.
+	 * iterate or/and do any actions on that list. Sessions are also
+	 * indexed by name and id in RCU hash tables updated under this
+	 * lock, see session_get_by_name().
 	 */
 	pthread_mutex_t lock;
 
@@ -69,7 +71,18 @@ struct ltt_session {
 	 * session_lock() and session_unlock() for that.
 	 */
 	pthread_mutex_t lock;
+	/* Node in the session list. */
 	struct cds_list_head list;
+	/* Nodes in the session indexes, keyed by name and id. */
+	struct lttng_ht_node_str node_by_name;
+	struct lttng_ht_node_u64 node_by_id;
+	/*
+	 * Reference count. The session list holds a reference which is put by
+	 * session_destroy(), others are taken by session_get_by_name(). The
+	 * session is freed after a grace period once the last one is put.
+	 */
+	long ref;
+	struct rcu_head rcu_node;
 	uint64_t id;		/* session unique identifier */
 	/* UID/GID of the user owning the session */
 	uid_t uid;
@@ -94,6 +107,16 @@ struct ltt_session {
 	 * command reset it to 0.
 	 */
 	unsigned int active:1;
+	/*
+	 * Set by session_destroy(), under the session lock. A session found
+	 * without holding the session list lock must be ignored once set.
+	 */
+	unsigned int destroyed:1;
+	/*
+	 * Set between the LTTNG_BEGIN_SESSION_UPDATE and
+	 * LTTNG_END_SESSION_UPDATE commands.
+	 */
+	unsigned int update_batched:1;
 
 	/* Snapshot representation in a session. */
 	struct snapshot snapshot;
@@ -125,6 +148,11 @@ void session_unlock(struct ltt_session *session);
 void session_unlock_list(void);
 
 struct ltt_session *session_find_by_name(const char *name);
+struct ltt_session *session_find_by_id(uint64_t id);
+struct ltt_session *session_get_by_name(const char *name);
+void session_put(struct ltt_session *session);
+ssize_t session_get_all(struct ltt_session ***sessions);
+void session_put_all(struct ltt_session **sessions, size_t count);
 struct ltt_session_list *session_get_list(void);
 
 int session_access_ok(struct ltt_session *session, uid_t uid, gid_t gid);
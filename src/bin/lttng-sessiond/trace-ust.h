@@ -125,6 +125,12 @@ struct ltt_ust_session {
 	unsigned int snapshot_mode;
 	unsigned int has_non_default_channel;
 	unsigned int live_timer_interval;	/* usec */
+	/*
+	 * Set while the session is updated by a batch of commands, see
+	 * cmd_begin_session_update(). The applications are not updated
+	 * until the batch ends, then all at once.
+	 */
+	unsigned int app_update_deferred:1;
 
 	/* Metadata channel attributes. */
 	struct lttng_ust_channel_attr metadata_attr;
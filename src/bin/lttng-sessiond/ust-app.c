@@ -36,6 +36,7 @@
 #include "buffer-registry.h"
 #include "fd-limit.h"
 #include "health-sessiond.h"
+#include "lttng-sessiond.h"
 #include "ust-app.h"
 #include "ust-consumer.h"
 #include "ust-ctl.h"
@@ -3979,186 +3980,357 @@ int ust_app_disable_event_glb(struct ltt_ust_session *usess,
 }
 
 /*
- * For a specific UST session, create the channel for all registered apps.
+ * Session command sent to every registered application by ust_app_fanout().
  */
-int ust_app_create_channel_glb(struct ltt_ust_session *usess,
-		struct ltt_ust_channel *uchan)
+struct ust_app_fanout {
+	struct ltt_ust_session *usess;
+	int (*cmd)(struct ltt_ust_session *usess, struct ust_app *app,
+			void *data);
+	void *data;
+	struct ust_app **apps;
+	unsigned long nb_apps;
+	/* Index of the next application to handle, updated atomically. */
+	unsigned long next_app;
+	/* Number of applications for which the command failed. */
+	unsigned long nb_errors;
+	/* First error returned by the command. */
+	int ret;
+};
+
+static void ust_app_fanout_run(struct ust_app_fanout *fanout)
 {
-	int ret = 0, created;
-	struct lttng_ht_iter iter;
-	struct ust_app *app;
-	struct ust_app_session *ua_sess = NULL;
+	for (;;) {
+		int ret;
+		unsigned long i;
 
-	/* Very wrong code flow */
-	assert(usess);
-	assert(uchan);
+		i = uatomic_add_return(&fanout->next_app, 1) - 1;
+		if (i >= fanout->nb_apps) {
+			break;
+		}
 
-	DBG2("UST app adding channel %s to UST domain for session id %" PRIu64,
-			uchan->name, usess->id);
+		ret = fanout->cmd(fanout->usess, fanout->apps[i], fanout->data);
+		if (ret < 0) {
+			uatomic_inc(&fanout->nb_errors);
+			(void) uatomic_cmpxchg(&fanout->ret, 0, ret);
+		}
+	}
+}
 
+static void *ust_app_fanout_thread(void *data)
+{
+	struct ust_app_fanout *fanout = data;
+
+	rcu_register_thread();
 	rcu_read_lock();
+	ust_app_fanout_run(fanout);
+	rcu_read_unlock();
+	rcu_unregister_thread();
+	return NULL;
+}
+
+/*
+ * Send a command to every registered application, spreading the applications
+ * over up to max_threads threads, the calling one included. A slow
+ * application only holds up the thread waiting on it, for at most the
+ * application socket timeout.
+ *
+ * Must be called with the RCU read side lock held, which keeps the
+ * applications alive until all the threads are done.
+ *
+ * Return 0 on success or the first error returned by the command.
+ */
+static int ust_app_fanout(struct ltt_ust_session *usess,
+		int (*cmd)(struct ltt_ust_session *usess, struct ust_app *app,
+			void *data),
+		void *data, unsigned int max_threads)
+{
+	int ret;
+	unsigned int nb_threads, nb_started = 0, i;
+	unsigned long capacity = 0;
+	pthread_t *threads = NULL;
+	struct lttng_ht_iter iter;
+	struct ust_app *app;
+	struct ust_app_fanout fanout;
+
+	if (usess->app_update_deferred) {
+		/* No application knows about the session yet. */
+		return 0;
+	}
+
+	memset(&fanout, 0, sizeof(fanout));
+	fanout.usess = usess;
+	fanout.cmd = cmd;
+	fanout.data = data;
 
-	/* For every registered applications */
 	cds_lfht_for_each_entry(ust_app_ht->ht, &iter.iter, app, pid_n.node) {
-		if (!app->compatible) {
-			/*
-			 * TODO: In time, we should notice the caller of this error by
-			 * telling him that this is a version error.
-			 */
-			continue;
+		if (fanout.nb_apps == capacity) {
+			struct ust_app **new_apps;
+
+			capacity = max(capacity * 2, 64UL);
+			new_apps = realloc(fanout.apps, capacity * sizeof(*new_apps));
+			if (!new_apps) {
+				PERROR("realloc ust app fanout");
+				ret = -ENOMEM;
+				goto end;
+			}
+			fanout.apps = new_apps;
 		}
-		if (!trace_ust_pid_tracker_lookup(usess, app->pid)) {
-			/* Skip. */
-			continue;
+		fanout.apps[fanout.nb_apps++] = app;
+	}
+
+	nb_threads = min(fanout.nb_apps, (unsigned long) max(max_threads, 1U));
+	if (nb_threads > 1) {
+		threads = zmalloc((nb_threads - 1) * sizeof(*threads));
+		if (!threads) {
+			PERROR("zmalloc ust app fanout threads");
+			/* Handle all the applications from this thread. */
+			nb_threads = 1;
 		}
+	}
 
-		/*
-		 * Create session on the tracer side and add it to app session HT. Note
-		 * that if session exist, it will simply return a pointer to the ust
-		 * app session.
-		 */
-		ret = create_ust_app_session(usess, app, &ua_sess, &created);
-		if (ret < 0) {
-			switch (ret) {
-			case -ENOTCONN:
-				/*
-				 * The application's socket is not valid. Either a bad socket
-				 * or a timeout on it. We can't inform the caller that for a
-				 * specific app, the session failed so lets continue here.
-				 */
-				ret = 0;	/* Not an error. */
-				continue;
-			case -ENOMEM:
-			default:
-				goto error_rcu_unlock;
-			}
+	for (i = 0; i + 1 < nb_threads; i++) {
+		ret = pthread_create(&threads[i], NULL, ust_app_fanout_thread,
+				&fanout);
+		if (ret) {
+			errno = ret;
+			PERROR("pthread_create ust app fanout");
+			break;
 		}
-		assert(ua_sess);
+		nb_started++;
+	}
 
-		pthread_mutex_lock(&ua_sess->lock);
+	DBG2("UST app session command sent to %lu apps with %u threads",
+			fanout.nb_apps, nb_started + 1);
 
-		if (ua_sess->deleted) {
-			pthread_mutex_unlock(&ua_sess->lock);
-			continue;
+	ust_app_fanout_run(&fanout);
+
+	for (i = 0; i < nb_started; i++) {
+		ret = pthread_join(threads[i], NULL);
+		if (ret) {
+			errno = ret;
+			PERROR("pthread_join ust app fanout");
 		}
+	}
 
-		if (!strncmp(uchan->name, DEFAULT_METADATA_NAME,
-					sizeof(uchan->name))) {
-			copy_channel_attr_to_ustctl(&ua_sess->metadata_attr, &uchan->attr);
-			ret = 0;
-		} else {
-			/* Create channel onto application. We don't need the chan ref. */
-			ret = create_ust_app_channel(ua_sess, uchan, app,
-					LTTNG_UST_CHAN_PER_CPU, usess, NULL);
+	if (fanout.nb_errors) {
+		ERR("UST app session command failed for %lu of %lu applications",
+				fanout.nb_errors, fanout.nb_apps);
+	}
+	ret = fanout.ret;
+end:
+	free(threads);
+	free(fanout.apps);
+	return ret;
+}
+
+/*
+ * Create the channel of a UST session for an application.
+ */
+static int create_channel_glb_app(struct ltt_ust_session *usess,
+		struct ust_app *app, void *data)
+{
+	int ret, created;
+	struct ltt_ust_channel *uchan = data;
+	struct ust_app_session *ua_sess = NULL;
+
+	if (!app->compatible) {
+		/*
+		 * TODO: In time, we should notice the caller of this error by
+		 * telling him that this is a version error.
+		 */
+		return 0;
+	}
+	if (!trace_ust_pid_tracker_lookup(usess, app->pid)) {
+		/* Skip. */
+		return 0;
+	}
+
+	/*
+	 * Create session on the tracer side and add it to app session HT. Note
+	 * that if session exist, it will simply return a pointer to the ust
+	 * app session.
+	 */
+	ret = create_ust_app_session(usess, app, &ua_sess, &created);
+	if (ret < 0) {
+		switch (ret) {
+		case -ENOTCONN:
+			/*
+			 * The application's socket is not valid. Either a bad socket
+			 * or a timeout on it. We can't inform the caller that for a
+			 * specific app, the session failed so lets continue here.
+			 */
+			return 0;	/* Not an error. */
+		case -ENOMEM:
+		default:
+			return ret;
 		}
+	}
+	assert(ua_sess);
+
+	pthread_mutex_lock(&ua_sess->lock);
+
+	if (ua_sess->deleted) {
 		pthread_mutex_unlock(&ua_sess->lock);
-		if (ret < 0) {
-			/* Cleanup the created session if it's the case. */
-			if (created) {
-				destroy_app_session(app, ua_sess);
-			}
-			switch (ret) {
-			case -ENOTCONN:
-				/*
-				 * The application's socket is not valid. Either a bad socket
-				 * or a timeout on it. We can't inform the caller that for a
-				 * specific app, the session failed so lets continue here.
-				 */
-				ret = 0;	/* Not an error. */
-				continue;
-			case -ENOMEM:
-			default:
-				goto error_rcu_unlock;
-			}
+		return 0;
+	}
+
+	if (!strncmp(uchan->name, DEFAULT_METADATA_NAME,
+				sizeof(uchan->name))) {
+		copy_channel_attr_to_ustctl(&ua_sess->metadata_attr, &uchan->attr);
+		ret = 0;
+	} else {
+		/* Create channel onto application. We don't need the chan ref. */
+		ret = create_ust_app_channel(ua_sess, uchan, app,
+				LTTNG_UST_CHAN_PER_CPU, usess, NULL);
+	}
+	pthread_mutex_unlock(&ua_sess->lock);
+	if (ret < 0) {
+		/* Cleanup the created session if it's the case. */
+		if (created) {
+			destroy_app_session(app, ua_sess);
+		}
+		switch (ret) {
+		case -ENOTCONN:
+			/*
+			 * The application's socket is not valid. Either a bad socket
+			 * or a timeout on it. We can't inform the caller that for a
+			 * specific app, the session failed so lets continue here.
+			 */
+			ret = 0;	/* Not an error. */
+			break;
+		case -ENOMEM:
+		default:
+			break;
 		}
 	}
+	return ret;
+}
 
-error_rcu_unlock:
+/*
+ * For a specific UST session, create the channel for all registered apps.
+ */
+int ust_app_create_channel_glb(struct ltt_ust_session *usess,
+		struct ltt_ust_channel *uchan)
+{
+	int ret;
+
+	/* Very wrong code flow */
+	assert(usess);
+	assert(uchan);
+
+	DBG2("UST app adding channel %s to UST domain for session id %" PRIu64,
+			uchan->name, usess->id);
+
+	rcu_read_lock();
+	/*
+	 * The per-UID buffer registries are shared by the applications of a
+	 * user and created on first use, so their applications are handled
+	 * one at a time.
+	 */
+	ret = ust_app_fanout(usess, create_channel_glb_app, uchan,
+			usess->buffer_type == LTTNG_BUFFER_PER_PID ?
+				app_cmd_threads : 1);
 	rcu_read_unlock();
 	return ret;
 }
 
+/* Event enabled on all the applications by ust_app_enable_event_glb(). */
+struct enable_event_glb_data {
+	struct ltt_ust_channel *uchan;
+	struct ltt_ust_event *uevent;
+};
+
 /*
- * Enable event for a specific session and channel on the tracer.
+ * Enable an event of a session channel for an application.
  */
-int ust_app_enable_event_glb(struct ltt_ust_session *usess,
-		struct ltt_ust_channel *uchan, struct ltt_ust_event *uevent)
+static int enable_event_glb_app(struct ltt_ust_session *usess,
+		struct ust_app *app, void *data)
 {
 	int ret = 0;
-	struct lttng_ht_iter iter, uiter;
+	struct enable_event_glb_data *event_data = data;
+	struct lttng_ht_iter uiter;
 	struct lttng_ht_node_str *ua_chan_node;
-	struct ust_app *app;
 	struct ust_app_session *ua_sess;
 	struct ust_app_channel *ua_chan;
 	struct ust_app_event *ua_event;
 
-	DBG("UST app enabling event %s for all apps for session id %" PRIu64,
-			uevent->attr.name, usess->id);
+	if (!app->compatible) {
+		/*
+		 * TODO: In time, we should notice the caller of this error by
+		 * telling him that this is a version error.
+		 */
+		return 0;
+	}
+	ua_sess = lookup_session_by_app(usess, app);
+	if (!ua_sess) {
+		/* The application has problem or is probably dead. */
+		return 0;
+	}
+
+	pthread_mutex_lock(&ua_sess->lock);
 
+	if (ua_sess->deleted) {
+		goto end_unlock;
+	}
+
+	/* Lookup channel in the ust app session */
+	lttng_ht_lookup(ua_sess->channels, (void *) event_data->uchan->name,
+			&uiter);
+	ua_chan_node = lttng_ht_iter_get_node_str(&uiter);
 	/*
-	 * NOTE: At this point, this function is called only if the session and
-	 * channel passed are already created for all apps. and enabled on the
-	 * tracer also.
+	 * It is possible that the channel cannot be found is
+	 * the channel/event creation occurs concurrently with
+	 * an application exit.
 	 */
+	if (!ua_chan_node) {
+		goto end_unlock;
+	}
 
-	rcu_read_lock();
-
-	/* For all registered applications */
-	cds_lfht_for_each_entry(ust_app_ht->ht, &iter.iter, app, pid_n.node) {
-		if (!app->compatible) {
-			/*
-			 * TODO: In time, we should notice the caller of this error by
-			 * telling him that this is a version error.
-			 */
-			continue;
-		}
-		ua_sess = lookup_session_by_app(usess, app);
-		if (!ua_sess) {
-			/* The application has problem or is probably dead. */
-			continue;
-		}
+	ua_chan = caa_container_of(ua_chan_node, struct ust_app_channel, node);
 
-		pthread_mutex_lock(&ua_sess->lock);
+	/* Get event node */
+	ua_event = find_ust_app_event(ua_chan->events,
+			event_data->uevent->attr.name, event_data->uevent->filter,
+			event_data->uevent->attr.loglevel,
+			event_data->uevent->exclusion);
+	if (ua_event == NULL) {
+		DBG3("UST app enable event %s not found for app PID %d."
+				"Skipping app", event_data->uevent->attr.name,
+				app->pid);
+		goto end_unlock;
+	}
 
-		if (ua_sess->deleted) {
-			pthread_mutex_unlock(&ua_sess->lock);
-			continue;
-		}
+	ret = enable_ust_app_event(ua_sess, ua_event, app);
 
-		/* Lookup channel in the ust app session */
-		lttng_ht_lookup(ua_sess->channels, (void *)uchan->name, &uiter);
-		ua_chan_node = lttng_ht_iter_get_node_str(&uiter);
-		/*
-		 * It is possible that the channel cannot be found is
-		 * the channel/event creation occurs concurrently with
-		 * an application exit.
-		 */
-		if (!ua_chan_node) {
-			pthread_mutex_unlock(&ua_sess->lock);
-			continue;
-		}
+end_unlock:
+	pthread_mutex_unlock(&ua_sess->lock);
+	return ret;
+}
 
-		ua_chan = caa_container_of(ua_chan_node, struct ust_app_channel, node);
+/*
+ * Enable event for a specific session and channel on the tracer.
+ */
+int ust_app_enable_event_glb(struct ltt_ust_session *usess,
+		struct ltt_ust_channel *uchan, struct ltt_ust_event *uevent)
+{
+	int ret;
+	struct enable_event_glb_data event_data = {
+		.uchan = uchan,
+		.uevent = uevent,
+	};
 
-		/* Get event node */
-		ua_event = find_ust_app_event(ua_chan->events, uevent->attr.name,
-				uevent->filter, uevent->attr.loglevel, uevent->exclusion);
-		if (ua_event == NULL) {
-			DBG3("UST app enable event %s not found for app PID %d."
-					"Skipping app", uevent->attr.name, app->pid);
-			goto next_app;
-		}
+	DBG("UST app enabling event %s for all apps for session id %" PRIu64,
+			uevent->attr.name, usess->id);
 
-		ret = enable_ust_app_event(ua_sess, ua_event, app);
-		if (ret < 0) {
-			pthread_mutex_unlock(&ua_sess->lock);
-			goto error;
-		}
-	next_app:
-		pthread_mutex_unlock(&ua_sess->lock);
-	}
+	/*
+	 * NOTE: At this point, this function is called only if the session and
+	 * channel passed are already created for all apps. and enabled on the
+	 * tracer also.
+	 */
 
-error:
+	rcu_read_lock();
+	ret = ust_app_fanout(usess, enable_event_glb_app, &event_data,
+			app_cmd_threads);
 	rcu_read_unlock();
 	return ret;
 }
@@ -4617,27 +4789,29 @@ end:
 	return 0;
 }
 
+static int start_trace_all_app(struct ltt_ust_session *usess,
+		struct ust_app *app, void *data)
+{
+	return ust_app_start_trace(usess, app);
+}
+
+static int stop_trace_all_app(struct ltt_ust_session *usess,
+		struct ust_app *app, void *data)
+{
+	return ust_app_stop_trace(usess, app);
+}
+
 /*
  * Start tracing for the UST session.
  */
 int ust_app_start_trace_all(struct ltt_ust_session *usess)
 {
-	int ret = 0;
-	struct lttng_ht_iter iter;
-	struct ust_app *app;
-
 	DBG("Starting all UST traces");
 
 	rcu_read_lock();
-
-	cds_lfht_for_each_entry(ust_app_ht->ht, &iter.iter, app, pid_n.node) {
-		ret = ust_app_start_trace(usess, app);
-		if (ret < 0) {
-			/* Continue to next apps even on error */
-			continue;
-		}
-	}
-
+	/* Continue to next apps even on error */
+	(void) ust_app_fanout(usess, start_trace_all_app, NULL,
+			app_cmd_threads);
 	rcu_read_unlock();
 
 	return 0;
@@ -4649,21 +4823,12 @@ int ust_app_start_trace_all(struct ltt_ust_session *usess)
  */
 int ust_app_stop_trace_all(struct ltt_ust_session *usess)
 {
-	int ret = 0;
-	struct lttng_ht_iter iter;
-	struct ust_app *app;
-
 	DBG("Stopping all UST traces");
 
 	rcu_read_lock();
-
-	cds_lfht_for_each_entry(ust_app_ht->ht, &iter.iter, app, pid_n.node) {
-		ret = ust_app_stop_trace(usess, app);
-		if (ret < 0) {
-			/* Continue to next apps even on error */
-			continue;
-		}
-	}
+	/* Continue to next apps even on error */
+	(void) ust_app_fanout(usess, stop_trace_all_app, NULL,
+			app_cmd_threads);
 
 	(void) ust_app_flush_session(usess);
 
@@ -4821,6 +4986,11 @@ void ust_app_global_update(struct ltt_ust_session *usess, struct ust_app *app)
 		return;
 	}
 
+	if (usess->app_update_deferred) {
+		/* Done for all applications once the update is applied. */
+		return;
+	}
+
 	if (trace_ust_pid_tracker_lookup(usess, app->pid)) {
 		ust_app_global_create(usess, app);
 	} else {
@@ -4843,6 +5013,26 @@ void ust_app_global_update_all(struct ltt_ust_session *usess)
 	rcu_read_unlock();
 }
 
+/*
+ * Return 1 if an application has a session for the given UST session else 0.
+ */
+int ust_app_has_session(struct ltt_ust_session *usess)
+{
+	int ret = 0;
+	struct lttng_ht_iter iter;
+	struct ust_app *app;
+
+	rcu_read_lock();
+	cds_lfht_for_each_entry(ust_app_ht->ht, &iter.iter, app, pid_n.node) {
+		if (lookup_session_by_app(usess, app)) {
+			ret = 1;
+			break;
+		}
+	}
+	rcu_read_unlock();
+	return ret;
+}
+
 /*
  * Add context to a specific channel for global UST domain.
  */
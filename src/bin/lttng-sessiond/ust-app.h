@@ -324,6 +324,7 @@ int ust_app_add_ctx_channel_glb(struct ltt_ust_session *usess,
 		struct ltt_ust_channel *uchan, struct ltt_ust_context *uctx);
 void ust_app_global_update(struct ltt_ust_session *usess, struct ust_app *app);
 void ust_app_global_update_all(struct ltt_ust_session *usess);
+int ust_app_has_session(struct ltt_ust_session *usess);
 
 void ust_app_clean_list(void);
 int ust_app_ht_alloc(void);
@@ -433,6 +434,9 @@ static inline
 void ust_app_global_update(struct ltt_ust_session *usess, struct ust_app *app)
 {}
 static inline
+void ust_app_global_update_all(struct ltt_ust_session *usess)
+{}
+static inline
 int ust_app_disable_channel_glb(struct ltt_ust_session *usess,
 		struct ltt_ust_channel *uchan)
 {
@@ -538,6 +542,12 @@ unsigned int ust_app_get_nb_stream(struct ltt_ust_session *usess)
 	return 0;
 }
 
+static inline
+int ust_app_has_session(struct ltt_ust_session *usess)
+{
+	return 0;
+}
+
 static inline
 int ust_app_supported(void)
 {
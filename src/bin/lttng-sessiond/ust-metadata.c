@@ -28,6 +28,7 @@
 #include <unistd.h>
 #include <inttypes.h>
 #include <common/common.h>
+#include <common/hashtable/utils.h>
 
 #include "ust-registry.h"
 #include "ust-clock.h"
@@ -92,15 +93,16 @@ int get_count_order(unsigned int count)
 }
 
 /*
- * Returns offset where to write in metadata array, or negative error value on error.
+ * Make room for at least len more bytes in the metadata array.
+ *
+ * Returns 0 on success, or negative error value on error.
  */
 static
-ssize_t metadata_reserve(struct ust_registry_session *session, size_t len)
+int metadata_reserve(struct ust_registry_session *session, size_t len)
 {
 	size_t new_len = session->metadata_len + len;
 	size_t new_alloc_len = new_len;
 	size_t old_alloc_len = session->metadata_alloc_len;
-	ssize_t ret;
 
 	if (new_alloc_len > (UINT32_MAX >> 1))
 		return -EINVAL;
@@ -120,29 +122,41 @@ ssize_t metadata_reserve(struct ust_registry_session *session, size_t len)
 		memset(&session->metadata[old_alloc_len], 0, new_alloc_len - old_alloc_len);
 		session->metadata_alloc_len = new_alloc_len;
 	}
-	ret = session->metadata_len;
-	session->metadata_len += len;
-	return ret;
+	return 0;
 }
 
+/*
+ * Append the metadata generated since the last call to the metadata file in a
+ * single write. Called once per statedump rather than per fragment.
+ */
 static
-int metadata_file_append(struct ust_registry_session *session,
-		const char *str, size_t len)
+int metadata_file_flush(struct ust_registry_session *session)
 {
+	size_t len;
 	ssize_t written;
 
 	if (session->metadata_fd < 0) {
 		return 0;
 	}
+	len = session->metadata_len - session->metadata_len_written;
+	if (!len) {
+		return 0;
+	}
 	/* Write to metadata file */
-	written = lttng_write(session->metadata_fd, str, len);
+	written = lttng_write(session->metadata_fd,
+			&session->metadata[session->metadata_len_written], len);
 	if (written != len) {
+		PERROR("Error appending to metadata file");
 		return -1;
 	}
+	session->metadata_len_written = session->metadata_len;
 	return 0;
 }
 
 /*
+ * Format directly at the end of the metadata array, which is only grown
+ * when the fragment does not fit in the space left.
+ *
  * We have exclusive access to our metadata buffer (protected by the
  * ust_lock), so we can do racy operations such as looking for
  * remaining space left in packet and write, since mutual exclusion
@@ -152,36 +166,37 @@ static
 int lttng_metadata_printf(struct ust_registry_session *session,
 		const char *fmt, ...)
 {
-	char *str = NULL;
-	size_t len;
+	char *str;
+	size_t avail;
 	va_list ap;
-	ssize_t offset;
-	int ret;
+	int ret, len;
 
+	avail = session->metadata_alloc_len - session->metadata_len;
+	str = avail ? &session->metadata[session->metadata_len] : NULL;
 	va_start(ap, fmt);
-	ret = vasprintf(&str, fmt, ap);
+	len = vsnprintf(str, avail, fmt, ap);
 	va_end(ap);
-	if (ret < 0)
-		return -ENOMEM;
+	if (len < 0)
+		return -EINVAL;
 
-	len = strlen(str);
-	offset = metadata_reserve(session, len);
-	if (offset < 0) {
-		ret = offset;
-		goto end;
-	}
-	memcpy(&session->metadata[offset], str, len);
-	ret = metadata_file_append(session, str, len);
-	if (ret) {
-		PERROR("Error appending to metadata file");
-		goto end;
+	if (len >= avail) {
+		/* Room for the null byte written by vsnprintf. */
+		ret = metadata_reserve(session, (size_t) len + 1);
+		if (ret)
+			return ret;
+		avail = session->metadata_alloc_len - session->metadata_len;
+		str = &session->metadata[session->metadata_len];
+		va_start(ap, fmt);
+		len = vsnprintf(str, avail, fmt, ap);
+		va_end(ap);
+		if (len < 0)
+			return -EINVAL;
 	}
-	DBG3("Append to metadata: \"%s\"", str);
-	ret = 0;
 
-end:
-	free(str);
-	return ret;
+	/* The null byte is not part of the metadata. */
+	session->metadata_len += len;
+	DBG3("Append to metadata: \"%.*s\"", len, str);
+	return 0;
 }
 
 static
@@ -601,6 +616,265 @@ int _lttng_fields_metadata_statedump(struct ust_registry_session *session,
 	return ret;
 }
 
+/*
+ * Cache of the rendered "fields" block of event declarations, shared by all
+ * the registries of the session daemon. Applications built from the same
+ * tracepoint providers register identical events in each of their per-PID
+ * registries: the block is rendered once and copied afterwards.
+ *
+ * The event header (id, stream id, log level) depends on the registry and is
+ * always rendered. Events having enumeration fields are not cached since
+ * enumeration ids are allocated per registry.
+ */
+struct ust_metadata_fields {
+	char name[LTTNG_UST_SYM_NAME_LEN];
+	char *signature;
+	int byte_order;
+	size_t nr_fields;
+	struct ustctl_field *fields;
+	/* Rendered fields, not null terminated. */
+	char *text;
+	size_t len;
+	/* Number of registry events referencing this entry. */
+	unsigned long refcount;
+	struct lttng_ht_node_str node;
+};
+
+static struct lttng_ht *metadata_fields_ht;
+static pthread_mutex_t metadata_fields_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int ht_match_metadata_fields(struct cds_lfht_node *node,
+		const void *_key)
+{
+	const struct ust_metadata_fields *entry, *key = _key;
+
+	entry = caa_container_of(node, struct ust_metadata_fields, node.node);
+
+	if (strncmp(entry->name, key->name, sizeof(entry->name))) {
+		goto no_match;
+	}
+	if (strcmp(entry->signature, key->signature)) {
+		goto no_match;
+	}
+	if (entry->byte_order != key->byte_order ||
+			entry->nr_fields != key->nr_fields) {
+		goto no_match;
+	}
+	if (memcmp(entry->fields, key->fields,
+			entry->nr_fields * sizeof(*entry->fields))) {
+		goto no_match;
+	}
+
+	/* Match */
+	return 1;
+
+no_match:
+	return 0;
+}
+
+static unsigned long ht_hash_metadata_fields(void *_key, unsigned long seed)
+{
+	uint64_t xored_key;
+	struct ust_metadata_fields *key = _key;
+
+	xored_key = (uint64_t) (hash_key_str(key->name, seed) ^
+			hash_key_str(key->signature, seed));
+
+	return hash_key_u64(&xored_key, seed);
+}
+
+static void destroy_metadata_fields_rcu(struct rcu_head *head)
+{
+	struct lttng_ht_node_str *node =
+		caa_container_of(head, struct lttng_ht_node_str, head);
+	struct ust_metadata_fields *entry =
+		caa_container_of(node, struct ust_metadata_fields, node);
+
+	free(entry->signature);
+	free(entry->fields);
+	free(entry->text);
+	free(entry);
+}
+
+static
+int event_fields_cacheable(struct ust_registry_event *event)
+{
+	size_t i;
+
+	for (i = 0; i < event->nr_fields; i++) {
+		if (event->fields[i].type.atype == ustctl_atype_enum) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/*
+ * Return the cache entry matching the event, or NULL.
+ *
+ * Called with the cache lock held.
+ */
+static
+struct ust_metadata_fields *metadata_fields_lookup(
+		struct ust_registry_session *session,
+		struct ust_registry_event *event)
+{
+	struct cds_lfht_iter iter;
+	struct cds_lfht_node *node;
+	struct ust_metadata_fields key;
+
+	if (!metadata_fields_ht) {
+		return NULL;
+	}
+
+	strncpy(key.name, event->name, sizeof(key.name));
+	key.name[sizeof(key.name) - 1] = '\0';
+	key.signature = event->signature;
+	key.byte_order = session->byte_order;
+	key.nr_fields = event->nr_fields;
+	key.fields = event->fields;
+
+	rcu_read_lock();
+	cds_lfht_lookup(metadata_fields_ht->ht,
+			ht_hash_metadata_fields(&key, lttng_ht_seed),
+			ht_match_metadata_fields, &key, &iter);
+	node = cds_lfht_iter_get_node(&iter);
+	rcu_read_unlock();
+	if (!node) {
+		return NULL;
+	}
+	return caa_container_of(node, struct ust_metadata_fields, node.node);
+}
+
+/*
+ * Add the fields rendered for the event to the cache. A failure only means
+ * the next registries will render them again.
+ *
+ * Called with the cache lock held.
+ */
+static
+struct ust_metadata_fields *metadata_fields_add(
+		struct ust_registry_session *session,
+		struct ust_registry_event *event,
+		const char *text, size_t len)
+{
+	struct ust_metadata_fields *entry;
+
+	if (!metadata_fields_ht) {
+		metadata_fields_ht = lttng_ht_new(0, LTTNG_HT_TYPE_STRING);
+		if (!metadata_fields_ht) {
+			return NULL;
+		}
+	}
+
+	entry = zmalloc(sizeof(*entry));
+	if (!entry) {
+		goto error;
+	}
+	strncpy(entry->name, event->name, sizeof(entry->name));
+	entry->name[sizeof(entry->name) - 1] = '\0';
+	entry->signature = strdup(event->signature);
+	entry->byte_order = session->byte_order;
+	entry->nr_fields = event->nr_fields;
+	entry->fields = zmalloc(event->nr_fields * sizeof(*entry->fields) + 1);
+	entry->text = zmalloc(len + 1);
+	if (!entry->signature || !entry->fields || !entry->text) {
+		goto error;
+	}
+	memcpy(entry->fields, event->fields,
+			event->nr_fields * sizeof(*entry->fields));
+	memcpy(entry->text, text, len);
+	entry->len = len;
+
+	cds_lfht_node_init(&entry->node.node);
+	rcu_read_lock();
+	cds_lfht_add(metadata_fields_ht->ht,
+			ht_hash_metadata_fields(entry, lttng_ht_seed),
+			&entry->node.node);
+	rcu_read_unlock();
+	return entry;
+
+error:
+	if (entry) {
+		free(entry->signature);
+		free(entry->fields);
+		free(entry->text);
+		free(entry);
+	}
+	return NULL;
+}
+
+/*
+ * Release the cached fields referenced by the event, if any.
+ */
+void ust_metadata_event_fields_put(struct ust_registry_event *event)
+{
+	struct ust_metadata_fields *entry = event->metadata_fields;
+	struct lttng_ht_iter iter;
+
+	if (!entry) {
+		return;
+	}
+	event->metadata_fields = NULL;
+
+	pthread_mutex_lock(&metadata_fields_lock);
+	if (--entry->refcount == 0) {
+		iter.iter.node = &entry->node.node;
+		rcu_read_lock();
+		(void) lttng_ht_del(metadata_fields_ht, &iter);
+		rcu_read_unlock();
+		call_rcu(&entry->node.head, destroy_metadata_fields_rcu);
+	}
+	pthread_mutex_unlock(&metadata_fields_lock);
+}
+
+/*
+ * Dump the fields of the event, copying them from the cache when another
+ * registry already rendered the same event.
+ */
+static
+int _lttng_event_fields_statedump(struct ust_registry_session *session,
+		struct ust_registry_event *event)
+{
+	int ret;
+	size_t start = session->metadata_len;
+	struct ust_metadata_fields *entry;
+
+	if (!event_fields_cacheable(event)) {
+		return _lttng_fields_metadata_statedump(session, event);
+	}
+
+	pthread_mutex_lock(&metadata_fields_lock);
+	entry = metadata_fields_lookup(session, event);
+	if (entry) {
+		ret = metadata_reserve(session, entry->len);
+		if (ret) {
+			goto end;
+		}
+		memcpy(&session->metadata[session->metadata_len], entry->text,
+				entry->len);
+		session->metadata_len += entry->len;
+	} else {
+		ret = _lttng_fields_metadata_statedump(session, event);
+		if (ret) {
+			goto end;
+		}
+		entry = metadata_fields_add(session, event,
+				&session->metadata[start],
+				session->metadata_len - start);
+		if (!entry) {
+			goto end;
+		}
+	}
+	if (!event->metadata_fields) {
+		entry->refcount++;
+		event->metadata_fields = entry;
+	}
+end:
+	pthread_mutex_unlock(&metadata_fields_lock);
+	return ret;
+}
+
 /*
  * Should be called with session registry mutex held.
  */
@@ -608,7 +882,7 @@ int ust_metadata_event_statedump(struct ust_registry_session *session,
 		struct ust_registry_channel *chan,
 		struct ust_registry_event *event)
 {
-	int ret = 0;
+	int ret = 0, flush_ret;
 
 	/* Don't dump metadata events */
 	if (chan->chan_id == -1U)
@@ -645,7 +919,7 @@ int ust_metadata_event_statedump(struct ust_registry_session *session,
 	if (ret)
 		goto end;
 
-	ret = _lttng_fields_metadata_statedump(session, event);
+	ret = _lttng_event_fields_statedump(session, event);
 	if (ret)
 		goto end;
 
@@ -657,7 +931,8 @@ int ust_metadata_event_statedump(struct ust_registry_session *session,
 	event->metadata_dumped = 1;
 
 end:
-	return ret;
+	flush_ret = metadata_file_flush(session);
+	return ret ? ret : flush_ret;
 }
 
 /*
@@ -666,7 +941,7 @@ end:
 int ust_metadata_channel_statedump(struct ust_registry_session *session,
 		struct ust_registry_channel *chan)
 {
-	int ret = 0;
+	int ret = 0, flush_ret;
 
 	/* Don't dump metadata events */
 	if (chan->chan_id == -1U)
@@ -711,7 +986,8 @@ int ust_metadata_channel_statedump(struct ust_registry_session *session,
 	chan->metadata_dumped = 1;
 
 end:
-	return ret;
+	flush_ret = metadata_file_flush(session);
+	return ret ? ret : flush_ret;
 }
 
 static
@@ -844,7 +1120,7 @@ int ust_metadata_session_statedump(struct ust_registry_session *session,
 	unsigned char *uuid_c;
 	char uuid_s[UUID_STR_LEN],
 		clock_uuid_s[UUID_STR_LEN];
-	int ret = 0;
+	int ret = 0, flush_ret;
 	char hostname[HOST_NAME_MAX];
 
 	assert(session);
@@ -1007,5 +1283,6 @@ int ust_metadata_session_statedump(struct ust_registry_session *session,
 		goto end;
 
 end:
-	return ret;
+	flush_ret = metadata_file_flush(session);
+	return ret ? ret : flush_ret;
 }
@@ -297,6 +297,7 @@ static void destroy_event(struct ust_registry_event *event)
 		return;
 	}
 
+	ust_metadata_event_fields_put(event);
 	free(event->fields);
 	free(event->model_emf_uri);
 	free(event->signature);
@@ -30,6 +30,7 @@
 #define CTF_SPEC_MINOR	8
 
 struct ust_app;
+struct ust_metadata_fields;
 
 struct ust_registry_session {
 	/*
@@ -68,6 +69,8 @@ struct ust_registry_session {
 	size_t metadata_len, metadata_alloc_len;
 	/* Length of bytes sent to the consumer. */
 	size_t metadata_len_sent;
+	/* Length of bytes written to the metadata file. */
+	size_t metadata_len_written;
 
 	char root_shm_path[PATH_MAX];
 	char shm_path[PATH_MAX];
@@ -153,6 +156,8 @@ struct ust_registry_event {
 	 * registration. 0 means no, 1 yes.
 	 */
 	unsigned int metadata_dumped;
+	/* Reference on the cached rendering of the fields. May be NULL. */
+	struct ust_metadata_fields *metadata_fields;
 	/*
 	 * Node in the ust-registry hash table. The event name is used to
 	 * initialize the node and the event_name/signature for the match function.
@@ -276,6 +281,7 @@ int ust_metadata_channel_statedump(struct ust_registry_session *session,
 int ust_metadata_event_statedump(struct ust_registry_session *session,
 		struct ust_registry_channel *chan,
 		struct ust_registry_event *event);
+void ust_metadata_event_fields_put(struct ust_registry_event *event);
 int ust_registry_create_or_find_enum(struct ust_registry_session *session,
 		int session_objd, char *name,
 		struct ustctl_enum_entry *entries, size_t nr_entries,
@@ -363,6 +369,10 @@ int ust_metadata_event_statedump(struct ust_registry_session *session,
 	return 0;
 }
 static inline
+void ust_metadata_event_fields_put(struct ust_registry_event *event)
+{
+}
+static inline
 int ust_registry_create_or_find_enum(struct ust_registry_session *session,
 		int session_objd, char *name,
 		struct ustctl_enum_entry *entries, size_t nr_entries,
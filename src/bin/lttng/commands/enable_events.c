@@ -768,6 +768,12 @@ static int enable_events(char *session_name)
 		goto error;
 	}
 
+	/*
+	 * Enable the events of the list on a single connection. Errors are
+	 * reported by the commands themselves.
+	 */
+	(void) lttng_session_daemon_connect();
+
 	/* Prepare Mi */
 	if (lttng_opt_mi) {
 		/* Open a events element */
@@ -1365,6 +1371,7 @@ error:
 	if (error) {
 		ret = CMD_ERROR;
 	}
+	lttng_session_daemon_disconnect();
 	lttng_destroy_handle(handle);
 
 	if (exclusion_list != NULL) {
@@ -36,6 +36,10 @@ extern int compat_sync_file_range(int fd, off64_t offset, off64_t nbytes,
 #define lttng_sync_file_range(fd, offset, nbytes, flags) \
 	compat_sync_file_range(fd, offset, nbytes, flags)
 
+#include <sys/sendfile.h>
+#define lttng_sendfile(out_fd, in_fd, offset, count) \
+	sendfile(out_fd, in_fd, offset, count)
+
 #endif /* __linux__ */
 
 #if (defined(__FreeBSD__) || defined(__CYGWIN__) || defined(__sun__))
@@ -69,6 +73,19 @@ static inline ssize_t splice(int fd_in, loff_t *off_in, int fd_out, loff_t *off_
 }
 #endif
 
+#if (defined(__FreeBSD__) || defined(__CYGWIN__) || defined(__sun__))
+/*
+ * The sendfile(2) of these systems differs from the Linux one, callers fall
+ * back to copying the data.
+ */
+static inline ssize_t lttng_sendfile(int out_fd, int in_fd, off_t *offset,
+		size_t count)
+{
+	errno = ENOSYS;
+	return -1;
+}
+#endif
+
 #ifdef __FreeBSD__
 #define POSIX_FADV_DONTNEED 0
 
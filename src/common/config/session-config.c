@@ -2536,6 +2536,18 @@ domain_init_error:
 		goto error;
 	}
 
+	/*
+	 * Update the applications once the whole session is loaded rather than
+	 * on each channel, context and event. An older session daemon does not
+	 * support it, which only makes the load slower.
+	 */
+	ret = lttng_begin_session_update((const char *) name);
+	if (ret == -LTTNG_ERR_UND) {
+		ret = 0;
+	} else if (ret) {
+		goto end;
+	}
+
 	if (shm_path) {
 		ret = lttng_set_session_shm_path((const char *) name,
 				(const char *) shm_path);
@@ -2552,6 +2564,13 @@ domain_init_error:
 		}
 	}
 
+	ret = lttng_end_session_update((const char *) name);
+	if (ret == -LTTNG_ERR_UND) {
+		ret = 0;
+	} else if (ret) {
+		goto end;
+	}
+
 	if (started) {
 		ret = lttng_start_tracing((const char *) name);
 		if (ret) {
@@ -2642,6 +2661,8 @@ int load_session_from_file(const char *path, const char *session_name,
 		goto end;
 	}
 
+	/* Issue all the commands of the sessions on a single connection. */
+	(void) lttng_session_daemon_connect();
 	for (session_node = xmlFirstElementChild(sessions_node);
 		session_node; session_node =
 			xmlNextElementSibling(session_node)) {
@@ -2653,6 +2674,7 @@ int load_session_from_file(const char *path, const char *session_name,
 			break;
 		}
 	}
+	lttng_session_daemon_disconnect();
 end:
 	xmlFreeDoc(doc);
 	if (!ret) {
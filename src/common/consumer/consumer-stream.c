@@ -20,12 +20,15 @@
 #define _LGPL_SOURCE
 #include <assert.h>
 #include <inttypes.h>
+#include <poll.h>
 #include <sys/mman.h>
+#include <time.h>
 #include <unistd.h>
 
 #include <common/common.h>
 #include <common/index/index.h>
 #include <common/kernel-consumer/kernel-consumer.h>
+#include <common/kernel-ctl/kernel-ctl.h>
 #include <common/relayd/relayd.h>
 #include <common/ust-consumer/ust-consumer.h>
 #include <common/utils.h>
@@ -156,6 +159,7 @@ void consumer_stream_close(struct lttng_consumer_stream *stream)
 
 	/* Close output fd. Could be a socket or local file at this point. */
 	if (stream->out_fd >= 0) {
+		lttng_consumer_flush_trace_file(stream);
 		ret = close(stream->out_fd);
 		if (ret) {
 			PERROR("close");
@@ -164,6 +168,7 @@ void consumer_stream_close(struct lttng_consumer_stream *stream)
 	}
 
 	if (stream->index_fd >= 0) {
+		(void) consumer_stream_flush_index(stream);
 		ret = close(stream->index_fd);
 		if (ret) {
 			PERROR("close stream index_fd");
@@ -225,6 +230,10 @@ void consumer_stream_delete(struct lttng_consumer_stream *stream,
 		/* Decrement the stream count of the global consumer data. */
 		assert(consumer_data.stream_count > 0);
 		consumer_data.stream_count--;
+		if (stream->data_thread) {
+			assert(stream->data_thread->stream_count > 0);
+			stream->data_thread->stream_count--;
+		}
 	}
 }
 
@@ -258,6 +267,137 @@ void consumer_stream_destroy_buffers(struct lttng_consumer_stream *stream)
 	}
 }
 
+/*
+ * Check whether the zero-copy send of the sub-buffer held by a stream is
+ * completed. The relayd data socket is reset if the send failed, or is still
+ * in progress past the deadline when one is given, so the sub-buffer can be
+ * released without the kernel still sending it.
+ *
+ * Return 1 if the sub-buffer can be released or 0 if the send is still in
+ * progress.
+ */
+static int check_zerocopy_completed(struct consumer_relayd_sock_pair *relayd,
+		struct lttng_consumer_stream *stream, struct timespec *deadline)
+{
+	int ret;
+	struct timespec now;
+
+	pthread_mutex_lock(&relayd->data_sock_mutex);
+	ret = relayd_zerocopy_completed(&relayd->data_sock,
+			&relayd->data_sock_zerocopy, stream->zerocopy_seq);
+	if (ret == 0 && deadline) {
+		ret = clock_gettime(CLOCK_MONOTONIC, &now);
+		if (ret < 0) {
+			PERROR("clock_gettime");
+		} else if (now.tv_sec < deadline->tv_sec ||
+				(now.tv_sec == deadline->tv_sec &&
+				now.tv_nsec < deadline->tv_nsec)) {
+			ret = 0;
+		} else {
+			ERR("Timeout waiting for relayd zero-copy completion");
+			ret = -1;
+		}
+	}
+	if (ret < 0) {
+		/* The hang up is caught by the next operation on the relayd. */
+		relayd_zerocopy_abort(&relayd->data_sock);
+		ret = 1;
+	}
+	pthread_mutex_unlock(&relayd->data_sock_mutex);
+
+	return ret;
+}
+
+/*
+ * Release the sub-buffer a stream holds until the kernel completes its
+ * zero-copy send to the relayd. The relayd data socket lock is only held to
+ * check for the completion, never while waiting for it.
+ *
+ * When wait is set, check periodically until the send completes or the network
+ * timeout, else DEFAULT_CONSUMERD_ZEROCOPY_TIMEOUT_MS, expires, in which case
+ * the relayd data socket is reset. The sub-buffer is released right away if
+ * the relayd is gone since the data is not used anymore.
+ *
+ * The stream lock MUST be acquired.
+ *
+ * Return 1 if the sub-buffer was released, 0 if the send is still in progress
+ * or a negative value on error.
+ */
+int consumer_stream_release_zerocopy(struct lttng_consumer_stream *stream,
+		int wait)
+{
+	int ret;
+	struct consumer_relayd_sock_pair *relayd;
+	struct timespec deadline, *deadline_ptr = NULL;
+
+	assert(stream);
+	assert(stream->zerocopy_pending);
+
+	if (wait) {
+		unsigned long timeout_ms = lttcomm_get_network_timeout();
+
+		if (!timeout_ms) {
+			timeout_ms = DEFAULT_CONSUMERD_ZEROCOPY_TIMEOUT_MS;
+		}
+		ret = clock_gettime(CLOCK_MONOTONIC, &deadline);
+		if (ret < 0) {
+			PERROR("clock_gettime");
+			goto end_nolock;
+		}
+		deadline.tv_sec += timeout_ms / 1000;
+		deadline.tv_nsec += (timeout_ms % 1000) * 1000000;
+		if (deadline.tv_nsec >= 1000000000) {
+			deadline.tv_sec++;
+			deadline.tv_nsec -= 1000000000;
+		}
+		deadline_ptr = &deadline;
+	}
+
+	rcu_read_lock();
+	relayd = consumer_find_relayd(stream->net_seq_idx);
+	if (relayd) {
+		while (!(ret = check_zerocopy_completed(relayd, stream,
+				deadline_ptr))) {
+			if (!wait) {
+				goto end;
+			}
+			(void) poll(NULL, 0, DEFAULT_CONSUMERD_ZEROCOPY_POLL_MS);
+		}
+	}
+
+	stream->zerocopy_pending = 0;
+
+	switch (consumer_data.type) {
+	case LTTNG_CONSUMER_KERNEL:
+		ret = kernctl_put_next_subbuf(stream->wait_fd);
+		if (ret < 0) {
+			ret = -errno;
+			PERROR("kernctl_put_next_subbuf");
+			goto end;
+		}
+		break;
+	case LTTNG_CONSUMER32_UST:
+	case LTTNG_CONSUMER64_UST:
+		ret = lttng_ustconsumer_put_next_subbuf(stream);
+		if (ret < 0) {
+			ERR("Releasing UST sub-buffer of stream %" PRIu64, stream->key);
+			goto end;
+		}
+		break;
+	default:
+		ERR("Unknown consumer_data type");
+		assert(0);
+		ret = -ENOSYS;
+		goto end;
+	}
+	ret = 1;
+
+end:
+	rcu_read_unlock();
+end_nolock:
+	return ret;
+}
+
 /*
  * Destroy and close a already created stream.
  */
@@ -267,6 +407,11 @@ static void destroy_close_stream(struct lttng_consumer_stream *stream)
 
 	DBG("Consumer stream destroy monitored key: %" PRIu64, stream->key);
 
+	/* The relayd may still be sending the held sub-buffer. */
+	if (stream->zerocopy_pending) {
+		(void) consumer_stream_release_zerocopy(stream, 1);
+	}
+
 	/* Destroy tracer buffers of the stream. */
 	consumer_stream_destroy_buffers(stream);
 	/* Close down everything including the relayd if one. */
@@ -328,9 +473,6 @@ void consumer_stream_destroy(struct lttng_consumer_stream *stream,
 			/* Update channel's refcount of the stream. */
 			free_chan = unref_channel(stream);
 
-			/* Indicates that the consumer data state MUST be updated after this. */
-			consumer_data.need_update = 1;
-
 			pthread_mutex_unlock(&stream->lock);
 			pthread_mutex_unlock(&stream->chan->lock);
 			pthread_mutex_unlock(&consumer_data.lock);
@@ -375,13 +517,13 @@ int consumer_stream_write_index(struct lttng_consumer_stream *stream,
 				stream->relayd_stream_id, stream->next_net_seq_num - 1);
 		pthread_mutex_unlock(&relayd->ctrl_sock_mutex);
 	} else {
-		ssize_t size_ret;
-
-		size_ret = index_write(stream->index_fd, index,
-				sizeof(struct ctf_packet_index));
-		if (size_ret < sizeof(struct ctf_packet_index)) {
-			ret = -1;
-		} else {
+		/*
+		 * Local indexes are batched and written once enough of them
+		 * have accumulated, see consumer_stream_flush_index().
+		 */
+		ret = index_buffer_add(&stream->index_buffer, stream->index_fd,
+				index);
+		if (ret > 0) {
 			ret = 0;
 		}
 	}
@@ -394,6 +536,37 @@ error:
 	return ret;
 }
 
+/*
+ * Write the indexes buffered for a stream to its local index file. Must be
+ * done before the index file is closed or rotated and whenever the indexes
+ * must be visible on disk (e.g. on stop).
+ *
+ * The stream lock must be held by the caller.
+ *
+ * Return 0 on success or else a negative value.
+ */
+int consumer_stream_flush_index(struct lttng_consumer_stream *stream)
+{
+	int ret;
+
+	assert(stream);
+
+	if (stream->index_fd < 0) {
+		ret = 0;
+		goto end;
+	}
+
+	ret = index_buffer_flush(&stream->index_buffer, stream->index_fd);
+	if (ret < 0) {
+		ERR("Flushing indexes of stream %" PRIu64, stream->key);
+		goto end;
+	}
+	ret = 0;
+
+end:
+	return ret;
+}
+
 /*
  * Actually do the metadata sync using the given metadata stream.
  *
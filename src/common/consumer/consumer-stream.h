@@ -74,7 +74,19 @@ void consumer_stream_destroy_buffers(struct lttng_consumer_stream *stream);
 int consumer_stream_write_index(struct lttng_consumer_stream *stream,
 		struct ctf_packet_index *index);
 
+/*
+ * Write the buffered indexes of a stream to its local index file.
+ */
+int consumer_stream_flush_index(struct lttng_consumer_stream *stream);
+
 int consumer_stream_sync_metadata(struct lttng_consumer_local_data *ctx,
 		uint64_t session_id);
 
+/*
+ * Release the sub-buffer held by a stream for a zero-copy send to the relayd
+ * once the send is completed.
+ */
+int consumer_stream_release_zerocopy(struct lttng_consumer_stream *stream,
+		int wait);
+
 #endif /* LTTNG_CONSUMER_STREAM_H */
@@ -19,11 +19,13 @@
 #define _LGPL_SOURCE
 #include <assert.h>
 #include <inttypes.h>
-#include <signal.h>
+#include <sys/timerfd.h>
+#include <time.h>
 
 #include <bin/lttng-consumerd/health-consumerd.h>
 #include <common/common.h>
 #include <common/compat/endian.h>
+#include <common/compat/poll.h>
 #include <common/kernel-ctl/kernel-ctl.h>
 #include <common/kernel-consumer/kernel-consumer.h>
 #include <common/consumer/consumer-stream.h>
@@ -31,38 +33,310 @@
 #include <common/consumer/consumer-testpoint.h>
 #include <common/ust-consumer/ust-consumer.h>
 
-static struct timer_signal_data timer_signal = {
-	.tid = 0,
-	.setup_done = 0,
-	.qs_done = 0,
+/* Resolution of the consumer timers, in usec. */
+#define TIMER_WHEEL_TICK_US		1000
+
+/*
+ * The wheel has TIMER_WHEEL_LEVELS levels of TIMER_WHEEL_SLOTS slots. A slot of
+ * level n spans TIMER_WHEEL_SLOTS^n ticks. Timers are queued at the level
+ * matching the time left before they expire and cascade down to the lower
+ * levels as time passes.
+ */
+#define TIMER_WHEEL_LEVELS		4
+#define TIMER_WHEEL_SLOT_BITS		6
+#define TIMER_WHEEL_SLOTS		(1U << TIMER_WHEEL_SLOT_BITS)
+#define TIMER_WHEEL_SLOT_MASK		(TIMER_WHEEL_SLOTS - 1)
+#define TIMER_WHEEL_LEVEL_SHIFT(level)	((level) * TIMER_WHEEL_SLOT_BITS)
+/* Longest delay a timer can be queued for. Later timers are requeued. */
+#define TIMER_WHEEL_MAX_DELTA		\
+	((1ULL << TIMER_WHEEL_LEVEL_SHIFT(TIMER_WHEEL_LEVELS)) - 1)
+
+/*
+ * Single timer wheel holding the switch and live timers of every channel. It
+ * is driven by a timerfd armed for the next tick holding timers and is
+ * handled by the consumer timer thread. All timers expiring on the same tick
+ * are handled in the same wakeup.
+ */
+struct timer_wheel {
+	/* Protects the wheel and the timers it holds. */
+	pthread_mutex_t lock;
+	/* Signaled each time the callback of a timer returns. */
+	pthread_cond_t cond;
+	int timerfd;
+	/* Wakes up the timer thread so it re-arms the timerfd. */
+	struct lttng_pipe *wakeup_pipe;
+	int wakeup_pending;
+	/* Next tick to process. */
+	uint64_t clock;
+	/* Tick for which the timerfd is armed, -1ULL if disarmed. */
+	uint64_t armed_tick;
+	/* Timer for which a callback is being executed, NULL if none. */
+	struct consumer_timer *running;
+	pthread_t tid;
+	int tid_set;
+	struct cds_list_head slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+};
+
+static struct timer_wheel timer_wheel = {
 	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.cond = PTHREAD_COND_INITIALIZER,
+	.timerfd = -1,
+	.armed_tick = -1ULL,
 };
 
 /*
- * Set custom signal mask to current thread.
+ * Return the current tick of the wheel clock.
  */
-static void setmask(sigset_t *mask)
+static uint64_t timer_wheel_now(void)
 {
 	int ret;
+	struct timespec ts;
+
+	ret = clock_gettime(CLOCK_MONOTONIC, &ts);
+	if (ret < 0) {
+		PERROR("clock_gettime timer wheel");
+		return timer_wheel.clock;
+	}
+	return ((uint64_t) ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000) /
+			TIMER_WHEEL_TICK_US;
+}
+
+/*
+ * Queue a timer in the slot matching its expiry. Wheel lock must be held.
+ */
+static void timer_wheel_queue(struct consumer_timer *timer)
+{
+	unsigned int level;
+	uint64_t expiry, delta;
+
+	expiry = max(timer->expiry, timer_wheel.clock);
+	delta = min(expiry - timer_wheel.clock, TIMER_WHEEL_MAX_DELTA);
+	for (level = 0; level < TIMER_WHEEL_LEVELS - 1; level++) {
+		if (delta < (1ULL << TIMER_WHEEL_LEVEL_SHIFT(level + 1))) {
+			break;
+		}
+	}
+	expiry = timer_wheel.clock + delta;
+	cds_list_add_tail(&timer->node, &timer_wheel.slots[level]
+			[(expiry >> TIMER_WHEEL_LEVEL_SHIFT(level)) &
+				TIMER_WHEEL_SLOT_MASK]);
+}
+
+/*
+ * Move the timers of a slot of a higher level to the lower levels. Wheel lock
+ * must be held.
+ */
+static void timer_wheel_cascade(unsigned int level)
+{
+	struct consumer_timer *timer, *tmp;
+	struct cds_list_head *slot;
+	CDS_LIST_HEAD(timers);
+
+	slot = &timer_wheel.slots[level][(timer_wheel.clock >>
+			TIMER_WHEEL_LEVEL_SHIFT(level)) & TIMER_WHEEL_SLOT_MASK];
+	cds_list_splice(slot, &timers);
+	CDS_INIT_LIST_HEAD(slot);
+	cds_list_for_each_entry_safe(timer, tmp, &timers, node) {
+		timer_wheel_queue(timer);
+	}
+}
+
+/*
+ * Return the next tick at which the wheel must be processed, -1ULL if it holds
+ * no timer. For the levels above 0, this is the tick at which the slot
+ * cascades. Wheel lock must be held.
+ */
+static uint64_t timer_wheel_next_tick(void)
+{
+	unsigned int level, i;
+	uint64_t next = -1ULL;
+
+	for (level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+		unsigned int shift = TIMER_WHEEL_LEVEL_SHIFT(level);
+		uint64_t base = timer_wheel.clock >> shift;
 
-	ret = sigemptyset(mask);
-	if (ret) {
-		PERROR("sigemptyset");
+		for (i = 0; i < TIMER_WHEEL_SLOTS; i++) {
+			uint64_t tick = (base + i) << shift;
+
+			if (cds_list_empty(&timer_wheel.slots[level]
+					[(base + i) & TIMER_WHEEL_SLOT_MASK])) {
+				continue;
+			}
+			if (tick < timer_wheel.clock) {
+				/* Current slot already cascaded, next turn. */
+				tick += (uint64_t) TIMER_WHEEL_SLOTS << shift;
+			}
+			next = min(next, tick);
+		}
 	}
-	ret = sigaddset(mask, LTTNG_CONSUMER_SIG_SWITCH);
-	if (ret) {
-		PERROR("sigaddset switch");
+	return next;
+}
+
+/*
+ * Move the wheel clock forward to the next tick holding timers, without going
+ * past limit. The ticks skipped have no timer to expire nor to cascade, which
+ * is the case of all of them after an idle period. Wheel lock must be held.
+ */
+static void timer_wheel_skip(uint64_t limit)
+{
+	uint64_t next;
+
+	if (limit <= timer_wheel.clock) {
+		return;
 	}
-	ret = sigaddset(mask, LTTNG_CONSUMER_SIG_TEARDOWN);
-	if (ret) {
-		PERROR("sigaddset teardown");
+	next = timer_wheel_next_tick();
+	if (next > timer_wheel.clock) {
+		timer_wheel.clock = min(next, limit);
 	}
-	ret = sigaddset(mask, LTTNG_CONSUMER_SIG_LIVE);
-	if (ret) {
-		PERROR("sigaddset live");
+}
+
+/*
+ * Advance the wheel clock up to "now", moving the expired timers to the
+ * expired list. Wheel lock must be held.
+ */
+static void timer_wheel_collect(uint64_t now, struct cds_list_head *expired)
+{
+	while (timer_wheel.clock <= now) {
+		unsigned int level;
+		struct consumer_timer *timer, *tmp;
+		struct cds_list_head *slot;
+
+		/* Only walk the ticks holding timers. */
+		timer_wheel_skip(now + 1);
+		if (timer_wheel.clock > now) {
+			break;
+		}
+
+		/* Cascade the higher levels when a lower level wraps. */
+		for (level = 1; level < TIMER_WHEEL_LEVELS; level++) {
+			if (timer_wheel.clock &
+					((1ULL << TIMER_WHEEL_LEVEL_SHIFT(level)) - 1)) {
+				break;
+			}
+			timer_wheel_cascade(level);
+		}
+
+		slot = &timer_wheel.slots[0][timer_wheel.clock &
+				TIMER_WHEEL_SLOT_MASK];
+		cds_list_for_each_entry_safe(timer, tmp, slot, node) {
+			cds_list_del(&timer->node);
+			if (timer->expiry > timer_wheel.clock) {
+				/*
+				 * Beyond the span of the wheel when queued:
+				 * lands in a later slot.
+				 */
+				timer_wheel_queue(timer);
+				continue;
+			}
+			cds_list_add_tail(&timer->node, expired);
+		}
+		timer_wheel.clock++;
 	}
 }
 
+/*
+ * Arm the timerfd for the next tick to process. Wheel lock must be held.
+ */
+static void timer_wheel_arm(void)
+{
+	int ret;
+	uint64_t next, next_us;
+	struct itimerspec its;
+
+	next = timer_wheel_next_tick();
+	if (next == timer_wheel.armed_tick) {
+		return;
+	}
+
+	memset(&its, 0, sizeof(its));
+	if (next != -1ULL) {
+		next_us = next * TIMER_WHEEL_TICK_US;
+		its.it_value.tv_sec = next_us / 1000000;
+		its.it_value.tv_nsec = (next_us % 1000000) * 1000;
+		if (!its.it_value.tv_sec && !its.it_value.tv_nsec) {
+			/* A zero value disarms the timerfd. */
+			its.it_value.tv_nsec = 1;
+		}
+	}
+	ret = timerfd_settime(timer_wheel.timerfd, TFD_TIMER_ABSTIME, &its,
+			NULL);
+	if (ret < 0) {
+		PERROR("timerfd_settime");
+		return;
+	}
+	timer_wheel.armed_tick = next;
+}
+
+/*
+ * Wake up the timer thread so it re-arms the timerfd. Wheel lock must be
+ * held.
+ */
+static void timer_wheel_wakeup(void)
+{
+	ssize_t ret;
+	char dummy = 0;
+
+	if (timer_wheel.wakeup_pending) {
+		return;
+	}
+	ret = lttng_pipe_write(timer_wheel.wakeup_pipe, &dummy, sizeof(dummy));
+	if (ret != sizeof(dummy)) {
+		PERROR("timer wheel wakeup");
+		return;
+	}
+	timer_wheel.wakeup_pending = 1;
+}
+
+/*
+ * Start a periodic timer on a channel. The first expiry is aligned on a
+ * multiple of the period so that timers sharing a period expire on the same
+ * tick and are handled together.
+ */
+static void timer_wheel_start(struct consumer_timer *timer,
+		struct lttng_consumer_channel *channel,
+		enum consumer_timer_type type, unsigned int interval_us)
+{
+	uint64_t now;
+
+	timer->channel = channel;
+	timer->type = type;
+	timer->period = max(1ULL, (interval_us + TIMER_WHEEL_TICK_US - 1) /
+			(uint64_t) TIMER_WHEEL_TICK_US);
+
+	pthread_mutex_lock(&timer_wheel.lock);
+	now = timer_wheel_now();
+	/* Queue relative to the current time if the wheel was idle. */
+	timer_wheel_skip(now);
+	timer->expiry = (now / timer->period + 1) * timer->period;
+	timer->armed = 1;
+	timer_wheel_queue(timer);
+	if (timer->expiry < timer_wheel.armed_tick) {
+		timer_wheel_wakeup();
+	}
+	pthread_mutex_unlock(&timer_wheel.lock);
+}
+
+/*
+ * Stop a timer. On return, its callback is not running and will not be
+ * called anymore.
+ */
+static void timer_wheel_stop(struct consumer_timer *timer)
+{
+	pthread_mutex_lock(&timer_wheel.lock);
+	if (timer->armed) {
+		cds_list_del_init(&timer->node);
+		timer->armed = 0;
+	}
+	/* The callback can't wait for itself. */
+	if (!timer_wheel.tid_set ||
+			!pthread_equal(timer_wheel.tid, pthread_self())) {
+		while (timer_wheel.running == timer) {
+			pthread_cond_wait(&timer_wheel.cond, &timer_wheel.lock);
+		}
+	}
+	pthread_mutex_unlock(&timer_wheel.lock);
+}
+
 /*
  * Execute action on a timer switch.
  *
@@ -71,12 +345,10 @@ static void setmask(sigset_t *mask)
  * deadlocks.
  */
 static void metadata_switch_timer(struct lttng_consumer_local_data *ctx,
-		int sig, siginfo_t *si, void *uc)
+		struct lttng_consumer_channel *channel)
 {
 	int ret;
-	struct lttng_consumer_channel *channel;
 
-	channel = si->si_value.sival_ptr;
 	assert(channel);
 
 	if (channel->switch_timer_error) {
@@ -113,12 +385,120 @@ static void metadata_switch_timer(struct lttng_consumer_local_data *ctx,
 	}
 }
 
-static int send_empty_index(struct lttng_consumer_stream *stream, uint64_t ts,
+/*
+ * Live beacons of the idle streams of a channel, sent to the relayd in a
+ * single command at the end of the live timer tick. The streams stay locked
+ * until then so no index of theirs is sent ahead of the beacon.
+ */
+struct live_beacons {
+	struct lttcomm_relayd_beacons *msg;
+	struct lttng_consumer_stream **streams;
+	uint32_t count;
+	uint32_t capacity;
+	uint64_t net_seq_idx;
+};
+
+/* Only used by the timer thread, reused across ticks. */
+static struct live_beacons live_beacons;
+
+/*
+ * Add the beacon of a locked stream to the batch.
+ *
+ * Return 1 if the beacon was batched, in which case the stream lock is now
+ * owned by the batch, else 0 and the caller must send the beacon itself.
+ */
+static int live_beacons_add(struct live_beacons *beacons,
+		struct lttng_consumer_stream *stream, uint64_t ts,
 		uint64_t stream_id)
+{
+	struct lttcomm_relayd_beacon *beacon;
+
+	if (beacons->count > 0 && beacons->net_seq_idx != stream->net_seq_idx) {
+		return 0;
+	}
+	if (!consumer_find_relayd(stream->net_seq_idx)) {
+		return 0;
+	}
+
+	if (beacons->count == beacons->capacity) {
+		uint32_t new_capacity = max(beacons->capacity * 2, 16U);
+		struct lttcomm_relayd_beacons *new_msg;
+		struct lttng_consumer_stream **new_streams;
+
+		new_msg = realloc(beacons->msg, sizeof(*new_msg) +
+				new_capacity * sizeof(new_msg->beacons[0]));
+		if (!new_msg) {
+			PERROR("realloc live beacons");
+			return 0;
+		}
+		beacons->msg = new_msg;
+		new_streams = realloc(beacons->streams,
+				new_capacity * sizeof(*new_streams));
+		if (!new_streams) {
+			PERROR("realloc live beacons streams");
+			return 0;
+		}
+		beacons->streams = new_streams;
+		beacons->capacity = new_capacity;
+	}
+
+	beacon = &beacons->msg->beacons[beacons->count];
+	beacon->relay_stream_id = htobe64(stream->relayd_stream_id);
+	beacon->timestamp_end = htobe64(ts);
+	beacon->stream_id = htobe64(stream_id);
+	beacons->streams[beacons->count] = stream;
+	beacons->net_seq_idx = stream->net_seq_idx;
+	beacons->count++;
+	return 1;
+}
+
+/*
+ * Send the batched beacons and release the locks of their streams.
+ *
+ * Must be called with the RCU read side lock held.
+ */
+static int live_beacons_send(struct live_beacons *beacons)
+{
+	int ret = 0;
+	uint32_t i;
+	struct consumer_relayd_sock_pair *relayd;
+
+	if (beacons->count == 0) {
+		goto end;
+	}
+
+	relayd = consumer_find_relayd(beacons->net_seq_idx);
+	if (relayd) {
+		DBG("Sending %" PRIu32 " live beacons to relayd %" PRIu64,
+				beacons->count, beacons->net_seq_idx);
+		pthread_mutex_lock(&relayd->ctrl_sock_mutex);
+		ret = relayd_send_beacons(&relayd->control_sock, beacons->msg,
+				beacons->count);
+		pthread_mutex_unlock(&relayd->ctrl_sock_mutex);
+	} else {
+		ret = -1;
+	}
+
+	for (i = 0; i < beacons->count; i++) {
+		pthread_mutex_unlock(&beacons->streams[i]->lock);
+	}
+	beacons->count = 0;
+end:
+	return ret;
+}
+
+static int send_empty_index(struct lttng_consumer_stream *stream, uint64_t ts,
+		uint64_t stream_id, struct live_beacons *beacons)
 {
 	int ret;
 	struct ctf_packet_index index;
 
+	if (beacons && live_beacons_add(beacons, stream, ts, stream_id)) {
+		/* Sent with the other beacons of the channel. */
+		ret = 1;
+		goto error;
+	}
+
 	memset(&index, 0, sizeof(index));
 	index.stream_id = htobe64(stream_id);
 	index.timestamp_end = htobe64(ts);
@@ -131,7 +511,14 @@ error:
 	return ret;
 }
 
-int consumer_flush_kernel_index(struct lttng_consumer_stream *stream)
+/*
+ * Flush the stream and send a beacon if it is empty. The beacon is added to
+ * the batch when one is given.
+ *
+ * Return 1 if the beacon was batched, 0 on success else a negative value.
+ */
+static int flush_kernel_index(struct lttng_consumer_stream *stream,
+		struct live_beacons *beacons)
 {
 	uint64_t ts, stream_id;
 	int ret;
@@ -159,17 +546,21 @@ int consumer_flush_kernel_index(struct lttng_consumer_stream *stream)
 			goto end;
 		}
 		DBG("Stream %" PRIu64 " empty, sending beacon", stream->key);
-		ret = send_empty_index(stream, ts, stream_id);
-		if (ret < 0) {
-			goto end;
-		}
+		ret = send_empty_index(stream, ts, stream_id, beacons);
+		goto end;
 	}
 	ret = 0;
 end:
 	return ret;
 }
 
-static int check_kernel_stream(struct lttng_consumer_stream *stream)
+int consumer_flush_kernel_index(struct lttng_consumer_stream *stream)
+{
+	return flush_kernel_index(stream, NULL);
+}
+
+static int check_kernel_stream(struct lttng_consumer_stream *stream,
+		struct live_beacons *beacons)
 {
 	int ret;
 
@@ -208,19 +599,31 @@ static int check_kernel_stream(struct lttng_consumer_stream *stream)
 		}
 		break;
 	}
-	ret = consumer_flush_kernel_index(stream);
+	ret = flush_kernel_index(stream, beacons);
+	if (ret == 1) {
+		/* The batch releases the lock once the beacons are sent. */
+		ret = 0;
+		goto end;
+	}
 	pthread_mutex_unlock(&stream->lock);
 end:
 	return ret;
 }
 
-int consumer_flush_ust_index(struct lttng_consumer_stream *stream)
+/*
+ * Flush the stream and send a beacon if it is empty. The beacon is added to
+ * the batch when one is given.
+ *
+ * Return 1 if the beacon was batched, 0 on success else a negative value.
+ */
+static int flush_ust_index(struct lttng_consumer_stream *stream,
+		struct live_beacons *beacons)
 {
 	uint64_t ts, stream_id;
 	int ret;
 
-	ret = cds_lfht_is_node_deleted(&stream->node.node);
-	if (ret) {
+	if (cds_lfht_is_node_deleted(&stream->node.node)) {
+		ret = 0;
 		goto end;
 	}
 
@@ -243,17 +646,21 @@ int consumer_flush_ust_index(struct lttng_consumer_stream *stream)
 			goto end;
 		}
 		DBG("Stream %" PRIu64 " empty, sending beacon", stream->key);
-		ret = send_empty_index(stream, ts, stream_id);
-		if (ret < 0) {
-			goto end;
-		}
+		ret = send_empty_index(stream, ts, stream_id, beacons);
+		goto end;
 	}
 	ret = 0;
 end:
 	return ret;
 }
 
-static int check_ust_stream(struct lttng_consumer_stream *stream)
+int consumer_flush_ust_index(struct lttng_consumer_stream *stream)
+{
+	return flush_ust_index(stream, NULL);
+}
+
+static int check_ust_stream(struct lttng_consumer_stream *stream,
+		struct live_beacons *beacons)
 {
 	int ret;
 
@@ -294,7 +701,12 @@ static int check_ust_stream(struct lttng_consumer_stream *stream)
 		}
 		break;
 	}
-	ret = consumer_flush_ust_index(stream);
+	ret = flush_ust_index(stream, beacons);
+	if (ret == 1) {
+		/* The batch releases the lock once the beacons are sent. */
+		ret = 0;
+		goto end;
+	}
 	pthread_mutex_unlock(&stream->lock);
 end:
 	return ret;
@@ -304,15 +716,13 @@ end:
  * Execute action on a live timer
  */
 static void live_timer(struct lttng_consumer_local_data *ctx,
-		int sig, siginfo_t *si, void *uc)
+		struct lttng_consumer_channel *channel)
 {
 	int ret;
-	struct lttng_consumer_channel *channel;
 	struct lttng_consumer_stream *stream;
 	struct lttng_ht *ht;
 	struct lttng_ht_iter iter;
 
-	channel = si->si_value.sival_ptr;
 	assert(channel);
 
 	if (channel->switch_timer_error) {
@@ -330,7 +740,7 @@ static void live_timer(struct lttng_consumer_local_data *ctx,
 				ht->hash_fct(&channel->key, lttng_ht_seed),
 				ht->match_fct, &channel->key, &iter.iter,
 				stream, node_channel_id.node) {
-			ret = check_ust_stream(stream);
+			ret = check_ust_stream(stream, &live_beacons);
 			if (ret < 0) {
 				goto error_unlock;
 			}
@@ -341,7 +751,7 @@ static void live_timer(struct lttng_consumer_local_data *ctx,
 				ht->hash_fct(&channel->key, lttng_ht_seed),
 				ht->match_fct, &channel->key, &iter.iter,
 				stream, node_channel_id.node) {
-			ret = check_kernel_stream(stream);
+			ret = check_kernel_stream(stream, &live_beacons);
 			if (ret < 0) {
 				goto error_unlock;
 			}
@@ -353,73 +763,24 @@ static void live_timer(struct lttng_consumer_local_data *ctx,
 	}
 
 error_unlock:
+	/* Send the beacons batched so far even on error to release the streams. */
+	ret = live_beacons_send(&live_beacons);
+	if (ret < 0) {
+		ERR("Failed to send the live beacons of channel %" PRIu64,
+				channel->key);
+	}
 	rcu_read_unlock();
 
 error:
 	return;
 }
 
-static
-void consumer_timer_signal_thread_qs(unsigned int signr)
-{
-	sigset_t pending_set;
-	int ret;
-
-	/*
-	 * We need to be the only thread interacting with the thread
-	 * that manages signals for teardown synchronization.
-	 */
-	pthread_mutex_lock(&timer_signal.lock);
-
-	/* Ensure we don't have any signal queued for this channel. */
-	for (;;) {
-		ret = sigemptyset(&pending_set);
-		if (ret == -1) {
-			PERROR("sigemptyset");
-		}
-		ret = sigpending(&pending_set);
-		if (ret == -1) {
-			PERROR("sigpending");
-		}
-		if (!sigismember(&pending_set, LTTNG_CONSUMER_SIG_SWITCH)) {
-			break;
-		}
-		caa_cpu_relax();
-	}
-
-	/*
-	 * From this point, no new signal handler will be fired that would try to
-	 * access "chan". However, we still need to wait for any currently
-	 * executing handler to complete.
-	 */
-	cmm_smp_mb();
-	CMM_STORE_SHARED(timer_signal.qs_done, 0);
-	cmm_smp_mb();
-
-	/*
-	 * Kill with LTTNG_CONSUMER_SIG_TEARDOWN, so signal management thread wakes
-	 * up.
-	 */
-	kill(getpid(), LTTNG_CONSUMER_SIG_TEARDOWN);
-
-	while (!CMM_LOAD_SHARED(timer_signal.qs_done)) {
-		caa_cpu_relax();
-	}
-	cmm_smp_mb();
-
-	pthread_mutex_unlock(&timer_signal.lock);
-}
-
 /*
  * Set the timer for periodical metadata flush.
  */
 void consumer_timer_switch_start(struct lttng_consumer_channel *channel,
 		unsigned int switch_timer_interval)
 {
-	int ret;
-	struct sigevent sev;
-	struct itimerspec its;
-
 	assert(channel);
 	assert(channel->key);
 
@@ -427,43 +788,19 @@ void consumer_timer_switch_start(struct lttng_consumer_channel *channel,
 		return;
 	}
 
-	sev.sigev_notify = SIGEV_SIGNAL;
-	sev.sigev_signo = LTTNG_CONSUMER_SIG_SWITCH;
-	sev.sigev_value.sival_ptr = channel;
-	ret = timer_create(CLOCKID, &sev, &channel->switch_timer);
-	if (ret == -1) {
-		PERROR("timer_create");
-	}
+	timer_wheel_start(&channel->switch_timer, channel,
+			CONSUMER_TIMER_SWITCH, switch_timer_interval);
 	channel->switch_timer_enabled = 1;
-
-	its.it_value.tv_sec = switch_timer_interval / 1000000;
-	its.it_value.tv_nsec = (switch_timer_interval % 1000000) * 1000;
-	its.it_interval.tv_sec = its.it_value.tv_sec;
-	its.it_interval.tv_nsec = its.it_value.tv_nsec;
-
-	ret = timer_settime(channel->switch_timer, 0, &its, NULL);
-	if (ret == -1) {
-		PERROR("timer_settime");
-	}
 }
 
 /*
- * Stop and delete timer.
+ * Stop the switch timer. Its callback is not running on return.
  */
 void consumer_timer_switch_stop(struct lttng_consumer_channel *channel)
 {
-	int ret;
-
 	assert(channel);
 
-	ret = timer_delete(channel->switch_timer);
-	if (ret == -1) {
-		PERROR("timer_delete");
-	}
-
-	consumer_timer_signal_thread_qs(LTTNG_CONSUMER_SIG_SWITCH);
-
-	channel->switch_timer = 0;
+	timer_wheel_stop(&channel->switch_timer);
 	channel->switch_timer_enabled = 0;
 }
 
@@ -473,10 +810,6 @@ void consumer_timer_switch_stop(struct lttng_consumer_channel *channel)
 void consumer_timer_live_start(struct lttng_consumer_channel *channel,
 		int live_timer_interval)
 {
-	int ret;
-	struct sigevent sev;
-	struct itimerspec its;
-
 	assert(channel);
 	assert(channel->key);
 
@@ -484,75 +817,110 @@ void consumer_timer_live_start(struct lttng_consumer_channel *channel,
 		return;
 	}
 
-	sev.sigev_notify = SIGEV_SIGNAL;
-	sev.sigev_signo = LTTNG_CONSUMER_SIG_LIVE;
-	sev.sigev_value.sival_ptr = channel;
-	ret = timer_create(CLOCKID, &sev, &channel->live_timer);
-	if (ret == -1) {
-		PERROR("timer_create");
-	}
+	timer_wheel_start(&channel->live_timer, channel,
+			CONSUMER_TIMER_LIVE, live_timer_interval);
 	channel->live_timer_enabled = 1;
+}
 
-	its.it_value.tv_sec = live_timer_interval / 1000000;
-	its.it_value.tv_nsec = (live_timer_interval % 1000000) * 1000;
-	its.it_interval.tv_sec = its.it_value.tv_sec;
-	its.it_interval.tv_nsec = its.it_value.tv_nsec;
+/*
+ * Stop the live timer. Its callback is not running on return.
+ */
+void consumer_timer_live_stop(struct lttng_consumer_channel *channel)
+{
+	assert(channel);
 
-	ret = timer_settime(channel->live_timer, 0, &its, NULL);
-	if (ret == -1) {
-		PERROR("timer_settime");
-	}
+	timer_wheel_stop(&channel->live_timer);
+	channel->live_timer_enabled = 0;
 }
 
 /*
- * Stop and delete timer.
+ * Create the timer wheel. It must be called from the consumer main before
+ * creating the threads.
  */
-void consumer_timer_live_stop(struct lttng_consumer_channel *channel)
+int consumer_timer_init(void)
 {
-	int ret;
+	unsigned int level, i;
 
-	assert(channel);
+	for (level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+		for (i = 0; i < TIMER_WHEEL_SLOTS; i++) {
+			CDS_INIT_LIST_HEAD(&timer_wheel.slots[level][i]);
+		}
+	}
 
-	ret = timer_delete(channel->live_timer);
-	if (ret == -1) {
-		PERROR("timer_delete");
+	timer_wheel.timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+	if (timer_wheel.timerfd < 0) {
+		PERROR("timerfd_create");
+		goto error;
 	}
 
-	consumer_timer_signal_thread_qs(LTTNG_CONSUMER_SIG_LIVE);
+	timer_wheel.wakeup_pipe = lttng_pipe_open(FD_CLOEXEC);
+	if (!timer_wheel.wakeup_pipe) {
+		goto error_pipe;
+	}
 
-	channel->live_timer = 0;
-	channel->live_timer_enabled = 0;
+	timer_wheel.clock = timer_wheel_now();
+	return 0;
+
+error_pipe:
+	if (close(timer_wheel.timerfd)) {
+		PERROR("close timerfd");
+	}
+	timer_wheel.timerfd = -1;
+error:
+	return -1;
 }
 
 /*
- * Block the RT signals for the entire process. It must be called from the
- * consumer main before creating the threads
+ * Execute the callbacks of the expired timers and requeue them. Wheel lock
+ * must be held; it is released while a callback executes.
  */
-int consumer_signal_init(void)
+static void timer_wheel_run(struct lttng_consumer_local_data *ctx,
+		struct cds_list_head *expired)
 {
-	int ret;
-	sigset_t mask;
+	while (!cds_list_empty(expired)) {
+		struct consumer_timer *timer;
+
+		timer = cds_list_first_entry(expired, struct consumer_timer,
+				node);
+		cds_list_del_init(&timer->node);
+		timer_wheel.running = timer;
+		pthread_mutex_unlock(&timer_wheel.lock);
+
+		health_code_update();
+
+		switch (timer->type) {
+		case CONSUMER_TIMER_SWITCH:
+			metadata_switch_timer(ctx, timer->channel);
+			break;
+		case CONSUMER_TIMER_LIVE:
+			live_timer(ctx, timer->channel);
+			break;
+		}
 
-	/* Block signal for entire process, so only our thread processes it. */
-	setmask(&mask);
-	ret = pthread_sigmask(SIG_BLOCK, &mask, NULL);
-	if (ret) {
-		errno = ret;
-		PERROR("pthread_sigmask");
-		return -1;
+		pthread_mutex_lock(&timer_wheel.lock);
+		timer_wheel.running = NULL;
+		pthread_cond_broadcast(&timer_wheel.cond);
+		if (timer->armed) {
+			timer->expiry += timer->period;
+			if (timer->expiry < timer_wheel.clock) {
+				/* Skip the periods missed. */
+				timer->expiry += ((timer_wheel.clock - timer->expiry) /
+						timer->period + 1) * timer->period;
+			}
+			timer_wheel_queue(timer);
+		}
 	}
-	return 0;
 }
 
 /*
- * This thread is the sighandler for signals LTTNG_CONSUMER_SIG_SWITCH,
- * LTTNG_CONSUMER_SIG_TEARDOWN and LTTNG_CONSUMER_SIG_LIVE.
+ * This thread handles the expiration of the timers of the wheel: the UST
+ * periodical metadata flush (switch timer) and the live timer.
  */
 void *consumer_timer_thread(void *data)
 {
-	int signr;
-	sigset_t mask;
-	siginfo_t info;
+	int ret;
+	uint32_t revents, nb_fd, i;
+	struct lttng_poll_event events;
 	struct lttng_consumer_local_data *ctx = data;
 
 	rcu_register_thread();
@@ -565,37 +933,85 @@ void *consumer_timer_thread(void *data)
 
 	health_code_update();
 
-	/* Only self thread will receive signal mask. */
-	setmask(&mask);
-	CMM_STORE_SHARED(timer_signal.tid, pthread_self());
+	ret = lttng_poll_create(&events, 2, LTTNG_CLOEXEC);
+	if (ret < 0) {
+		goto error_testpoint;
+	}
+	ret = lttng_poll_add(&events, timer_wheel.timerfd, LPOLLIN);
+	if (ret < 0) {
+		goto error_poll;
+	}
+	ret = lttng_poll_add(&events,
+			lttng_pipe_get_readfd(timer_wheel.wakeup_pipe), LPOLLIN);
+	if (ret < 0) {
+		goto error_poll;
+	}
+
+	pthread_mutex_lock(&timer_wheel.lock);
+	timer_wheel.tid = pthread_self();
+	timer_wheel.tid_set = 1;
+	pthread_mutex_unlock(&timer_wheel.lock);
 
 	while (1) {
+		CDS_LIST_HEAD(expired);
+
 		health_code_update();
 
+		pthread_mutex_lock(&timer_wheel.lock);
+		timer_wheel_collect(timer_wheel_now(), &expired);
+		timer_wheel_run(ctx, &expired);
+		timer_wheel_arm();
+		pthread_mutex_unlock(&timer_wheel.lock);
+
 		health_poll_entry();
-		signr = sigwaitinfo(&mask, &info);
+		ret = lttng_poll_wait(&events, -1);
 		health_poll_exit();
-		if (signr == -1) {
+		if (ret < 0) {
 			if (errno != EINTR) {
-				PERROR("sigwaitinfo");
+				PERROR("timer wheel poll");
 			}
 			continue;
-		} else if (signr == LTTNG_CONSUMER_SIG_SWITCH) {
-			metadata_switch_timer(ctx, info.si_signo, &info, NULL);
-		} else if (signr == LTTNG_CONSUMER_SIG_TEARDOWN) {
-			cmm_smp_mb();
-			CMM_STORE_SHARED(timer_signal.qs_done, 1);
-			cmm_smp_mb();
-			DBG("Signal timer metadata thread teardown");
-		} else if (signr == LTTNG_CONSUMER_SIG_LIVE) {
-			live_timer(ctx, info.si_signo, &info, NULL);
-		} else {
-			ERR("Unexpected signal %d\n", info.si_signo);
+		}
+
+		nb_fd = ret;
+		for (i = 0; i < nb_fd; i++) {
+			int pollfd = LTTNG_POLL_GETFD(&events, i);
+			ssize_t size_ret;
+
+			revents = LTTNG_POLL_GETEV(&events, i);
+			if (!(revents & LPOLLIN)) {
+				continue;
+			}
+			if (pollfd == timer_wheel.timerfd) {
+				uint64_t expirations;
+
+				size_ret = lttng_read(pollfd, &expirations,
+						sizeof(expirations));
+				if (size_ret < 0 && errno != EAGAIN) {
+					PERROR("read timerfd");
+				}
+				pthread_mutex_lock(&timer_wheel.lock);
+				timer_wheel.armed_tick = -1ULL;
+				pthread_mutex_unlock(&timer_wheel.lock);
+			} else {
+				char dummy;
+
+				pthread_mutex_lock(&timer_wheel.lock);
+				size_ret = lttng_pipe_read(timer_wheel.wakeup_pipe,
+						&dummy, sizeof(dummy));
+				if (size_ret != sizeof(dummy)) {
+					PERROR("read timer wheel wakeup pipe");
+				}
+				timer_wheel.wakeup_pending = 0;
+				pthread_mutex_unlock(&timer_wheel.lock);
+			}
 		}
 	}
 
+error_poll:
+	lttng_poll_clean(&events);
 error_testpoint:
-	/* Only reached in testpoint error */
+	/* Only reached on error */
 	health_error();
 	health_unregister(health_consumerd);
 
@@ -50,7 +50,6 @@
 
 struct lttng_consumer_global_data consumer_data = {
 	.stream_count = 0,
-	.need_update = 1,
 	.type = LTTNG_CONSUMER_UNKNOWN,
 };
 
@@ -96,6 +95,20 @@ static void notify_thread_lttng_pipe(struct lttng_pipe *pipe)
 	(void) lttng_pipe_write(pipe, &null_stream, sizeof(null_stream));
 }
 
+/*
+ * Notify every data stream poll thread to poll back again.
+ */
+static void notify_data_threads(struct lttng_consumer_local_data *ctx)
+{
+	unsigned int i;
+
+	assert(ctx);
+
+	for (i = 0; i < ctx->nb_data_threads; i++) {
+		notify_thread_lttng_pipe(ctx->data_threads[i].data_pipe);
+	}
+}
+
 static void notify_health_quit_pipe(int *pipe)
 {
 	ssize_t ret;
@@ -317,6 +330,11 @@ static void free_relayd_rcu(struct rcu_head *head)
 	 * there is no one referencing to this relayd object.
 	 */
 	(void) relayd_close(&relayd->control_sock);
+	/* The data of sends in progress is not kept anymore, drop them. */
+	if (relayd->data_sock_zerocopy.nb_completed !=
+			relayd->data_sock_zerocopy.nb_sent) {
+		relayd_zerocopy_abort(&relayd->data_sock);
+	}
 	(void) relayd_close(&relayd->data_sock);
 
 	free(relayd);
@@ -485,7 +503,7 @@ static void cleanup_relayd(struct consumer_relayd_sock_pair *relayd,
 	 * read of this status which happens AFTER receiving this notify.
 	 */
 	if (ctx) {
-		notify_thread_lttng_pipe(ctx->consumer_data_pipe);
+		notify_data_threads(ctx);
 		notify_thread_lttng_pipe(ctx->consumer_metadata_pipe);
 	}
 }
@@ -571,6 +589,9 @@ struct lttng_consumer_stream *consumer_allocate_stream(uint64_t channel_key,
 	stream->monitor = monitor;
 	stream->endpoint_status = CONSUMER_ENDPOINT_ACTIVE;
 	stream->index_fd = -1;
+	stream->cpu = cpu;
+	CDS_INIT_LIST_HEAD(&stream->retry_node);
+	CDS_INIT_LIST_HEAD(&stream->zerocopy_node);
 	pthread_mutex_init(&stream->lock, NULL);
 	pthread_mutex_init(&stream->metadata_timer_lock, NULL);
 
@@ -620,13 +641,46 @@ end:
 }
 
 /*
- * Add a stream to the global list protected by a mutex.
+ * Select the data thread that will own the given stream. Streams are sharded
+ * on their CPU number so the buffers of a given CPU are always consumed by the
+ * same thread. Streams with no known CPU go to the least loaded thread.
+ *
+ * Called with consumer_data.lock held.
+ */
+static struct lttng_consumer_data_thread *select_data_thread(
+		struct lttng_consumer_local_data *ctx,
+		struct lttng_consumer_stream *stream)
+{
+	unsigned int i;
+	struct lttng_consumer_data_thread *thread;
+
+	assert(ctx->nb_data_threads > 0);
+
+	if (stream->cpu >= 0) {
+		return &ctx->data_threads[stream->cpu % ctx->nb_data_threads];
+	}
+
+	thread = &ctx->data_threads[0];
+	for (i = 1; i < ctx->nb_data_threads; i++) {
+		if (ctx->data_threads[i].stream_count < thread->stream_count) {
+			thread = &ctx->data_threads[i];
+		}
+	}
+	return thread;
+}
+
+/*
+ * Add a stream to the global list protected by a mutex and assign it to the
+ * data thread that will consume it. The caller must then send the stream to
+ * that thread through its data pipe.
  */
-int consumer_add_data_stream(struct lttng_consumer_stream *stream)
+int consumer_add_data_stream(struct lttng_consumer_local_data *ctx,
+		struct lttng_consumer_stream *stream)
 {
 	struct lttng_ht *ht = data_ht;
 	int ret = 0;
 
+	assert(ctx);
 	assert(stream);
 	assert(ht);
 
@@ -668,7 +722,11 @@ int consumer_add_data_stream(struct lttng_consumer_stream *stream)
 
 	/* Update consumer data once the node is inserted. */
 	consumer_data.stream_count++;
-	consumer_data.need_update = 1;
+	stream->data_thread = select_data_thread(ctx, stream);
+	stream->data_thread->stream_count++;
+
+	DBG3("Stream %" PRIu64 " (cpu %d) assigned to data thread %u",
+			stream->key, stream->cpu, stream->data_thread->id);
 
 	rcu_read_unlock();
 	pthread_mutex_unlock(&stream->lock);
@@ -734,6 +792,7 @@ static struct consumer_relayd_sock_pair *consumer_allocate_relayd_sock_pair(
 	obj->data_sock.sock.fd = -1;
 	lttng_ht_node_init_u64(&obj->node, obj->net_seq_idx);
 	pthread_mutex_init(&obj->ctrl_sock_mutex, NULL);
+	pthread_mutex_init(&obj->data_sock_mutex, NULL);
 
 error:
 	return obj;
@@ -868,6 +927,32 @@ void close_relayd_stream(struct lttng_consumer_stream *stream)
 	rcu_read_unlock();
 }
 
+/*
+ * Set the data header sent to the relayd before a packet of the given data
+ * stream.
+ */
+static void init_relayd_data_hdr(struct lttng_consumer_stream *stream,
+		size_t data_size, unsigned long padding,
+		struct lttcomm_relayd_data_hdr *data_hdr)
+{
+	/* Reset data header */
+	memset(data_hdr, 0, sizeof(*data_hdr));
+
+	/* Set header with stream information */
+	data_hdr->stream_id = htobe64(stream->relayd_stream_id);
+	data_hdr->data_size = htobe32(data_size);
+	data_hdr->padding_size = htobe32(padding);
+	/*
+	 * Note that net_seq_num below is assigned with the *current* value of
+	 * next_net_seq_num and only after that the next_net_seq_num will be
+	 * increment. This is why when issuing a command on the relayd using
+	 * this next value, 1 should always be substracted in order to compare
+	 * the last seen sequence number on the relayd side to the last sent.
+	 */
+	data_hdr->net_seq_num = htobe64(stream->next_net_seq_num);
+	/* Other fields are zeroed previously */
+}
+
 /*
  * Handle stream for relayd transmission if the stream applies for network
  * streaming where the net sequence index is set.
@@ -885,9 +970,6 @@ static int write_relayd_stream_header(struct lttng_consumer_stream *stream,
 	assert(stream);
 	assert(relayd);
 
-	/* Reset data header */
-	memset(&data_hdr, 0, sizeof(data_hdr));
-
 	if (stream->metadata_flag) {
 		/* Caller MUST acquire the relayd control socket lock */
 		ret = relayd_send_metadata(&relayd->control_sock, data_size);
@@ -898,19 +980,7 @@ static int write_relayd_stream_header(struct lttng_consumer_stream *stream,
 		/* Metadata are always sent on the control socket. */
 		outfd = relayd->control_sock.sock.fd;
 	} else {
-		/* Set header with stream information */
-		data_hdr.stream_id = htobe64(stream->relayd_stream_id);
-		data_hdr.data_size = htobe32(data_size);
-		data_hdr.padding_size = htobe32(padding);
-		/*
-		 * Note that net_seq_num below is assigned with the *current* value of
-		 * next_net_seq_num and only after that the next_net_seq_num will be
-		 * increment. This is why when issuing a command on the relayd using
-		 * this next value, 1 should always be substracted in order to compare
-		 * the last seen sequence number on the relayd side to the last sent.
-		 */
-		data_hdr.net_seq_num = htobe64(stream->next_net_seq_num);
-		/* Other fields are zeroed previously */
+		init_relayd_data_hdr(stream, data_size, padding, &data_hdr);
 
 		ret = relayd_send_data_hdr(&relayd->data_sock, &data_hdr,
 				sizeof(data_hdr));
@@ -1060,67 +1130,6 @@ int consumer_add_channel(struct lttng_consumer_channel *channel,
 	return 0;
 }
 
-/*
- * Allocate the pollfd structure and the local view of the out fds to avoid
- * doing a lookup in the linked list and concurrency issues when writing is
- * needed. Called with consumer_data.lock held.
- *
- * Returns the number of fds in the structures.
- */
-static int update_poll_array(struct lttng_consumer_local_data *ctx,
-		struct pollfd **pollfd, struct lttng_consumer_stream **local_stream,
-		struct lttng_ht *ht)
-{
-	int i = 0;
-	struct lttng_ht_iter iter;
-	struct lttng_consumer_stream *stream;
-
-	assert(ctx);
-	assert(ht);
-	assert(pollfd);
-	assert(local_stream);
-
-	DBG("Updating poll fd array");
-	rcu_read_lock();
-	cds_lfht_for_each_entry(ht->ht, &iter.iter, stream, node.node) {
-		/*
-		 * Only active streams with an active end point can be added to the
-		 * poll set and local stream storage of the thread.
-		 *
-		 * There is a potential race here for endpoint_status to be updated
-		 * just after the check. However, this is OK since the stream(s) will
-		 * be deleted once the thread is notified that the end point state has
-		 * changed where this function will be called back again.
-		 */
-		if (stream->state != LTTNG_CONSUMER_ACTIVE_STREAM ||
-				stream->endpoint_status == CONSUMER_ENDPOINT_INACTIVE) {
-			continue;
-		}
-		/*
-		 * This clobbers way too much the debug output. Uncomment that if you
-		 * need it for debugging purposes.
-		 *
-		 * DBG("Active FD %d", stream->wait_fd);
-		 */
-		(*pollfd)[i].fd = stream->wait_fd;
-		(*pollfd)[i].events = POLLIN | POLLPRI;
-		local_stream[i] = stream;
-		i++;
-	}
-	rcu_read_unlock();
-
-	/*
-	 * Insert the consumer_data_pipe at the end of the array and don't
-	 * increment i so nb_fd is the number of real FD.
-	 */
-	(*pollfd)[i].fd = lttng_pipe_get_readfd(ctx->consumer_data_pipe);
-	(*pollfd)[i].events = POLLIN | POLLPRI;
-
-	(*pollfd)[i + 1].fd = lttng_pipe_get_readfd(ctx->consumer_wakeup_pipe);
-	(*pollfd)[i + 1].events = POLLIN | POLLPRI;
-	return i;
-}
-
 /*
  * Poll on the should_quit pipe and the command socket return -1 on
  * error, 1 if should exit, 0 if data is available on the command socket
@@ -1228,22 +1237,48 @@ void lttng_consumer_should_exit(struct lttng_consumer_local_data *ctx)
 	DBG("Consumer flag that it should quit");
 }
 
-void lttng_consumer_sync_trace_file(struct lttng_consumer_stream *stream,
-		off_t orig_offset)
+/*
+ * Called after trace data is written to the output file of a stream. The data
+ * is handed to writeback in batches of at least
+ * DEFAULT_CONSUMERD_WRITEBACK_BATCH_SIZE bytes (or a sub-buffer if larger) so
+ * small sub-buffers don't cost three syscalls each, one of them blocking.
+ */
+void lttng_consumer_sync_trace_file(struct lttng_consumer_stream *stream)
 {
 	int outfd = stream->out_fd;
+	off_t prev_offset = stream->writeback_prev_offset;
+	off_t offset = stream->writeback_offset;
+	off_t batch_size;
+
+	/* Nothing to do for network streaming. */
+	if (stream->net_seq_idx != (uint64_t) -1ULL || outfd < 0) {
+		return;
+	}
+
+	batch_size = max_t(off_t, stream->max_sb_size,
+			DEFAULT_CONSUMERD_WRITEBACK_BATCH_SIZE);
+	if (stream->out_fd_offset - offset < batch_size) {
+		return;
+	}
+
+	/* This won't block, but will start writeout asynchronously */
+	lttng_sync_file_range(outfd, offset, stream->out_fd_offset - offset,
+			SYNC_FILE_RANGE_WRITE);
+	stream->writeback_prev_offset = offset;
+	stream->writeback_offset = stream->out_fd_offset;
+
+	if (offset == prev_offset) {
+		/* First batch of the file. */
+		return;
+	}
 
 	/*
 	 * This does a blocking write-and-wait on any page that belongs to the
-	 * subbuffer prior to the one we just wrote.
+	 * batch prior to the one we just started writing back.
 	 * Don't care about error values, as these are just hints and ways to
 	 * limit the amount of page cache used.
 	 */
-	if (orig_offset < stream->max_sb_size) {
-		return;
-	}
-	lttng_sync_file_range(outfd, orig_offset - stream->max_sb_size,
-			stream->max_sb_size,
+	lttng_sync_file_range(outfd, prev_offset, offset - prev_offset,
 			SYNC_FILE_RANGE_WAIT_BEFORE
 			| SYNC_FILE_RANGE_WRITE
 			| SYNC_FILE_RANGE_WAIT_AFTER);
@@ -1261,8 +1296,40 @@ void lttng_consumer_sync_trace_file(struct lttng_consumer_stream *stream,
 	 * defined. So it can be expected to lead to lower throughput in
 	 * streaming.
 	 */
-	posix_fadvise(outfd, orig_offset - stream->max_sb_size,
-			stream->max_sb_size, POSIX_FADV_DONTNEED);
+	posix_fadvise(outfd, prev_offset, offset - prev_offset,
+			POSIX_FADV_DONTNEED);
+}
+
+/*
+ * Write back the data of the output file of a stream not yet waited for by
+ * lttng_consumer_sync_trace_file(), including the last partial batch. Called
+ * before the output file is closed or rotated so its last batches don't stay
+ * in the page cache.
+ */
+void lttng_consumer_flush_trace_file(struct lttng_consumer_stream *stream)
+{
+	int outfd = stream->out_fd;
+	off_t prev_offset = stream->writeback_prev_offset;
+
+	/* Nothing to do for network streaming. */
+	if (stream->net_seq_idx != (uint64_t) -1ULL || outfd < 0) {
+		return;
+	}
+
+	if (stream->out_fd_offset == prev_offset) {
+		return;
+	}
+
+	/* See lttng_consumer_sync_trace_file(). */
+	lttng_sync_file_range(outfd, prev_offset,
+			stream->out_fd_offset - prev_offset,
+			SYNC_FILE_RANGE_WAIT_BEFORE
+			| SYNC_FILE_RANGE_WRITE
+			| SYNC_FILE_RANGE_WAIT_AFTER);
+	posix_fadvise(outfd, prev_offset, stream->out_fd_offset - prev_offset,
+			POSIX_FADV_DONTNEED);
+	stream->writeback_prev_offset = stream->out_fd_offset;
+	stream->writeback_offset = stream->out_fd_offset;
 }
 
 /*
@@ -1302,6 +1369,7 @@ struct lttng_consumer_local_data *lttng_consumer_create(
 
 	ctx->consumer_error_socket = -1;
 	ctx->consumer_metadata_socket = -1;
+	ctx->nb_snapshot_threads = DEFAULT_CONSUMERD_SNAPSHOT_THREADS;
 	pthread_mutex_init(&ctx->metadata_socket_lock, NULL);
 	/* assign the callbacks */
 	ctx->on_buffer_ready = buffer_ready;
@@ -1309,16 +1377,6 @@ struct lttng_consumer_local_data *lttng_consumer_create(
 	ctx->on_recv_stream = recv_stream;
 	ctx->on_update_stream = update_stream;
 
-	ctx->consumer_data_pipe = lttng_pipe_open(0);
-	if (!ctx->consumer_data_pipe) {
-		goto error_poll_pipe;
-	}
-
-	ctx->consumer_wakeup_pipe = lttng_pipe_open(0);
-	if (!ctx->consumer_wakeup_pipe) {
-		goto error_wakeup_pipe;
-	}
-
 	ret = pipe(ctx->consumer_should_quit);
 	if (ret < 0) {
 		PERROR("Error creating recv pipe");
@@ -1343,15 +1401,68 @@ error_metadata_pipe:
 error_channel_pipe:
 	utils_close_pipe(ctx->consumer_should_quit);
 error_quit_pipe:
-	lttng_pipe_destroy(ctx->consumer_wakeup_pipe);
-error_wakeup_pipe:
-	lttng_pipe_destroy(ctx->consumer_data_pipe);
-error_poll_pipe:
 	free(ctx);
 error:
 	return NULL;
 }
 
+/*
+ * Allocate the data stream poll threads' state of the given context. The
+ * threads themselves are launched by the caller using
+ * consumer_thread_data_poll() with each element of ctx->data_threads as
+ * argument.
+ *
+ * Return 0 on success else a negative value.
+ */
+int lttng_consumer_init_data_threads(struct lttng_consumer_local_data *ctx,
+		unsigned int nb_threads)
+{
+	unsigned int i;
+
+	assert(ctx);
+	assert(!ctx->data_threads);
+
+	if (nb_threads == 0) {
+		nb_threads = 1;
+	}
+
+	ctx->data_threads = zmalloc(nb_threads * sizeof(*ctx->data_threads));
+	if (!ctx->data_threads) {
+		PERROR("zmalloc data threads");
+		goto error;
+	}
+
+	for (i = 0; i < nb_threads; i++) {
+		struct lttng_consumer_data_thread *thread = &ctx->data_threads[i];
+
+		thread->id = i;
+		thread->ctx = ctx;
+		thread->data_pipe = lttng_pipe_open(0);
+		if (!thread->data_pipe) {
+			goto error_pipe;
+		}
+		thread->wakeup_pipe = lttng_pipe_open(0);
+		if (!thread->wakeup_pipe) {
+			lttng_pipe_destroy(thread->data_pipe);
+			goto error_pipe;
+		}
+	}
+	ctx->nb_data_threads = nb_threads;
+
+	DBG("Consumer using %u data thread(s)", nb_threads);
+	return 0;
+
+error_pipe:
+	while (i-- > 0) {
+		lttng_pipe_destroy(ctx->data_threads[i].data_pipe);
+		lttng_pipe_destroy(ctx->data_threads[i].wakeup_pipe);
+	}
+	free(ctx->data_threads);
+	ctx->data_threads = NULL;
+error:
+	return -1;
+}
+
 /*
  * Iterate over all streams of the hashtable and free them properly.
  */
@@ -1409,6 +1520,7 @@ static void destroy_metadata_stream_ht(struct lttng_ht *ht)
 void lttng_consumer_destroy(struct lttng_consumer_local_data *ctx)
 {
 	int ret;
+	unsigned int i;
 
 	DBG("Consumer destroying it. Closing everything.");
 
@@ -1428,9 +1540,12 @@ void lttng_consumer_destroy(struct lttng_consumer_local_data *ctx)
 		PERROR("close");
 	}
 	utils_close_pipe(ctx->consumer_channel_pipe);
-	lttng_pipe_destroy(ctx->consumer_data_pipe);
+	for (i = 0; i < ctx->nb_data_threads; i++) {
+		lttng_pipe_destroy(ctx->data_threads[i].data_pipe);
+		lttng_pipe_destroy(ctx->data_threads[i].wakeup_pipe);
+	}
+	free(ctx->data_threads);
 	lttng_pipe_destroy(ctx->consumer_metadata_pipe);
-	lttng_pipe_destroy(ctx->consumer_wakeup_pipe);
 	utils_close_pipe(ctx->consumer_should_quit);
 
 	unlink(ctx->consumer_command_sock_path);
@@ -1478,7 +1593,8 @@ end:
 /*
  * Mmap the ring buffer, read it and write the data to the tracefile. This is a
  * core function for writing trace buffers to either the local filesystem or
- * the network.
+ * the network. mmap_offset is the offset of the sub-buffer held by the stream
+ * inside its mmap area, as returned by the tracer.
  *
  * It must be called with the stream lock held.
  *
@@ -1489,13 +1605,11 @@ end:
 ssize_t lttng_consumer_on_read_subbuffer_mmap(
 		struct lttng_consumer_local_data *ctx,
 		struct lttng_consumer_stream *stream, unsigned long len,
-		unsigned long padding,
+		unsigned long padding, unsigned long mmap_offset,
 		struct ctf_packet_index *index)
 {
-	unsigned long mmap_offset;
 	void *mmap_base;
 	ssize_t ret = 0;
-	off_t orig_offset = stream->out_fd_offset;
 	/* Default is on the disk */
 	int outfd = stream->out_fd;
 	struct consumer_relayd_sock_pair *relayd = NULL;
@@ -1504,25 +1618,10 @@ ssize_t lttng_consumer_on_read_subbuffer_mmap(
 	/* RCU lock for the relayd pointer */
 	rcu_read_lock();
 
-	/* Flag that the current stream if set for network streaming. */
-	if (stream->net_seq_idx != (uint64_t) -1ULL) {
-		relayd = consumer_find_relayd(stream->net_seq_idx);
-		if (relayd == NULL) {
-			ret = -EPIPE;
-			goto end;
-		}
-	}
-
-	/* get the offset inside the fd to mmap */
+	/* The caller gives the offset of the sub-buffer inside the mmap area. */
 	switch (consumer_data.type) {
 	case LTTNG_CONSUMER_KERNEL:
 		mmap_base = stream->mmap_base;
-		ret = kernctl_get_mmap_read_offset(stream->wait_fd, &mmap_offset);
-		if (ret < 0) {
-			ret = -errno;
-			PERROR("tracer ctl get_mmap_read_offset");
-			goto end;
-		}
 		break;
 	case LTTNG_CONSUMER32_UST:
 	case LTTNG_CONSUMER64_UST:
@@ -1532,47 +1631,59 @@ ssize_t lttng_consumer_on_read_subbuffer_mmap(
 			ret = -EPERM;
 			goto end;
 		}
-		ret = lttng_ustctl_get_mmap_read_offset(stream, &mmap_offset);
-		if (ret != 0) {
-			PERROR("tracer ctl get_mmap_read_offset");
-			ret = -EINVAL;
-			goto end;
-		}
 		break;
 	default:
 		ERR("Unknown consumer_data type");
 		assert(0);
 	}
 
+	/* Flag that the current stream if set for network streaming. */
+	if (stream->net_seq_idx != (uint64_t) -1ULL) {
+		relayd = consumer_find_relayd(stream->net_seq_idx);
+		if (relayd == NULL) {
+			ret = -EPIPE;
+			goto end;
+		}
+	}
+
 	/* Handle stream on the relayd if the output is on the network */
 	if (relayd) {
 		unsigned long netlen = len;
 
 		/*
-		 * Lock the control socket for the complete duration of the function
-		 * since from this point on we will use the socket.
+		 * Lock the control or data socket for the complete duration of the
+		 * function since from this point on we will use the socket.
 		 */
 		if (stream->metadata_flag) {
 			/* Metadata requires the control socket. */
 			pthread_mutex_lock(&relayd->ctrl_sock_mutex);
 			netlen += sizeof(struct lttcomm_relayd_metadata_payload);
-		}
 
-		ret = write_relayd_stream_header(stream, netlen, padding, relayd);
-		if (ret < 0) {
-			relayd_hang_up = 1;
-			goto write_error;
-		}
-		/* Use the returned socket. */
-		outfd = ret;
+			ret = write_relayd_stream_header(stream, netlen, padding, relayd);
+			if (ret < 0) {
+				relayd_hang_up = 1;
+				goto write_error;
+			}
+			/* Use the returned socket. */
+			outfd = ret;
 
-		/* Write metadata stream id before payload */
-		if (stream->metadata_flag) {
+			/* Write metadata stream id before payload */
 			ret = write_relayd_metadata_id(outfd, stream, relayd, padding);
 			if (ret < 0) {
 				relayd_hang_up = 1;
 				goto write_error;
 			}
+		} else {
+			/* Other data threads may be sending on the data socket. */
+			pthread_mutex_lock(&relayd->data_sock_mutex);
+
+			/*
+			 * The header is sent with the payload below in a single
+			 * sendmsg() call.
+			 */
+			init_relayd_data_hdr(stream, netlen, padding,
+					&stream->relayd_data_hdr);
+			outfd = relayd->data_sock.sock.fd;
 		}
 	} else {
 		/* No streaming, we have to set the len with the full padding */
@@ -1584,6 +1695,7 @@ ssize_t lttng_consumer_on_read_subbuffer_mmap(
 		if (stream->chan->tracefile_size > 0 &&
 				(stream->tracefile_size_current + len) >
 				stream->chan->tracefile_size) {
+			lttng_consumer_flush_trace_file(stream);
 			ret = utils_rotate_stream_file(stream->chan->pathname,
 					stream->name, stream->chan->tracefile_size,
 					stream->chan->tracefile_count, stream->uid, stream->gid,
@@ -1596,6 +1708,10 @@ ssize_t lttng_consumer_on_read_subbuffer_mmap(
 			outfd = stream->out_fd;
 
 			if (stream->index_fd >= 0) {
+				ret = consumer_stream_flush_index(stream);
+				if (ret < 0) {
+					goto end;
+				}
 				ret = close(stream->index_fd);
 				if (ret < 0) {
 					PERROR("Closing index");
@@ -1615,7 +1731,8 @@ ssize_t lttng_consumer_on_read_subbuffer_mmap(
 			/* Reset current size because we just perform a rotation. */
 			stream->tracefile_size_current = 0;
 			stream->out_fd_offset = 0;
-			orig_offset = 0;
+			stream->writeback_offset = 0;
+			stream->writeback_prev_offset = 0;
 		}
 		stream->tracefile_size_current += len;
 		if (index) {
@@ -1627,7 +1744,27 @@ ssize_t lttng_consumer_on_read_subbuffer_mmap(
 	 * This call guarantee that len or less is returned. It's impossible to
 	 * receive a ret value that is bigger than len.
 	 */
-	ret = lttng_write(outfd, mmap_base + mmap_offset, len);
+	if (relayd && !stream->metadata_flag) {
+		/*
+		 * Only the data threads defer the release of the sub-buffer, a
+		 * snapshot puts it back right away so its data is copied.
+		 */
+		struct relayd_zerocopy *zerocopy = stream->monitor ?
+				&relayd->data_sock_zerocopy : NULL;
+		uint32_t nb_sent = relayd->data_sock_zerocopy.nb_sent;
+
+		ret = relayd_send_data(&relayd->data_sock, &stream->relayd_data_hdr,
+				mmap_base + mmap_offset, len, zerocopy);
+		if (ret >= 0) {
+			++stream->next_net_seq_num;
+		}
+		if (relayd->data_sock_zerocopy.nb_sent != nb_sent) {
+			stream->zerocopy_pending = 1;
+			stream->zerocopy_seq = relayd->data_sock_zerocopy.nb_sent;
+		}
+	} else {
+		ret = lttng_write(outfd, mmap_base + mmap_offset, len);
+	}
 	DBG("Consumer mmap write() ret %zd (len %lu)", ret, len);
 	if (ret < 0 || ((size_t) ret != len)) {
 		/*
@@ -1656,14 +1793,10 @@ ssize_t lttng_consumer_on_read_subbuffer_mmap(
 	}
 	stream->output_written += ret;
 
-	/* This call is useless on a socket so better save a syscall. */
 	if (!relayd) {
-		/* This won't block, but will start writeout asynchronously */
-		lttng_sync_file_range(outfd, stream->out_fd_offset, len,
-				SYNC_FILE_RANGE_WRITE);
 		stream->out_fd_offset += len;
 	}
-	lttng_consumer_sync_trace_file(stream, orig_offset);
+	lttng_consumer_sync_trace_file(stream);
 
 write_error:
 	/*
@@ -1675,9 +1808,12 @@ write_error:
 	}
 
 end:
-	/* Unlock only if ctrl socket used */
-	if (relayd && stream->metadata_flag) {
-		pthread_mutex_unlock(&relayd->ctrl_sock_mutex);
+	if (relayd) {
+		if (stream->metadata_flag) {
+			pthread_mutex_unlock(&relayd->ctrl_sock_mutex);
+		} else {
+			pthread_mutex_unlock(&relayd->data_sock_mutex);
+		}
 	}
 
 	rcu_read_unlock();
@@ -1699,7 +1835,6 @@ ssize_t lttng_consumer_on_read_subbuffer_splice(
 {
 	ssize_t ret = 0, written = 0, ret_splice = 0;
 	loff_t offset = 0;
-	off_t orig_offset = stream->out_fd_offset;
 	int fd = stream->wait_fd;
 	/* Default is on the disk */
 	int outfd = stream->out_fd;
@@ -1736,7 +1871,13 @@ ssize_t lttng_consumer_on_read_subbuffer_splice(
 	if (relayd) {
 		unsigned long total_len = len;
 
-		if (stream->metadata_flag) {
+		if (!stream->metadata_flag) {
+			/*
+			 * Lock the data socket for the complete duration of the function
+			 * since other data threads may be sending on it.
+			 */
+			pthread_mutex_lock(&relayd->data_sock_mutex);
+		} else {
 			/*
 			 * Lock the control socket for the complete duration of the function
 			 * since from this point on we will use the socket.
@@ -1772,6 +1913,7 @@ ssize_t lttng_consumer_on_read_subbuffer_splice(
 		if (stream->chan->tracefile_size > 0 &&
 				(stream->tracefile_size_current + len) >
 				stream->chan->tracefile_size) {
+			lttng_consumer_flush_trace_file(stream);
 			ret = utils_rotate_stream_file(stream->chan->pathname,
 					stream->name, stream->chan->tracefile_size,
 					stream->chan->tracefile_count, stream->uid, stream->gid,
@@ -1785,6 +1927,11 @@ ssize_t lttng_consumer_on_read_subbuffer_splice(
 			outfd = stream->out_fd;
 
 			if (stream->index_fd >= 0) {
+				ret = consumer_stream_flush_index(stream);
+				if (ret < 0) {
+					written = ret;
+					goto end;
+				}
 				ret = close(stream->index_fd);
 				if (ret < 0) {
 					PERROR("Closing index");
@@ -1805,7 +1952,8 @@ ssize_t lttng_consumer_on_read_subbuffer_splice(
 			/* Reset current size because we just perform a rotation. */
 			stream->tracefile_size_current = 0;
 			stream->out_fd_offset = 0;
-			orig_offset = 0;
+			stream->writeback_offset = 0;
+			stream->writeback_prev_offset = 0;
 		}
 		stream->tracefile_size_current += len;
 		index->offset = htobe64(stream->out_fd_offset);
@@ -1864,17 +2012,13 @@ ssize_t lttng_consumer_on_read_subbuffer_splice(
 			len -= ret_splice;
 		}
 
-		/* This call is useless on a socket so better save a syscall. */
 		if (!relayd) {
-			/* This won't block, but will start writeout asynchronously */
-			lttng_sync_file_range(outfd, stream->out_fd_offset, ret_splice,
-					SYNC_FILE_RANGE_WRITE);
 			stream->out_fd_offset += ret_splice;
 		}
 		stream->output_written += ret_splice;
 		written += ret_splice;
 	}
-	lttng_consumer_sync_trace_file(stream, orig_offset);
+	lttng_consumer_sync_trace_file(stream);
 	goto end;
 
 write_error:
@@ -1903,8 +2047,12 @@ splice_error:
 	}
 
 end:
-	if (relayd && stream->metadata_flag) {
-		pthread_mutex_unlock(&relayd->ctrl_sock_mutex);
+	if (relayd) {
+		if (stream->metadata_flag) {
+			pthread_mutex_unlock(&relayd->ctrl_sock_mutex);
+		} else {
+			pthread_mutex_unlock(&relayd->data_sock_mutex);
+		}
 	}
 
 	rcu_read_unlock();
@@ -2118,28 +2266,6 @@ int consumer_add_metadata_stream(struct lttng_consumer_stream *stream)
 	return ret;
 }
 
-/*
- * Delete data stream that are flagged for deletion (endpoint_status).
- */
-static void validate_endpoint_status_data_stream(void)
-{
-	struct lttng_ht_iter iter;
-	struct lttng_consumer_stream *stream;
-
-	DBG("Consumer delete flagged data stream");
-
-	rcu_read_lock();
-	cds_lfht_for_each_entry(data_ht->ht, &iter.iter, stream, node.node) {
-		/* Validate delete flag of the stream */
-		if (stream->endpoint_status == CONSUMER_ENDPOINT_ACTIVE) {
-			continue;
-		}
-		/* Delete it right now */
-		consumer_del_stream(stream, data_ht);
-	}
-	rcu_read_unlock();
-}
-
 /*
  * Delete metadata stream that are flagged for deletion (endpoint_status).
  */
@@ -2391,20 +2517,226 @@ error_testpoint:
 	return NULL;
 }
 
+/*
+ * Add a data stream received on the data pipe to the poll set and to the fd
+ * index of the given data thread.
+ *
+ * Return 0 on success else a negative value.
+ */
+static int data_thread_add_stream(struct lttng_consumer_data_thread *thread,
+		struct lttng_poll_event *pollset, struct lttng_ht *stream_fd_ht,
+		struct lttng_consumer_stream *stream)
+{
+	int ret;
+
+	assert(thread);
+	assert(pollset);
+	assert(stream_fd_ht);
+	assert(stream);
+	assert(stream->data_thread == thread);
+
+	DBG("Data thread %u adding stream %" PRIu64 " (fd %d) to poll set",
+			thread->id, stream->key, stream->wait_fd);
+
+	ret = lttng_poll_add(pollset, stream->wait_fd,
+			LPOLLIN | LPOLLPRI | LPOLLHUP);
+	if (ret < 0) {
+		goto end;
+	}
+
+	lttng_ht_node_init_u64(&stream->node_wait_fd, stream->wait_fd);
+	rcu_read_lock();
+	lttng_ht_add_unique_u64(stream_fd_ht, &stream->node_wait_fd);
+	rcu_read_unlock();
+
+end:
+	return ret;
+}
+
+/*
+ * Remove a data stream from the poll set, the fd index and the retry list of
+ * its data thread and destroy it.
+ */
+static void data_thread_del_stream(struct lttng_poll_event *pollset,
+		struct lttng_ht *stream_fd_ht, struct lttng_consumer_stream *stream)
+{
+	int ret;
+	struct lttng_ht_iter iter;
+
+	assert(pollset);
+	assert(stream_fd_ht);
+	assert(stream);
+
+	/* Must be done before the stream's fd is closed. */
+	lttng_poll_del(pollset, stream->wait_fd);
+
+	rcu_read_lock();
+	iter.iter.node = &stream->node_wait_fd.node;
+	ret = lttng_ht_del(stream_fd_ht, &iter);
+	assert(!ret);
+	rcu_read_unlock();
+
+	cds_list_del_init(&stream->retry_node);
+	cds_list_del_init(&stream->zerocopy_node);
+
+	consumer_del_stream(stream, data_ht);
+}
+
+/*
+ * Delete the data streams of a data thread that are flagged for deletion
+ * (endpoint_status).
+ *
+ * Return the number of deleted streams.
+ */
+static unsigned int validate_endpoint_status_data_stream(
+		struct lttng_poll_event *pollset, struct lttng_ht *stream_fd_ht)
+{
+	unsigned int nb_deleted = 0;
+	struct lttng_ht_iter iter;
+	struct lttng_consumer_stream *stream;
+
+	DBG("Consumer delete flagged data stream");
+
+	assert(pollset);
+	assert(stream_fd_ht);
+
+	rcu_read_lock();
+	cds_lfht_for_each_entry(stream_fd_ht->ht, &iter.iter, stream,
+			node_wait_fd.node) {
+		/* Validate delete flag of the stream */
+		if (stream->endpoint_status == CONSUMER_ENDPOINT_ACTIVE) {
+			continue;
+		}
+		/* Delete it right now */
+		data_thread_del_stream(pollset, stream_fd_ht, stream);
+		nb_deleted++;
+	}
+	rcu_read_unlock();
+
+	return nb_deleted;
+}
+
+/*
+ * Find the stream of the given data thread using the given wait fd.
+ *
+ * RCU read side lock MUST be acquired.
+ */
+static struct lttng_consumer_stream *data_thread_find_stream(
+		struct lttng_ht *stream_fd_ht, int fd)
+{
+	uint64_t key = (uint64_t) fd;
+	struct lttng_ht_iter iter;
+	struct lttng_ht_node_u64 *node;
+
+	lttng_ht_lookup(stream_fd_ht, &key, &iter);
+	node = lttng_ht_iter_get_node_u64(&iter);
+	if (!node) {
+		return NULL;
+	}
+	return caa_container_of(node, struct lttng_consumer_stream,
+			node_wait_fd);
+}
+
+/*
+ * Consume the data of the given stream owned by a data thread. The stream is
+ * added to the retry list if it has more data to be read without a poll event
+ * being raised and to the zero-copy list if it holds a sub-buffer until the
+ * completion of its send to the relayd.
+ *
+ * Return 0 on success or 1 if the stream was deleted.
+ */
+static int data_thread_read_stream(struct lttng_consumer_local_data *ctx,
+		struct lttng_poll_event *pollset, struct lttng_ht *stream_fd_ht,
+		struct lttng_consumer_stream *stream,
+		struct cds_list_head *retry_list,
+		struct cds_list_head *zerocopy_list)
+{
+	ssize_t len;
+
+	len = ctx->on_buffer_ready(stream, ctx);
+	/* it's ok to have an unavailable sub-buffer */
+	if (len < 0 && len != -EAGAIN && len != -ENODATA) {
+		/* Clean the stream and free it. */
+		data_thread_del_stream(pollset, stream_fd_ht, stream);
+		return 1;
+	} else if (len > 0) {
+		stream->data_read = 1;
+	}
+
+	if ((stream->has_data || (stream->hangup_flush_done && len > 0)) &&
+			!stream->zerocopy_pending &&
+			cds_list_empty(&stream->retry_node)) {
+		cds_list_add_tail(&stream->retry_node, retry_list);
+	}
+	if (stream->zerocopy_pending && cds_list_empty(&stream->zerocopy_node)) {
+		cds_list_add_tail(&stream->zerocopy_node, zerocopy_list);
+	}
+	return 0;
+}
+
+/*
+ * Release the sub-buffers held by the streams of a data thread whose zero-copy
+ * send to the relayd is completed. A released stream is read again since its
+ * next sub-buffer may be ready without a poll event being raised.
+ */
+static void data_thread_release_zerocopy(struct cds_list_head *zerocopy_list,
+		struct cds_list_head *retry_list)
+{
+	int ret;
+	struct lttng_consumer_stream *stream, *tmp_stream;
+
+	cds_list_for_each_entry_safe(stream, tmp_stream, zerocopy_list,
+			zerocopy_node) {
+		health_code_update();
+
+		pthread_mutex_lock(&stream->lock);
+		ret = 1;
+		if (stream->zerocopy_pending) {
+			ret = consumer_stream_release_zerocopy(stream, 0);
+		}
+		pthread_mutex_unlock(&stream->lock);
+		if (ret == 0) {
+			continue;
+		}
+
+		cds_list_del_init(&stream->zerocopy_node);
+		if (cds_list_empty(&stream->retry_node)) {
+			cds_list_add_tail(&stream->retry_node, retry_list);
+		}
+	}
+}
+
 /*
  * This thread polls the fds in the set to consume the data and write
- * it to tracefile if necessary.
+ * it to tracefile if necessary. Only the data streams owned by the given
+ * lttng_consumer_data_thread are handled.
+ *
+ * Streams are added to the poll set when received on the thread's data pipe
+ * and removed when deleted so that each wakeup only costs the number of ready
+ * streams. Streams flagged with has_data (see the wakeup pipe) or flushed on
+ * hang up are kept on a retry list and read again without waiting on a poll
+ * event. Streams holding a sub-buffer for a zero-copy send to the relayd are
+ * kept on a zero-copy list until the send completes.
  */
 void *consumer_thread_data_poll(void *data)
 {
-	int num_rdy, num_hup, high_prio, ret, i, err = -1;
-	struct pollfd *pollfd = NULL;
-	/* local view of the streams */
-	struct lttng_consumer_stream **local_stream = NULL, *new_stream = NULL;
-	/* local view of consumer_data.fds_count */
-	int nb_fd = 0;
-	struct lttng_consumer_local_data *ctx = data;
-	ssize_t len;
+	int ret, i, high_prio, err = -1;
+	uint32_t revents, nb_ready;
+	/* Number of streams in the poll set. */
+	unsigned int nb_streams = 0;
+	struct lttng_consumer_stream *stream = NULL, *tmp_stream;
+	struct lttng_poll_event events;
+	/* Owned streams indexed by wait fd. Only used by this thread. */
+	struct lttng_ht *stream_fd_ht = NULL;
+	/* Streams having data to consume without a poll event. */
+	struct cds_list_head retry_list, retry_pass;
+	/* Streams holding a sub-buffer until its zero-copy send completes. */
+	struct cds_list_head zerocopy_list;
+	int timeout;
+	struct lttng_consumer_data_thread *thread = data;
+	struct lttng_consumer_local_data *ctx = thread->ctx;
+	int data_pipe_fd = lttng_pipe_get_readfd(thread->data_pipe);
+	int wakeup_pipe_fd = lttng_pipe_get_readfd(thread->wakeup_pipe);
 
 	rcu_register_thread();
 
@@ -2416,9 +2748,28 @@ void *consumer_thread_data_poll(void *data)
 
 	health_code_update();
 
-	local_stream = zmalloc(sizeof(struct lttng_consumer_stream *));
-	if (local_stream == NULL) {
-		PERROR("local_stream malloc");
+	CDS_INIT_LIST_HEAD(&retry_list);
+	CDS_INIT_LIST_HEAD(&zerocopy_list);
+
+	stream_fd_ht = lttng_ht_new(0, LTTNG_HT_TYPE_U64);
+	if (!stream_fd_ht) {
+		goto end_ht;
+	}
+
+	/* Size is set to 2 for the data and wakeup pipes. */
+	ret = lttng_poll_create(&events, 2, LTTNG_CLOEXEC);
+	if (ret < 0) {
+		ERR("Poll set creation failed");
+		goto end_poll;
+	}
+
+	ret = lttng_poll_add(&events, data_pipe_fd, LPOLLIN | LPOLLPRI);
+	if (ret < 0) {
+		goto end;
+	}
+
+	ret = lttng_poll_add(&events, wakeup_pipe_fd, LPOLLIN | LPOLLPRI);
+	if (ret < 0) {
 		goto end;
 	}
 
@@ -2426,142 +2777,118 @@ void *consumer_thread_data_poll(void *data)
 		health_code_update();
 
 		high_prio = 0;
-		num_hup = 0;
-
-		/*
-		 * the fds set has been updated, we need to update our
-		 * local array as well
-		 */
-		pthread_mutex_lock(&consumer_data.lock);
-		if (consumer_data.need_update) {
-			free(pollfd);
-			pollfd = NULL;
-
-			free(local_stream);
-			local_stream = NULL;
-
-			/*
-			 * Allocate for all fds +1 for the consumer_data_pipe and +1 for
-			 * wake up pipe.
-			 */
-			pollfd = zmalloc((consumer_data.stream_count + 2) * sizeof(struct pollfd));
-			if (pollfd == NULL) {
-				PERROR("pollfd malloc");
-				pthread_mutex_unlock(&consumer_data.lock);
-				goto end;
-			}
-
-			local_stream = zmalloc((consumer_data.stream_count + 2) *
-					sizeof(struct lttng_consumer_stream *));
-			if (local_stream == NULL) {
-				PERROR("local_stream malloc");
-				pthread_mutex_unlock(&consumer_data.lock);
-				goto end;
-			}
-			ret = update_poll_array(ctx, &pollfd, local_stream,
-					data_ht);
-			if (ret < 0) {
-				ERR("Error in allocating pollfd or local_outfds");
-				lttng_consumer_send_error(ctx, LTTCOMM_CONSUMERD_POLL_ERROR);
-				pthread_mutex_unlock(&consumer_data.lock);
-				goto end;
-			}
-			nb_fd = ret;
-			consumer_data.need_update = 0;
-		}
-		pthread_mutex_unlock(&consumer_data.lock);
 
 		/* No FDs and consumer_quit, consumer_cleanup the thread */
-		if (nb_fd == 0 && consumer_quit == 1) {
+		if (nb_streams == 0 && consumer_quit == 1) {
 			err = 0;	/* All is OK */
 			goto end;
 		}
-		/* poll on the array of fds */
-	restart:
-		DBG("polling on %d fd", nb_fd + 2);
+
+		DBG("Data thread %u polling on %u stream(s)", thread->id,
+				nb_streams);
+		/*
+		 * Don't block if some streams still have data to be read and
+		 * check for zero-copy completions periodically.
+		 */
+		if (!cds_list_empty(&retry_list)) {
+			timeout = 0;
+		} else if (!cds_list_empty(&zerocopy_list)) {
+			timeout = DEFAULT_CONSUMERD_ZEROCOPY_POLL_MS;
+		} else {
+			timeout = -1;
+		}
 		health_poll_entry();
-		num_rdy = poll(pollfd, nb_fd + 2, -1);
+		ret = lttng_poll_wait(&events, timeout);
 		health_poll_exit();
-		DBG("poll num_rdy : %d", num_rdy);
-		if (num_rdy == -1) {
-			/*
-			 * Restart interrupted system call.
-			 */
-			if (errno == EINTR) {
-				goto restart;
-			}
+		DBG("Data thread %u poll return from wait with %d fd(s)",
+				thread->id, ret);
+		if (ret < 0) {
 			PERROR("Poll error");
 			lttng_consumer_send_error(ctx, LTTCOMM_CONSUMERD_POLL_ERROR);
 			goto end;
-		} else if (num_rdy == 0) {
-			DBG("Polling thread timed out");
-			goto end;
 		}
 
+		nb_ready = ret;
+
 		/*
-		 * If the consumer_data_pipe triggered poll go directly to the
-		 * beginning of the loop to update the array. We want to prioritize
-		 * array update over low-priority reads.
+		 * If the data pipe triggered poll go directly to the beginning of
+		 * the loop once the poll set is updated. We want to prioritize poll
+		 * set update over low-priority reads.
 		 */
-		if (pollfd[nb_fd].revents & (POLLIN | POLLPRI)) {
+		for (i = 0; i < nb_ready; i++) {
+			if (LTTNG_POLL_GETFD(&events, i) != data_pipe_fd ||
+					!(LTTNG_POLL_GETEV(&events, i) & (LPOLLIN | LPOLLPRI))) {
+				continue;
+			}
+			break;
+		}
+		if (i < nb_ready) {
 			ssize_t pipe_readlen;
 
-			DBG("consumer_data_pipe wake up");
-			pipe_readlen = lttng_pipe_read(ctx->consumer_data_pipe,
-					&new_stream, sizeof(new_stream));
-			if (pipe_readlen < sizeof(new_stream)) {
+			DBG("Data thread %u data pipe wake up", thread->id);
+			pipe_readlen = lttng_pipe_read(thread->data_pipe,
+					&stream, sizeof(stream));
+			if (pipe_readlen < sizeof(stream)) {
 				PERROR("Consumer data pipe");
 				/* Continue so we can at least handle the current stream(s). */
 				continue;
 			}
 
 			/*
-			 * If the stream is NULL, just ignore it. It's also possible that
-			 * the sessiond poll thread changed the consumer_quit state and is
-			 * waking us up to test it.
+			 * If the stream is NULL, the endpoint status of some streams has
+			 * changed. It's also possible that the sessiond poll thread
+			 * changed the consumer_quit state and is waking us up to test it.
 			 */
-			if (new_stream == NULL) {
-				validate_endpoint_status_data_stream();
+			if (stream == NULL) {
+				nb_streams -= validate_endpoint_status_data_stream(&events,
+						stream_fd_ht);
 				continue;
 			}
 
-			/* Continue to update the local streams and handle prio ones */
-			continue;
-		}
-
-		/* Handle wakeup pipe. */
-		if (pollfd[nb_fd + 1].revents & (POLLIN | POLLPRI)) {
-			char dummy;
-			ssize_t pipe_readlen;
+			/*
+			 * The endpoint of this stream might have been flagged before
+			 * its reception in which case the matching notification has
+			 * already been handled.
+			 */
+			if (stream->endpoint_status == CONSUMER_ENDPOINT_INACTIVE) {
+				consumer_del_stream(stream, data_ht);
+				continue;
+			}
 
-			pipe_readlen = lttng_pipe_read(ctx->consumer_wakeup_pipe, &dummy,
-					sizeof(dummy));
-			if (pipe_readlen < 0) {
-				PERROR("Consumer data wakeup pipe");
+			ret = data_thread_add_stream(thread, &events, stream_fd_ht,
+					stream);
+			if (ret < 0) {
+				ERR("Data thread %u failed to poll stream %" PRIu64,
+						thread->id, stream->key);
+				consumer_del_stream(stream, data_ht);
+				continue;
 			}
-			/* We've been awakened to handle stream(s). */
-			ctx->has_wakeup = 0;
+			nb_streams++;
+
+			/* Continue to update the poll set and handle prio ones */
+			continue;
 		}
 
+		rcu_read_lock();
+
 		/* Take care of high priority channels first. */
-		for (i = 0; i < nb_fd; i++) {
+		for (i = 0; i < nb_ready; i++) {
 			health_code_update();
 
-			if (local_stream[i] == NULL) {
+			revents = LTTNG_POLL_GETEV(&events, i);
+			if (!(revents & LPOLLPRI)) {
 				continue;
 			}
-			if (pollfd[i].revents & POLLPRI) {
-				DBG("Urgent read on fd %d", pollfd[i].fd);
-				high_prio = 1;
-				len = ctx->on_buffer_ready(local_stream[i], ctx);
-				/* it's ok to have an unavailable sub-buffer */
-				if (len < 0 && len != -EAGAIN && len != -ENODATA) {
-					/* Clean the stream and free it. */
-					consumer_del_stream(local_stream[i], data_ht);
-					local_stream[i] = NULL;
-				} else if (len > 0) {
-					local_stream[i]->data_read = 1;
-				}
+			stream = data_thread_find_stream(stream_fd_ht,
+					LTTNG_POLL_GETFD(&events, i));
+			if (!stream) {
+				continue;
+			}
+			DBG("Urgent read on fd %d", stream->wait_fd);
+			high_prio = 1;
+			if (data_thread_read_stream(ctx, &events, stream_fd_ht, stream,
+					&retry_list, &zerocopy_list)) {
+				nb_streams--;
 			}
 		}
 
@@ -2570,88 +2897,134 @@ void *consumer_thread_data_poll(void *data)
 		 * for more high prio data.
 		 */
 		if (high_prio) {
+			rcu_read_unlock();
 			continue;
 		}
 
+		/*
+		 * Streams of the retry list having a poll event are read only once,
+		 * with the other ready streams.
+		 */
+		CDS_INIT_LIST_HEAD(&retry_pass);
+		cds_list_for_each_entry_safe(stream, tmp_stream, &retry_list,
+				retry_node) {
+			cds_list_del(&stream->retry_node);
+			cds_list_add_tail(&stream->retry_node, &retry_pass);
+		}
+
 		/* Take care of low priority channels. */
-		for (i = 0; i < nb_fd; i++) {
+		for (i = 0; i < nb_ready; i++) {
+			int pollfd;
+
 			health_code_update();
 
-			if (local_stream[i] == NULL) {
+			pollfd = LTTNG_POLL_GETFD(&events, i);
+			revents = LTTNG_POLL_GETEV(&events, i);
+
+			/* Handle wakeup pipe. */
+			if (pollfd == wakeup_pipe_fd) {
+				char dummy;
+				ssize_t pipe_readlen;
+
+				pipe_readlen = lttng_pipe_read(thread->wakeup_pipe, &dummy,
+						sizeof(dummy));
+				if (pipe_readlen < 0) {
+					PERROR("Consumer data wakeup pipe");
+				}
+				/* We've been awakened to handle stream(s). */
+				thread->has_wakeup = 0;
 				continue;
 			}
-			if ((pollfd[i].revents & POLLIN) ||
-					local_stream[i]->hangup_flush_done ||
-					local_stream[i]->has_data) {
-				DBG("Normal read on fd %d", pollfd[i].fd);
-				len = ctx->on_buffer_ready(local_stream[i], ctx);
-				/* it's ok to have an unavailable sub-buffer */
-				if (len < 0 && len != -EAGAIN && len != -ENODATA) {
-					/* Clean the stream and free it. */
-					consumer_del_stream(local_stream[i], data_ht);
-					local_stream[i] = NULL;
-				} else if (len > 0) {
-					local_stream[i]->data_read = 1;
-				}
+
+			if (!(revents & LPOLLIN)) {
+				continue;
+			}
+			stream = data_thread_find_stream(stream_fd_ht, pollfd);
+			if (!stream) {
+				continue;
+			}
+			DBG("Normal read on fd %d", pollfd);
+			cds_list_del_init(&stream->retry_node);
+			if (data_thread_read_stream(ctx, &events, stream_fd_ht, stream,
+					&retry_list, &zerocopy_list)) {
+				nb_streams--;
+			}
+		}
+
+		/* Streams left in the retry pass have no poll event this round. */
+		cds_list_for_each_entry_safe(stream, tmp_stream, &retry_pass,
+				retry_node) {
+			health_code_update();
+
+			cds_list_del_init(&stream->retry_node);
+			DBG("Retry read on fd %d", stream->wait_fd);
+			if (data_thread_read_stream(ctx, &events, stream_fd_ht, stream,
+					&retry_list, &zerocopy_list)) {
+				nb_streams--;
 			}
 		}
 
 		/* Handle hangup and errors */
-		for (i = 0; i < nb_fd; i++) {
+		for (i = 0; i < nb_ready; i++) {
+			int pollfd;
+
 			health_code_update();
 
-			if (local_stream[i] == NULL) {
+			pollfd = LTTNG_POLL_GETFD(&events, i);
+			revents = LTTNG_POLL_GETEV(&events, i);
+			if (pollfd == wakeup_pipe_fd) {
+				continue;
+			}
+			stream = data_thread_find_stream(stream_fd_ht, pollfd);
+			if (!stream) {
 				continue;
 			}
-			if (!local_stream[i]->hangup_flush_done
-					&& (pollfd[i].revents & (POLLHUP | POLLERR | POLLNVAL))
+			if (!stream->hangup_flush_done
+					&& (revents & (LPOLLHUP | LPOLLERR | LPOLLNVAL))
 					&& (consumer_data.type == LTTNG_CONSUMER32_UST
 						|| consumer_data.type == LTTNG_CONSUMER64_UST)) {
 				DBG("fd %d is hup|err|nval. Attempting flush and read.",
-						pollfd[i].fd);
-				lttng_ustconsumer_on_stream_hangup(local_stream[i]);
+						pollfd);
+				lttng_ustconsumer_on_stream_hangup(stream);
 				/* Attempt read again, for the data we just flushed. */
-				local_stream[i]->data_read = 1;
+				stream->data_read = 1;
+				if (cds_list_empty(&stream->retry_node)) {
+					cds_list_add_tail(&stream->retry_node, &retry_list);
+				}
 			}
 			/*
 			 * If the poll flag is HUP/ERR/NVAL and we have
 			 * read no data in this pass, we can remove the
 			 * stream from its hash table.
 			 */
-			if ((pollfd[i].revents & POLLHUP)) {
-				DBG("Polling fd %d tells it has hung up.", pollfd[i].fd);
-				if (!local_stream[i]->data_read) {
-					consumer_del_stream(local_stream[i], data_ht);
-					local_stream[i] = NULL;
-					num_hup++;
-				}
-			} else if (pollfd[i].revents & POLLERR) {
-				ERR("Error returned in polling fd %d.", pollfd[i].fd);
-				if (!local_stream[i]->data_read) {
-					consumer_del_stream(local_stream[i], data_ht);
-					local_stream[i] = NULL;
-					num_hup++;
+			if (revents & (LPOLLHUP | LPOLLERR | LPOLLNVAL)) {
+				if (revents & LPOLLHUP) {
+					DBG("Polling fd %d tells it has hung up.", pollfd);
+				} else {
+					ERR("Error returned in polling fd %d.", pollfd);
 				}
-			} else if (pollfd[i].revents & POLLNVAL) {
-				ERR("Polling fd %d tells fd is not open.", pollfd[i].fd);
-				if (!local_stream[i]->data_read) {
-					consumer_del_stream(local_stream[i], data_ht);
-					local_stream[i] = NULL;
-					num_hup++;
+				if (!stream->data_read) {
+					data_thread_del_stream(&events, stream_fd_ht, stream);
+					nb_streams--;
+					continue;
 				}
 			}
-			if (local_stream[i] != NULL) {
-				local_stream[i]->data_read = 0;
-			}
+			stream->data_read = 0;
 		}
+
+		data_thread_release_zerocopy(&zerocopy_list, &retry_list);
+
+		rcu_read_unlock();
 	}
 	/* All is OK */
 	err = 0;
 end:
-	DBG("polling thread exiting");
-	free(pollfd);
-	free(local_stream);
+	DBG("Data thread %u exiting", thread->id);
 
+	lttng_poll_clean(&events);
+end_poll:
+	lttng_ht_destroy(stream_fd_ht);
+end_ht:
 	/*
 	 * Close the write side of the pipe so epoll_wait() in
 	 * consumer_thread_metadata_poll can catch it. The thread is monitoring the
@@ -2659,8 +3032,14 @@ end:
 	 * not return and could create a endless wait period if the pipe is the
 	 * only tracked fd in the poll set. The thread will take care of closing
 	 * the read side.
+	 *
+	 * Only the last data thread to exit closes it since the metadata thread
+	 * must keep consuming while data streams are still being consumed.
 	 */
-	(void) lttng_pipe_write_close(ctx->consumer_metadata_pipe);
+	if (uatomic_add_return(&ctx->nb_data_threads_exited, 1) ==
+			ctx->nb_data_threads) {
+		(void) lttng_pipe_write_close(ctx->consumer_metadata_pipe);
+	}
 
 error_testpoint:
 	if (err) {
@@ -3168,10 +3547,10 @@ end:
 	consumer_quit = 1;
 
 	/*
-	 * Notify the data poll thread to poll back again and test the
+	 * Notify the data poll threads to poll back again and test the
 	 * consumer_quit state that we just set so to quit gracefully.
 	 */
-	notify_thread_lttng_pipe(ctx->consumer_data_pipe);
+	notify_data_threads(ctx);
 
 	notify_channel_pipe(ctx, NULL, -1, CONSUMER_CHANNEL_QUIT);
 
@@ -3430,6 +3809,12 @@ int consumer_add_relayd_socket(uint64_t net_seq_idx, int sock_type,
 		/* Assign version values. */
 		relayd->data_sock.major = relayd_sock->major;
 		relayd->data_sock.minor = relayd_sock->minor;
+
+		if (ctx->relayd_zerocopy) {
+			/* Falls back on copying the data if not supported. */
+			(void) relayd_enable_zerocopy(&relayd->data_sock,
+					&relayd->data_sock_zerocopy);
+		}
 		break;
 	default:
 		ERR("Unknown relayd socket type (%d)", sock_type);
@@ -3610,6 +3995,15 @@ int consumer_data_pending(uint64_t id)
 				pthread_mutex_unlock(&stream->lock);
 				goto data_pending;
 			}
+			/*
+			 * All the data was consumed: make the batched indexes
+			 * available alongside it.
+			 */
+			ret = consumer_stream_flush_index(stream);
+			if (ret < 0) {
+				pthread_mutex_unlock(&stream->lock);
+				goto data_pending;
+			}
 		}
 
 		/* Relayd check */
@@ -3722,3 +4116,141 @@ unsigned long consumer_get_consume_start_pos(unsigned long consumed_pos,
 	}
 	return start_pos;
 }
+
+/*
+ * Streams of a snapshot shared by the threads copying them.
+ */
+struct snapshot_copy_work {
+	struct lttng_consumer_stream **streams;
+	unsigned int nb_streams;
+	/* Index of the next stream to copy. Updated atomically. */
+	unsigned int next_stream;
+	/* First error encountered. Set atomically. */
+	int ret;
+	struct lttng_consumer_local_data *ctx;
+	int (*copy_stream)(struct lttng_consumer_stream *stream,
+			struct lttng_consumer_local_data *ctx);
+};
+
+static void snapshot_copy_work_run(struct snapshot_copy_work *work)
+{
+	for (;;) {
+		int ret;
+		unsigned int i;
+		struct lttng_consumer_stream *stream;
+
+		i = uatomic_add_return(&work->next_stream, 1) - 1;
+		if (i >= work->nb_streams || uatomic_read(&work->ret)) {
+			break;
+		}
+		stream = work->streams[i];
+
+		health_code_update();
+
+		pthread_mutex_lock(&stream->lock);
+		ret = work->copy_stream(stream, work->ctx);
+		pthread_mutex_unlock(&stream->lock);
+		if (ret < 0) {
+			(void) uatomic_cmpxchg(&work->ret, 0, ret);
+		}
+	}
+}
+
+static void *snapshot_copy_thread(void *data)
+{
+	rcu_register_thread();
+	rcu_read_lock();
+	snapshot_copy_work_run(data);
+	rcu_read_unlock();
+	rcu_unregister_thread();
+	return NULL;
+}
+
+/*
+ * Copy the streams of a snapshot channel using up to ctx->nb_snapshot_threads
+ * threads, the calling thread included. The snapshot positions of every
+ * stream must already be taken so all the streams are captured at the same
+ * point in time, no matter how long it takes to copy them.
+ *
+ * copy_stream is called with the stream lock held. The RCU read side lock
+ * must be held by the caller.
+ *
+ * Return 0 on success or else the first error returned by copy_stream.
+ */
+int consumer_snapshot_copy_streams(struct lttng_consumer_channel *channel,
+		struct lttng_consumer_local_data *ctx,
+		int (*copy_stream)(struct lttng_consumer_stream *stream,
+			struct lttng_consumer_local_data *ctx))
+{
+	int ret;
+	unsigned int i, nb_threads, nb_threads_started = 0;
+	pthread_t *threads = NULL;
+	struct lttng_consumer_stream *stream;
+	struct snapshot_copy_work work;
+
+	assert(channel);
+	assert(ctx);
+	assert(copy_stream);
+
+	memset(&work, 0, sizeof(work));
+	work.ctx = ctx;
+	work.copy_stream = copy_stream;
+
+	cds_list_for_each_entry(stream, &channel->streams.head, send_node) {
+		work.nb_streams++;
+	}
+	if (!work.nb_streams) {
+		ret = 0;
+		goto end;
+	}
+
+	work.streams = zmalloc(work.nb_streams * sizeof(*work.streams));
+	if (!work.streams) {
+		PERROR("zmalloc snapshot streams");
+		ret = -ENOMEM;
+		goto end;
+	}
+	i = 0;
+	cds_list_for_each_entry(stream, &channel->streams.head, send_node) {
+		work.streams[i++] = stream;
+	}
+
+	nb_threads = min(work.nb_streams, max(ctx->nb_snapshot_threads, 1U));
+	if (nb_threads > 1) {
+		threads = zmalloc((nb_threads - 1) * sizeof(*threads));
+		if (!threads) {
+			PERROR("zmalloc snapshot threads");
+			nb_threads = 1;
+		}
+	}
+	for (i = 0; i < nb_threads - 1; i++) {
+		ret = pthread_create(&threads[i], NULL, snapshot_copy_thread,
+				&work);
+		if (ret) {
+			errno = ret;
+			PERROR("pthread_create snapshot copy thread");
+			/* Copy with the threads we have. */
+			break;
+		}
+		nb_threads_started++;
+	}
+	DBG("Copying %u snapshot streams of channel %" PRIu64
+			" with %u threads", work.nb_streams, channel->key,
+			nb_threads_started + 1);
+
+	snapshot_copy_work_run(&work);
+
+	for (i = 0; i < nb_threads_started; i++) {
+		ret = pthread_join(threads[i], NULL);
+		if (ret) {
+			errno = ret;
+			PERROR("pthread_join snapshot copy thread");
+		}
+	}
+	ret = work.ret;
+
+end:
+	free(threads);
+	free(work.streams);
+	return ret;
+}
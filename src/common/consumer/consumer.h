@@ -32,7 +32,8 @@
 #include <common/compat/uuid.h>
 #include <common/sessiond-comm/sessiond-comm.h>
 #include <common/pipe.h>
-#include <common/index/ctf-index.h>
+#include <common/index/index.h>
+#include <common/relayd/relayd.h>
 
 /* Commands for consumer */
 enum lttng_consumer_command {
@@ -89,6 +90,21 @@ enum consumer_channel_type {
 	CONSUMER_CHANNEL_TYPE_DATA	= 1,
 };
 
+/* Layout of the packet context found in the sub-buffers of a stream. */
+enum consumer_packet_layout {
+	/* Not validated yet. */
+	CONSUMER_PACKET_LAYOUT_UNCHECKED	= 0,
+	/* Packet context of the kernel tracer, decoded by the consumer. */
+	CONSUMER_PACKET_LAYOUT_KERNEL		= 1,
+	/* Unknown layout, the tracer is queried for the packet values. */
+	CONSUMER_PACKET_LAYOUT_UNSUPPORTED	= 2,
+};
+
+enum consumer_timer_type {
+	CONSUMER_TIMER_SWITCH	= 0,
+	CONSUMER_TIMER_LIVE	= 1,
+};
+
 extern struct lttng_consumer_global_data consumer_data;
 
 struct stream_list {
@@ -98,6 +114,23 @@ struct stream_list {
 
 /* Stub. */
 struct consumer_metadata_cache;
+struct lttng_consumer_channel;
+
+/*
+ * Periodic channel timer queued in the consumer timer wheel. Protected by the
+ * wheel lock.
+ */
+struct consumer_timer {
+	/* Node in a slot of the wheel or in the expired list. */
+	struct cds_list_head node;
+	/* Next expiration and period, in wheel ticks. */
+	uint64_t expiry;
+	uint64_t period;
+	enum consumer_timer_type type;
+	struct lttng_consumer_channel *channel;
+	/* Set while the timer is started. */
+	int armed;
+};
 
 struct lttng_consumer_channel {
 	/* HT node used for consumer_data.channel_ht */
@@ -159,12 +192,12 @@ struct lttng_consumer_channel {
 	struct consumer_metadata_cache *metadata_cache;
 	/* For UST metadata periodical flush */
 	int switch_timer_enabled;
-	timer_t switch_timer;
+	struct consumer_timer switch_timer;
 	int switch_timer_error;
 
 	/* For the live mode */
 	int live_timer_enabled;
-	timer_t live_timer;
+	struct consumer_timer live_timer;
 	int live_timer_error;
 
 	/* On-disk circular buffer */
@@ -224,6 +257,22 @@ struct lttng_consumer_stream {
 	struct lttng_ht_node_u64 node_channel_id;
 	/* HT node used in consumer_data.stream_list_ht */
 	struct lttng_ht_node_u64 node_session_id;
+	/*
+	 * HT node indexing a data stream by wait_fd in the poll set of its data
+	 * thread. Only used by the owning data thread.
+	 */
+	struct lttng_ht_node_u64 node_wait_fd;
+	/*
+	 * Node of the owning data thread's list of streams to read again without
+	 * waiting for a poll event. Only used by the owning data thread.
+	 */
+	struct cds_list_head retry_node;
+	/*
+	 * Node of the owning data thread's list of streams holding a sub-buffer
+	 * until the completion of its zero-copy send to the relayd. Only used by
+	 * the owning data thread.
+	 */
+	struct cds_list_head zerocopy_node;
 	/* Pointer to associated channel. */
 	struct lttng_consumer_channel *chan;
 
@@ -236,6 +285,13 @@ struct lttng_consumer_stream {
 	int out_fd; /* output file to write the data */
 	/* Write position in the output file descriptor */
 	off_t out_fd_offset;
+	/*
+	 * Start of the data written to the output file for which writeback is
+	 * not started yet and start of the batch whose writeback was started
+	 * last. See lttng_consumer_sync_trace_file().
+	 */
+	off_t writeback_offset;
+	off_t writeback_prev_offset;
 	/* Amount of bytes written to the output */
 	uint64_t output_written;
 	enum lttng_consumer_stream_state state;
@@ -267,6 +323,11 @@ struct lttng_consumer_stream {
 	 */
 	void *mmap_base;
 	unsigned long mmap_len;
+	/*
+	 * Kernel MMAP output only: the index values of a packet are read
+	 * from its mmap'd packet context when its layout is known.
+	 */
+	enum consumer_packet_layout packet_layout;
 
 	/* For UST */
 
@@ -355,6 +416,16 @@ struct lttng_consumer_stream {
 	 * FD of the index file for this stream.
 	 */
 	int index_fd;
+	/*
+	 * Indexes not yet written to index_fd. Protected by the stream lock.
+	 */
+	struct index_buffer index_buffer;
+	/*
+	 * Range of positions to copy during a snapshot. Taken for every stream
+	 * of the channel before any of them is copied.
+	 */
+	unsigned long snapshot_consumed_pos;
+	unsigned long snapshot_produced_pos;
 
 	/*
 	 * Local pipe to extract data when using splice.
@@ -369,6 +440,25 @@ struct lttng_consumer_stream {
 
 	/* Indicate if the stream still has some data to be read. */
 	unsigned int has_data:1;
+
+	/*
+	 * The sub-buffer last read is sent to the relayd without being copied
+	 * and is released once the kernel is done with it, see
+	 * consumer_stream_release_zerocopy(). zerocopy_seq identifies the send
+	 * on the relayd data socket and relayd_data_hdr, sent along with the
+	 * data, has to be kept until then. Protected by the stream lock.
+	 */
+	unsigned int zerocopy_pending:1;
+	uint32_t zerocopy_seq;
+	struct lttcomm_relayd_data_hdr relayd_data_hdr;
+
+	/* CPU number of the stream's ring buffer, -1 if unknown. */
+	int cpu;
+	/*
+	 * Data thread owning this stream. Only set for data streams once added
+	 * to the data stream hash table. Immutable afterwards.
+	 */
+	struct lttng_consumer_data_thread *data_thread;
 };
 
 /*
@@ -402,11 +492,18 @@ struct consumer_relayd_sock_pair {
 	struct lttcomm_relayd_sock control_sock;
 
 	/*
-	 * We don't need a mutex at this point since we only splice or write single
-	 * large chunk of data with a header appended at the begining. Moreover,
-	 * this socket is for now only used in a single thread.
+	 * Mutex protecting the data socket. Data streams of a relayd can be owned
+	 * by different data threads so the header and the payload of a packet
+	 * must be sent atomically with respect to the other threads.
+	 *
+	 * This is nested INSIDE the stream lock.
 	 */
+	pthread_mutex_t data_sock_mutex;
+
+	/* Data socket. Trace data of the data streams is passed over it. */
 	struct lttcomm_relayd_sock data_sock;
+	/* Zero-copy state of the data socket. Protected by data_sock_mutex. */
+	struct relayd_zerocopy data_sock_zerocopy;
 	struct lttng_ht_node_u64 node;
 
 	/* Session id on both sides for the sockets. */
@@ -414,6 +511,36 @@ struct consumer_relayd_sock_pair {
 	uint64_t sessiond_session_id;
 };
 
+/*
+ * Data stream poll thread. The data streams are sharded between those threads
+ * so each stream is consumed by exactly one of them.
+ */
+struct lttng_consumer_data_thread {
+	/* Index of this thread in the data thread array of the context. */
+	unsigned int id;
+	pthread_t thread;
+	struct lttng_consumer_local_data *ctx;
+	/* Data stream poll thread pipe. To transfer data stream to the thread */
+	struct lttng_pipe *data_pipe;
+
+	/*
+	 * Data thread use that pipe to catch wakeup from read subbuffer that
+	 * detects that there is still data to be read for the stream encountered.
+	 * Before doing so, the stream is flagged to indicate that there is still
+	 * data to be read.
+	 *
+	 * Both pipes (read/write) are owned and used inside the data thread.
+	 */
+	struct lttng_pipe *wakeup_pipe;
+	/* Indicate if the wakeup thread has been notified. */
+	unsigned int has_wakeup:1;
+
+	/*
+	 * Number of streams owned by this thread. Protected by consumer_data.lock.
+	 */
+	int stream_count;
+};
+
 /*
  * UST consumer local data to the program. One or more instance per
  * process.
@@ -477,20 +604,15 @@ struct lttng_consumer_local_data {
 	char *consumer_command_sock_path;
 	/* communication with splice */
 	int consumer_channel_pipe[2];
-	/* Data stream poll thread pipe. To transfer data stream to the thread */
-	struct lttng_pipe *consumer_data_pipe;
-
-	/*
-	 * Data thread use that pipe to catch wakeup from read subbuffer that
-	 * detects that there is still data to be read for the stream encountered.
-	 * Before doing so, the stream is flagged to indicate that there is still
-	 * data to be read.
-	 *
-	 * Both pipes (read/write) are owned and used inside the data thread.
-	 */
-	struct lttng_pipe *consumer_wakeup_pipe;
-	/* Indicate if the wakeup thread has been notified. */
-	unsigned int has_wakeup:1;
+	/* Data stream poll threads. Set by lttng_consumer_init_data_threads(). */
+	struct lttng_consumer_data_thread *data_threads;
+	unsigned int nb_data_threads;
+	/* Number of data threads that have exited. Updated atomically. */
+	unsigned int nb_data_threads_exited;
+	/* Use zero-copy transmission on the relayd data sockets if supported. */
+	unsigned int relayd_zerocopy:1;
+	/* Maximum number of threads copying the streams of a snapshot. */
+	unsigned int nb_snapshot_threads;
 
 	/* to let the signal handler wake up the fd receiver thread */
 	int consumer_should_quit[2];
@@ -520,11 +642,6 @@ struct lttng_consumer_global_data {
 
 	/* Channel hash table protected by consumer_data.lock. */
 	struct lttng_ht *channel_ht;
-	/*
-	 * Flag specifying if the local array of FDs needs update in the
-	 * poll function. Protected by consumer_data.lock.
-	 */
-	unsigned int need_update;
 	enum lttng_consumer_type type;
 
 	/*
@@ -586,8 +703,8 @@ void lttng_consumer_cleanup(void);
 /*
  * Flush pending writes to trace output disk file.
  */
-void lttng_consumer_sync_trace_file(struct lttng_consumer_stream *stream,
-		off_t orig_offset);
+void lttng_consumer_sync_trace_file(struct lttng_consumer_stream *stream);
+void lttng_consumer_flush_trace_file(struct lttng_consumer_stream *stream);
 
 /*
  * Poll on the should_quit pipe and the command socket return -1 on error and
@@ -648,10 +765,12 @@ struct lttng_consumer_local_data *lttng_consumer_create(
 		int (*recv_stream)(struct lttng_consumer_stream *stream),
 		int (*update_stream)(uint64_t sessiond_key, uint32_t state));
 void lttng_consumer_destroy(struct lttng_consumer_local_data *ctx);
+int lttng_consumer_init_data_threads(struct lttng_consumer_local_data *ctx,
+		unsigned int nb_threads);
 ssize_t lttng_consumer_on_read_subbuffer_mmap(
 		struct lttng_consumer_local_data *ctx,
 		struct lttng_consumer_stream *stream, unsigned long len,
-		unsigned long padding,
+		unsigned long padding, unsigned long mmap_offset,
 		struct ctf_packet_index *index);
 ssize_t lttng_consumer_on_read_subbuffer_splice(
 		struct lttng_consumer_local_data *ctx,
@@ -689,7 +808,12 @@ void consumer_destroy_relayd(struct consumer_relayd_sock_pair *relayd);
 unsigned long consumer_get_consume_start_pos(unsigned long consumed_pos,
 		unsigned long produced_pos, uint64_t nb_packets_per_stream,
 		uint64_t max_sb_size);
-int consumer_add_data_stream(struct lttng_consumer_stream *stream);
+int consumer_snapshot_copy_streams(struct lttng_consumer_channel *channel,
+		struct lttng_consumer_local_data *ctx,
+		int (*copy_stream)(struct lttng_consumer_stream *stream,
+			struct lttng_consumer_local_data *ctx));
+int consumer_add_data_stream(struct lttng_consumer_local_data *ctx,
+		struct lttng_consumer_stream *stream);
 void consumer_del_stream_for_data(struct lttng_consumer_stream *stream);
 int consumer_add_metadata_stream(struct lttng_consumer_stream *stream);
 void consumer_del_stream_for_metadata(struct lttng_consumer_stream *stream);
@@ -79,10 +79,43 @@
 #define DEFAULT_USTCONSUMERD32_CMD_SOCK_PATH    DEFAULT_USTCONSUMERD32_PATH "/command"
 #define DEFAULT_USTCONSUMERD32_ERR_SOCK_PATH    DEFAULT_USTCONSUMERD32_PATH "/error"
 
+/* Number of data stream poll threads of a consumer daemon. */
+#define DEFAULT_CONSUMERD_DATA_THREADS          1
+#define DEFAULT_CONSUMERD_DATA_THREADS_ENV      "LTTNG_CONSUMERD_DATA_THREADS"
+
+/*
+ * Minimal amount of trace data written to a local trace file before its
+ * writeback is started. A larger sub-buffer size is used if set.
+ */
+#define DEFAULT_CONSUMERD_WRITEBACK_BATCH_SIZE  (1024 * 1024)
+
+/* Maximum number of threads copying the streams of a channel snapshot. */
+#define DEFAULT_CONSUMERD_SNAPSHOT_THREADS      4
+#define DEFAULT_CONSUMERD_SNAPSHOT_THREADS_ENV  "LTTNG_CONSUMERD_SNAPSHOT_THREADS"
+
+/* Enables zero-copy transmission of trace data to the relayd when set. */
+#define DEFAULT_CONSUMERD_ZEROCOPY_ENV          "LTTNG_CONSUMERD_ZEROCOPY"
+
+/*
+ * Interval at which a data thread checks for the completion of its zero-copy
+ * sends while sub-buffers are held for them.
+ */
+#define DEFAULT_CONSUMERD_ZEROCOPY_POLL_MS      1
+
+/*
+ * Time a stream being destroyed waits for its last zero-copy send to complete
+ * when no network timeout is set. The relayd connection is reset past it.
+ */
+#define DEFAULT_CONSUMERD_ZEROCOPY_TIMEOUT_MS   10000
+
 /* Relayd path */
 #define DEFAULT_RELAYD_RUNDIR			"%s"
 #define DEFAULT_RELAYD_PATH			DEFAULT_RELAYD_RUNDIR "/relayd"
 
+/* Number of threads handling the control and data connections of a relayd. */
+#define DEFAULT_RELAYD_WORKER_THREADS		1
+#define DEFAULT_RELAYD_LIVE_WORKER_THREADS	1
+
 /* Default lttng run directory */
 #define DEFAULT_LTTNG_HOME_ENV_VAR              "LTTNG_HOME"
 #define DEFAULT_LTTNG_FALLBACK_HOME_ENV_VAR	"HOME"
@@ -291,6 +324,16 @@
 #define DEFAULT_APP_SOCKET_RW_TIMEOUT       5  /* sec */
 #define DEFAULT_APP_SOCKET_TIMEOUT_ENV      "LTTNG_APP_SOCKET_TIMEOUT"
 
+/*
+ * Number of threads sending a session-wide command to the registered
+ * applications concurrently.
+ */
+#define DEFAULT_APP_CMD_THREADS             8
+#define DEFAULT_APP_CMD_THREADS_ENV         "LTTNG_APP_CMD_THREADS"
+
+/* Number of threads processing the commands of the lttng clients. */
+#define DEFAULT_CLIENT_CMD_THREADS          4
+
 #define DEFAULT_UST_STREAM_FD_NUM			2 /* Number of fd per UST stream. */
 
 #define DEFAULT_SNAPSHOT_NAME				"snapshot"
@@ -300,6 +343,20 @@
 #define DEFAULT_INDEX_FILE_SUFFIX			".idx"
 #define DEFAULT_INDEX_DIR					"index"
 
+/*
+ * Packet indexes are written to the index file in batches: a batch is
+ * written once it holds this many entries or once its oldest entry has
+ * been buffered for longer than the maximum age (in msec).
+ */
+#define DEFAULT_INDEX_BUFFER_ENTRIES			64
+#define DEFAULT_INDEX_BUFFER_MAX_AGE			100 /* msec */
+
+/*
+ * Number of the most recent packet indexes of a live stream kept in memory by
+ * the relay daemon to serve viewers without reading the index file back.
+ */
+#define DEFAULT_RELAYD_LIVE_INDEX_RING_ENTRIES		256
+
 /* Default lttng command live timer value in usec. */
 #define DEFAULT_LTTNG_LIVE_TIMER			1000000
 
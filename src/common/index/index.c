@@ -202,3 +202,80 @@ error_close:
 error:
 	return ret;
 }
+
+/*
+ * Write all the indexes held by the buffer to the given fd in a single
+ * write and empty the buffer.
+ *
+ * Return the number of indexes written or a negative value on error, in
+ * which case the buffered indexes are discarded.
+ */
+int index_buffer_flush(struct index_buffer *buffer, int fd)
+{
+	int ret;
+	ssize_t size_ret;
+	size_t len;
+
+	assert(buffer);
+
+	if (!buffer->count) {
+		ret = 0;
+		goto end;
+	}
+
+	len = buffer->count * sizeof(struct ctf_packet_index);
+	size_ret = index_write(fd, buffer->entries, len);
+	if (size_ret < (ssize_t) len) {
+		ret = -1;
+	} else {
+		ret = buffer->count;
+	}
+	buffer->count = 0;
+
+end:
+	return ret;
+}
+
+/*
+ * Add an index to the buffer. The buffered indexes are written to the given
+ * fd once the buffer is full or once its oldest entry is older than
+ * DEFAULT_INDEX_BUFFER_MAX_AGE.
+ *
+ * Return the number of indexes written to the fd (0 if the index was only
+ * buffered) or a negative value on error.
+ */
+int index_buffer_add(struct index_buffer *buffer, int fd,
+		struct ctf_packet_index *index)
+{
+	int ret;
+	struct timespec now;
+	int64_t age_ms;
+
+	assert(buffer);
+	assert(index);
+
+	/* A full buffer is always flushed by the add that filled it. */
+	assert(buffer->count < DEFAULT_INDEX_BUFFER_ENTRIES);
+
+	ret = clock_gettime(CLOCK_MONOTONIC, &now);
+	if (ret < 0) {
+		PERROR("clock_gettime index buffer");
+		/* Don't keep an index we can't age, write it right away. */
+		memset(&now, 0, sizeof(now));
+	}
+	if (!buffer->count) {
+		buffer->oldest = now;
+	}
+	memcpy(&buffer->entries[buffer->count++], index, sizeof(*index));
+
+	age_ms = (int64_t) (now.tv_sec - buffer->oldest.tv_sec) * 1000 +
+			(now.tv_nsec - buffer->oldest.tv_nsec) / 1000000;
+	if (buffer->count < DEFAULT_INDEX_BUFFER_ENTRIES &&
+			age_ms < DEFAULT_INDEX_BUFFER_MAX_AGE && ret == 0) {
+		goto end;
+	}
+	ret = index_buffer_flush(buffer, fd);
+
+end:
+	return ret;
+}
@@ -20,13 +20,30 @@
 #define _INDEX_H
 
 #include <inttypes.h>
+#include <time.h>
+
+#include <common/defaults.h>
 
 #include "ctf-index.h"
 
+/*
+ * Packet indexes of a stream waiting to be written to its index file. The
+ * owner of the buffer is responsible for its synchronization.
+ */
+struct index_buffer {
+	struct ctf_packet_index entries[DEFAULT_INDEX_BUFFER_ENTRIES];
+	unsigned int count;
+	/* Monotonic time at which the oldest entry was buffered. */
+	struct timespec oldest;
+};
+
 int index_create_file(char *path_name, char *stream_name, int uid, int gid,
 		uint64_t size, uint64_t count);
 ssize_t index_write(int fd, struct ctf_packet_index *index, size_t len);
 int index_open(const char *path_name, const char *channel_name,
 		uint64_t tracefile_count, uint64_t tracefile_count_current);
+int index_buffer_add(struct index_buffer *buffer, int fd,
+		struct ctf_packet_index *index);
+int index_buffer_flush(struct index_buffer *buffer, int fd);
 
 #endif /* _INDEX_H */
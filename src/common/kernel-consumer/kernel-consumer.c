@@ -49,6 +49,25 @@ extern struct lttng_consumer_global_data consumer_data;
 extern int consumer_poll_timeout;
 extern volatile int consumer_quit;
 
+/* CTF packet magic number, in the native byte order of the tracer. */
+#define KERNEL_PACKET_MAGIC	0xC1FC1FC1
+
+/*
+ * Packet header and context written by the kernel tracer at the beginning of
+ * every packet of a data stream, in its native byte order. Sizes are in bits.
+ */
+struct kernel_packet_context {
+	uint32_t magic;
+	uint8_t uuid[16];
+	uint32_t stream_id;
+	uint64_t timestamp_begin;
+	uint64_t timestamp_end;
+	uint64_t content_size;
+	uint64_t packet_size;
+	unsigned long events_discarded;
+	uint32_t cpu_id;
+} LTTNG_PACKED;
+
 /*
  * Take a snapshot for a specific fd
  *
@@ -108,9 +127,133 @@ int lttng_kconsumer_get_consumed_snapshot(struct lttng_consumer_stream *stream,
 	return ret;
 }
 
+/*
+ * Close the output of a snapshot stream so it can be used by the next
+ * snapshot.
+ *
+ * Returns 0 on success, < 0 on error
+ */
+static int snapshot_close_stream(struct lttng_consumer_stream *stream)
+{
+	int ret = 0;
+
+	if (stream->net_seq_idx == (uint64_t) -1ULL) {
+		if (stream->out_fd >= 0) {
+			lttng_consumer_flush_trace_file(stream);
+			ret = close(stream->out_fd);
+			if (ret < 0) {
+				PERROR("Kernel consumer snapshot close out_fd");
+			}
+			stream->out_fd = -1;
+		}
+	} else {
+		close_relayd_stream(stream);
+		stream->net_seq_idx = (uint64_t) -1ULL;
+	}
+
+	return ret;
+}
+
+/*
+ * Copy the sub-buffers of a stream between its snapshot positions and close
+ * its output. Called with the stream lock held, possibly from a snapshot
+ * copy thread.
+ *
+ * Returns 0 on success, < 0 on error
+ */
+static int snapshot_copy_stream(struct lttng_consumer_stream *stream,
+		struct lttng_consumer_local_data *ctx)
+{
+	int ret;
+	unsigned long consumed_pos = stream->snapshot_consumed_pos;
+
+	while (consumed_pos < stream->snapshot_produced_pos) {
+		ssize_t read_len;
+		unsigned long len, padded_len, mmap_offset;
+
+		health_code_update();
+
+		DBG("Kernel consumer taking snapshot at pos %lu", consumed_pos);
+
+		ret = kernctl_get_subbuf(stream->wait_fd, &consumed_pos);
+		if (ret < 0) {
+			if (errno != EAGAIN) {
+				PERROR("kernctl_get_subbuf snapshot");
+				ret = -errno;
+				goto end;
+			}
+			DBG("Kernel consumer get subbuf failed. Skipping it.");
+			consumed_pos += stream->max_sb_size;
+			continue;
+		}
+
+		ret = kernctl_get_subbuf_size(stream->wait_fd, &len);
+		if (ret < 0) {
+			ERR("Snapshot kernctl_get_subbuf_size");
+			ret = -errno;
+			goto error_put_subbuf;
+		}
+
+		ret = kernctl_get_padded_subbuf_size(stream->wait_fd, &padded_len);
+		if (ret < 0) {
+			ERR("Snapshot kernctl_get_padded_subbuf_size");
+			ret = -errno;
+			goto error_put_subbuf;
+		}
+
+		ret = kernctl_get_mmap_read_offset(stream->wait_fd, &mmap_offset);
+		if (ret < 0) {
+			ERR("Snapshot kernctl_get_mmap_read_offset");
+			ret = -errno;
+			goto error_put_subbuf;
+		}
+
+		read_len = lttng_consumer_on_read_subbuffer_mmap(ctx, stream, len,
+				padded_len - len, mmap_offset, NULL);
+		/*
+		 * We write the padded len in local tracefiles but the data len
+		 * when using a relay. Display the error but continue processing
+		 * to try to release the subbuffer.
+		 */
+		if (stream->net_seq_idx != (uint64_t) -1ULL) {
+			if (read_len != len) {
+				ERR("Error sending to the relay (ret: %zd != len: %lu)",
+						read_len, len);
+			}
+		} else {
+			if (read_len != padded_len) {
+				ERR("Error writing to tracefile (ret: %zd != len: %lu)",
+						read_len, padded_len);
+			}
+		}
+
+		ret = kernctl_put_subbuf(stream->wait_fd);
+		if (ret < 0) {
+			ERR("Snapshot kernctl_put_subbuf");
+			ret = -errno;
+			goto end;
+		}
+		consumed_pos += stream->max_sb_size;
+	}
+
+	ret = snapshot_close_stream(stream);
+	goto end;
+
+error_put_subbuf:
+	if (kernctl_put_subbuf(stream->wait_fd) < 0) {
+		ERR("Snapshot kernctl_put_subbuf error path");
+	}
+end:
+	return ret;
+}
+
 /*
  * Take a snapshot of all the stream of a channel
  *
+ * The positions of every stream are taken first, back to back, so that the
+ * snapshot is as close as possible to a single point in time. The streams
+ * are then copied in parallel.
+ *
  * Returns 0 on success, < 0 on error
  */
 int lttng_kconsumer_snapshot_channel(uint64_t key, char *path,
@@ -140,6 +283,7 @@ int lttng_kconsumer_snapshot_channel(uint64_t key, char *path,
 		goto end;
 	}
 
+	/* Set up the snapshot output of every stream. */
 	cds_list_for_each_entry(stream, &channel->streams.head, send_node) {
 
 		health_code_update();
@@ -177,13 +321,29 @@ int lttng_kconsumer_snapshot_channel(uint64_t key, char *path,
 			DBG("Kernel consumer snapshot stream %s/%s (%" PRIu64 ")",
 					path, stream->name, stream->key);
 		}
-		if (relayd_id != -1ULL) {
-			ret = consumer_send_relayd_streams_sent(relayd_id);
+
+		if (stream->max_sb_size == 0) {
+			ret = kernctl_get_max_subbuf_size(stream->wait_fd,
+					&stream->max_sb_size);
 			if (ret < 0) {
-				ERR("sending streams sent to relayd");
+				ERR("Getting kernel max_sb_size");
+				ret = -errno;
 				goto end_unlock;
 			}
 		}
+		pthread_mutex_unlock(&stream->lock);
+	}
+	if (relayd_id != -1ULL) {
+		ret = consumer_send_relayd_streams_sent(relayd_id);
+		if (ret < 0) {
+			ERR("sending streams sent to relayd");
+			goto error_close;
+		}
+	}
+
+	/* Take the snapshot positions of every stream. */
+	cds_list_for_each_entry(stream, &channel->streams.head, send_node) {
+		pthread_mutex_lock(&stream->lock);
 
 		ret = kernctl_buffer_flush(stream->wait_fd);
 		if (ret < 0) {
@@ -210,110 +370,31 @@ int lttng_kconsumer_snapshot_channel(uint64_t key, char *path,
 			goto end_unlock;
 		}
 
-		if (stream->max_sb_size == 0) {
-			ret = kernctl_get_max_subbuf_size(stream->wait_fd,
-					&stream->max_sb_size);
-			if (ret < 0) {
-				ERR("Getting kernel max_sb_size");
-				ret = -errno;
-				goto end_unlock;
-			}
-		}
-
-		consumed_pos = consumer_get_consume_start_pos(consumed_pos,
-				produced_pos, nb_packets_per_stream,
+		stream->snapshot_consumed_pos = consumer_get_consume_start_pos(
+				consumed_pos, produced_pos, nb_packets_per_stream,
 				stream->max_sb_size);
-
-		while (consumed_pos < produced_pos) {
-			ssize_t read_len;
-			unsigned long len, padded_len;
-
-			health_code_update();
-
-			DBG("Kernel consumer taking snapshot at pos %lu", consumed_pos);
-
-			ret = kernctl_get_subbuf(stream->wait_fd, &consumed_pos);
-			if (ret < 0) {
-				if (errno != EAGAIN) {
-					PERROR("kernctl_get_subbuf snapshot");
-					ret = -errno;
-					goto end_unlock;
-				}
-				DBG("Kernel consumer get subbuf failed. Skipping it.");
-				consumed_pos += stream->max_sb_size;
-				continue;
-			}
-
-			ret = kernctl_get_subbuf_size(stream->wait_fd, &len);
-			if (ret < 0) {
-				ERR("Snapshot kernctl_get_subbuf_size");
-				ret = -errno;
-				goto error_put_subbuf;
-			}
-
-			ret = kernctl_get_padded_subbuf_size(stream->wait_fd, &padded_len);
-			if (ret < 0) {
-				ERR("Snapshot kernctl_get_padded_subbuf_size");
-				ret = -errno;
-				goto error_put_subbuf;
-			}
-
-			read_len = lttng_consumer_on_read_subbuffer_mmap(ctx, stream, len,
-					padded_len - len, NULL);
-			/*
-			 * We write the padded len in local tracefiles but the data len
-			 * when using a relay. Display the error but continue processing
-			 * to try to release the subbuffer.
-			 */
-			if (relayd_id != (uint64_t) -1ULL) {
-				if (read_len != len) {
-					ERR("Error sending to the relay (ret: %zd != len: %lu)",
-							read_len, len);
-				}
-			} else {
-				if (read_len != padded_len) {
-					ERR("Error writing to tracefile (ret: %zd != len: %lu)",
-							read_len, padded_len);
-				}
-			}
-
-			ret = kernctl_put_subbuf(stream->wait_fd);
-			if (ret < 0) {
-				ERR("Snapshot kernctl_put_subbuf");
-				ret = -errno;
-				goto end_unlock;
-			}
-			consumed_pos += stream->max_sb_size;
-		}
-
-		if (relayd_id == (uint64_t) -1ULL) {
-			if (stream->out_fd >= 0) {
-				ret = close(stream->out_fd);
-				if (ret < 0) {
-					PERROR("Kernel consumer snapshot close out_fd");
-					goto end_unlock;
-				}
-				stream->out_fd = -1;
-			}
-		} else {
-			close_relayd_stream(stream);
-			stream->net_seq_idx = (uint64_t) -1ULL;
-		}
+		stream->snapshot_produced_pos = produced_pos;
 		pthread_mutex_unlock(&stream->lock);
 	}
 
+	ret = consumer_snapshot_copy_streams(channel, ctx, snapshot_copy_stream);
+	if (ret < 0) {
+		goto error_close;
+	}
+
 	/* All good! */
 	ret = 0;
 	goto end;
 
-error_put_subbuf:
-	ret = kernctl_put_subbuf(stream->wait_fd);
-	if (ret < 0) {
-		ret = -errno;
-		ERR("Snapshot kernctl_put_subbuf error path");
-	}
 end_unlock:
 	pthread_mutex_unlock(&stream->lock);
+error_close:
+	/* Release the outputs left open so the next snapshot can proceed. */
+	cds_list_for_each_entry(stream, &channel->streams.head, send_node) {
+		pthread_mutex_lock(&stream->lock);
+		(void) snapshot_close_stream(stream);
+		pthread_mutex_unlock(&stream->lock);
+	}
 end:
 	rcu_read_unlock();
 	return ret;
@@ -717,14 +798,14 @@ int lttng_kconsumer_recv_cmd(struct lttng_consumer_local_data *ctx,
 			}
 			stream_pipe = ctx->consumer_metadata_pipe;
 		} else {
-			ret = consumer_add_data_stream(new_stream);
+			ret = consumer_add_data_stream(ctx, new_stream);
 			if (ret) {
 				ERR("Consumer add stream %" PRIu64 " failed. Continuing",
 						new_stream->key);
 				consumer_stream_free(new_stream);
 				goto end_nosignal;
 			}
-			stream_pipe = ctx->consumer_data_pipe;
+			stream_pipe = new_stream->data_thread->data_pipe;
 		}
 
 		/* Vitible to other threads */
@@ -961,11 +1042,12 @@ error_fatal:
 }
 
 /*
- * Populate index values of a kernel stream. Values are set in big endian order.
+ * Populate index values of a kernel stream using the tracer ioctls. Values are
+ * set in big endian order.
  *
  * Return 0 on success or else a negative value.
  */
-static int get_index_values(struct ctf_packet_index *index, int infd)
+static int get_index_values_ioctl(struct ctf_packet_index *index, int infd)
 {
 	int ret;
 
@@ -1014,6 +1096,151 @@ static int get_index_values(struct ctf_packet_index *index, int infd)
 error:
 	return ret;
 }
+
+/*
+ * Decode the index values of the current sub-buffer from the packet context
+ * at its beginning. padded_len is the padded size of the sub-buffer and
+ * mmap_offset its offset in the mmap area of the stream.
+ *
+ * Return 0 on success or 1 if the packet context does not have the expected
+ * layout.
+ */
+static int get_index_values_mmap(struct lttng_consumer_stream *stream,
+		struct ctf_packet_index *index, unsigned long padded_len,
+		unsigned long mmap_offset)
+{
+	int ret;
+	const struct kernel_packet_context *packet;
+
+	if (padded_len < sizeof(*packet) ||
+			mmap_offset + padded_len > stream->mmap_len) {
+		ret = 1;
+		goto end;
+	}
+	packet = (const struct kernel_packet_context *)
+			((const char *) stream->mmap_base + mmap_offset);
+	if (packet->magic != KERNEL_PACKET_MAGIC ||
+			packet->packet_size != (uint64_t) padded_len * CHAR_BIT ||
+			packet->content_size > packet->packet_size) {
+		ret = 1;
+		goto end;
+	}
+
+	index->timestamp_begin = htobe64(packet->timestamp_begin);
+	index->timestamp_end = htobe64(packet->timestamp_end);
+	index->events_discarded = htobe64(packet->events_discarded);
+	index->content_size = htobe64(packet->content_size);
+	index->packet_size = htobe64(packet->packet_size);
+	index->stream_id = htobe64(packet->stream_id);
+	ret = 0;
+
+end:
+	return ret;
+}
+
+/*
+ * Validate that the packet context of the current sub-buffer has the layout
+ * expected by get_index_values_mmap() by comparing it with the values
+ * returned by the tracer, which are used to fill the index.
+ *
+ * Return 0 on success or else a negative value.
+ */
+static int check_packet_layout(struct lttng_consumer_stream *stream,
+		struct ctf_packet_index *index, unsigned long padded_len,
+		unsigned long mmap_offset)
+{
+	int ret;
+	unsigned long subbuf_size;
+	struct ctf_packet_index mmap_index;
+
+	ret = get_index_values_ioctl(index, stream->wait_fd);
+	if (ret < 0) {
+		goto end;
+	}
+
+	stream->packet_layout = CONSUMER_PACKET_LAYOUT_UNSUPPORTED;
+	if (stream->chan->output != CONSUMER_CHANNEL_MMAP) {
+		goto end;
+	}
+
+	memset(&mmap_index, 0, sizeof(mmap_index));
+	ret = get_index_values_mmap(stream, &mmap_index, padded_len,
+			mmap_offset);
+	if (ret > 0) {
+		ret = 0;
+		goto unsupported;
+	}
+
+	ret = kernctl_get_subbuf_size(stream->wait_fd, &subbuf_size);
+	if (ret < 0) {
+		PERROR("kernctl_get_subbuf_size");
+		ret = -errno;
+		goto end;
+	}
+
+	if (mmap_index.timestamp_begin != index->timestamp_begin ||
+			mmap_index.timestamp_end != index->timestamp_end ||
+			mmap_index.events_discarded != index->events_discarded ||
+			mmap_index.content_size != index->content_size ||
+			mmap_index.packet_size != index->packet_size ||
+			mmap_index.stream_id != index->stream_id ||
+			be64toh(index->content_size) !=
+				(uint64_t) subbuf_size * CHAR_BIT) {
+		goto unsupported;
+	}
+
+	DBG("Decoding packet contexts of stream %s from its sub-buffers",
+			stream->name);
+	stream->packet_layout = CONSUMER_PACKET_LAYOUT_KERNEL;
+	goto end;
+
+unsupported:
+	DBG("Unknown packet context layout for stream %s, using the tracer "
+			"to get its packet indexes", stream->name);
+end:
+	return ret;
+}
+
+/*
+ * Get the index values of the current sub-buffer of a data stream.
+ *
+ * For the MMAP output, the values are decoded from the packet context at the
+ * beginning of the sub-buffer rather than queried with six ioctls. The layout
+ * of the packet context is validated on the first packet of the stream; the
+ * ioctls are used when it is unknown.
+ *
+ * Return 0 on success or else a negative value.
+ */
+static int get_index_values(struct lttng_consumer_stream *stream,
+		struct ctf_packet_index *index, unsigned long padded_len,
+		unsigned long mmap_offset)
+{
+	int ret;
+
+	switch (stream->packet_layout) {
+	case CONSUMER_PACKET_LAYOUT_UNCHECKED:
+		ret = check_packet_layout(stream, index, padded_len,
+				mmap_offset);
+		break;
+	case CONSUMER_PACKET_LAYOUT_KERNEL:
+		ret = get_index_values_mmap(stream, index, padded_len,
+				mmap_offset);
+		if (ret <= 0) {
+			break;
+		}
+		WARN("Unexpected packet context in stream %s, using the tracer "
+				"to get its packet indexes", stream->name);
+		stream->packet_layout = CONSUMER_PACKET_LAYOUT_UNSUPPORTED;
+		/* Fall-through. */
+	case CONSUMER_PACKET_LAYOUT_UNSUPPORTED:
+	default:
+		ret = get_index_values_ioctl(index, stream->wait_fd);
+		break;
+	}
+
+	return ret;
+}
+
 /*
  * Sync metadata meaning request them to the session daemon and snapshot to the
  * metadata thread can consumer them.
@@ -1057,7 +1284,7 @@ end:
 ssize_t lttng_kconsumer_read_subbuffer(struct lttng_consumer_stream *stream,
 		struct lttng_consumer_local_data *ctx)
 {
-	unsigned long len, subbuf_size, padding;
+	unsigned long len, subbuf_size, padding, mmap_offset = 0;
 	int err, write_index = 1;
 	ssize_t ret = 0;
 	int infd = stream->wait_fd;
@@ -1065,6 +1292,20 @@ ssize_t lttng_kconsumer_read_subbuffer(struct lttng_consumer_stream *stream,
 
 	DBG("In read_subbuffer (infd : %d)", infd);
 
+	/*
+	 * The previous sub-buffer may still be in use by a zero-copy send, the
+	 * data thread reads the stream again once it is released.
+	 */
+	if (stream->zerocopy_pending) {
+		ret = consumer_stream_release_zerocopy(stream, 0);
+		if (ret < 0) {
+			goto end;
+		} else if (ret == 0) {
+			ret = -EAGAIN;
+			goto end;
+		}
+	}
+
 	/* Get the next subbuffer */
 	err = kernctl_get_next_subbuf(infd);
 	if (err != 0) {
@@ -1099,8 +1340,23 @@ ssize_t lttng_kconsumer_read_subbuffer(struct lttng_consumer_stream *stream,
 		goto end;
 	}
 
+	/* Read once for both the index values and the write of the data. */
+	if (stream->chan->output == CONSUMER_CHANNEL_MMAP) {
+		err = kernctl_get_mmap_read_offset(infd, &mmap_offset);
+		if (err != 0) {
+			ret = -errno;
+			PERROR("kernctl_get_mmap_read_offset");
+			err = kernctl_put_subbuf(infd);
+			if (err != 0) {
+				PERROR("Error in unreserving sub buffer\n");
+				ret = -errno;
+			}
+			goto end;
+		}
+	}
+
 	if (!stream->metadata_flag) {
-		ret = get_index_values(&index, infd);
+		ret = get_index_values(stream, &index, len, mmap_offset);
 		if (ret < 0) {
 			err = kernctl_put_subbuf(infd);
 			if (err != 0) {
@@ -1147,8 +1403,16 @@ ssize_t lttng_kconsumer_read_subbuffer(struct lttng_consumer_stream *stream,
 		}
 		break;
 	case CONSUMER_CHANNEL_MMAP:
-		/* Get subbuffer size without padding */
-		err = kernctl_get_subbuf_size(infd, &subbuf_size);
+		/*
+		 * Get subbuffer size without padding. It is the content size of
+		 * the packet when its context was decoded.
+		 */
+		if (stream->packet_layout == CONSUMER_PACKET_LAYOUT_KERNEL) {
+			subbuf_size = be64toh(index.content_size) / CHAR_BIT;
+			err = 0;
+		} else {
+			err = kernctl_get_subbuf_size(infd, &subbuf_size);
+		}
 		if (err != 0) {
 			PERROR("Getting sub-buffer len failed.");
 			err = kernctl_put_subbuf(infd);
@@ -1173,7 +1437,7 @@ ssize_t lttng_kconsumer_read_subbuffer(struct lttng_consumer_stream *stream,
 
 		/* write the subbuffer to the tracefile */
 		ret = lttng_consumer_on_read_subbuffer_mmap(ctx, stream, subbuf_size,
-				padding, &index);
+				padding, mmap_offset, &index);
 		/*
 		 * The mmap operation should write subbuf_size amount of data when
 		 * network streaming or the full padding (len) size when we are _not_
@@ -1197,16 +1461,22 @@ ssize_t lttng_kconsumer_read_subbuffer(struct lttng_consumer_stream *stream,
 		ret = -EPERM;
 	}
 
-	err = kernctl_put_next_subbuf(infd);
-	if (err != 0) {
-		if (errno == EFAULT) {
-			PERROR("Error in unreserving sub buffer\n");
-		} else if (errno == EIO) {
-			/* Should never happen with newer LTTng versions */
-			PERROR("Reader has been pushed by the writer, last sub-buffer corrupted.");
+	/*
+	 * A sub-buffer sent with zero-copy is released by the data thread once
+	 * the send completes.
+	 */
+	if (!stream->zerocopy_pending) {
+		err = kernctl_put_next_subbuf(infd);
+		if (err != 0) {
+			if (errno == EFAULT) {
+				PERROR("Error in unreserving sub buffer\n");
+			} else if (errno == EIO) {
+				/* Should never happen with newer LTTng versions */
+				PERROR("Reader has been pushed by the writer, last sub-buffer corrupted.");
+			}
+			ret = -errno;
+			goto end;
 		}
-		ret = -errno;
-		goto end;
 	}
 
 	/* Write index if needed. */
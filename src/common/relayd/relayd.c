@@ -21,6 +21,12 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#ifdef __linux__
+#include <linux/errqueue.h>
+#endif
 #include <inttypes.h>
 
 #include <common/common.h>
@@ -31,6 +37,17 @@
 
 #include "relayd.h"
 
+#if defined(SO_ZEROCOPY) && defined(MSG_ZEROCOPY) && defined(SO_EE_ORIGIN_ZEROCOPY)
+#define RELAYD_HAVE_ZEROCOPY
+#endif
+
+/*
+ * Number of consecutive zero-copy sends the kernel has to fall back on copying
+ * (e.g. loopback or a device without scatter-gather) before zero-copy is
+ * disabled on a socket.
+ */
+#define RELAYD_ZEROCOPY_MAX_COPIED	16
+
 /*
  * Send command. Fill up the header and append the data.
  */
@@ -579,6 +596,253 @@ error:
 	return ret;
 }
 
+/*
+ * Enable zero-copy transmission on a relayd data socket. The data given to
+ * relayd_send_data() is then not copied to the socket buffer and must be kept
+ * until the kernel is done with it, see relayd_zerocopy_completed().
+ *
+ * Return 0 on success else a negative value if the kernel does not support it.
+ */
+int relayd_enable_zerocopy(struct lttcomm_relayd_sock *rsock,
+		struct relayd_zerocopy *zerocopy)
+{
+	int ret;
+
+	/* Code flow error. Safety net. */
+	assert(rsock);
+	assert(zerocopy);
+
+	memset(zerocopy, 0, sizeof(*zerocopy));
+
+#ifdef RELAYD_HAVE_ZEROCOPY
+	{
+		int val = 1;
+
+		ret = setsockopt(rsock->sock.fd, SOL_SOCKET, SO_ZEROCOPY, &val,
+				sizeof(val));
+		if (ret < 0) {
+			ret = -errno;
+			DBG("Relayd socket %d does not support zero-copy: %s",
+					rsock->sock.fd, strerror(errno));
+			goto end;
+		}
+		zerocopy->enabled = 1;
+		DBG("Zero-copy enabled on relayd socket %d", rsock->sock.fd);
+	}
+#else
+	ret = -ENOTSUP;
+	DBG("Zero-copy transmission not supported by this build");
+	goto end;
+#endif /* RELAYD_HAVE_ZEROCOPY */
+
+end:
+	return ret;
+}
+
+/*
+ * Check whether the kernel completed the zero-copy sends issued on a socket up
+ * to seq, the value of zerocopy->nb_sent right after the last send of
+ * interest, after which their data can be reused. The completions are read
+ * from the error queue of the socket, TCP reporting them in order. This never
+ * blocks, the caller checks again later if the sends are in progress.
+ *
+ * The lock of the socket MUST be held.
+ *
+ * Return 1 if the sends are completed, 0 if they are still in progress or -1
+ * with errno set on error, in which case the data may still be in use and the
+ * socket must be aborted with relayd_zerocopy_abort() before reusing it.
+ */
+int relayd_zerocopy_completed(struct lttcomm_relayd_sock *rsock,
+		struct relayd_zerocopy *zerocopy, uint32_t seq)
+{
+#ifdef RELAYD_HAVE_ZEROCOPY
+	int ret;
+
+	/* Code flow error. Safety net. */
+	assert(rsock);
+	assert(zerocopy);
+
+	if (rsock->sock.fd < 0) {
+		errno = ECONNRESET;
+		return -1;
+	}
+
+	while ((int32_t) (zerocopy->nb_completed - seq) < 0) {
+		char control[CMSG_SPACE(sizeof(struct sock_extended_err) +
+				sizeof(struct sockaddr_in6))];
+		struct msghdr msg;
+		struct cmsghdr *cmsg;
+
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_control = control;
+		msg.msg_controllen = sizeof(control);
+
+		/* Reading the error queue never blocks. */
+		ret = recvmsg(rsock->sock.fd, &msg, MSG_ERRQUEUE);
+		if (ret < 0) {
+			if (errno == EINTR) {
+				continue;
+			} else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+				PERROR("recvmsg relayd zero-copy completion");
+				return -1;
+			}
+			return 0;
+		}
+
+		for (cmsg = CMSG_FIRSTHDR(&msg); cmsg;
+				cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+			struct sock_extended_err *serr;
+
+			if (!(cmsg->cmsg_level == SOL_IP &&
+					cmsg->cmsg_type == IP_RECVERR) &&
+					!(cmsg->cmsg_level == SOL_IPV6 &&
+					cmsg->cmsg_type == IPV6_RECVERR)) {
+				continue;
+			}
+
+			serr = (struct sock_extended_err *) CMSG_DATA(cmsg);
+			if (serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY) {
+				errno = serr->ee_errno;
+				PERROR("relayd socket error");
+				return -1;
+			}
+
+			/* Range [ee_info, ee_data] of completed sends. */
+			zerocopy->nb_completed += serr->ee_data - serr->ee_info + 1;
+			if (serr->ee_code & SO_EE_CODE_ZEROCOPY_COPIED) {
+				zerocopy->nb_copied++;
+			} else {
+				zerocopy->nb_copied = 0;
+			}
+		}
+
+		/* The kernel keeps copying the data, stop paying for pinning. */
+		if (zerocopy->enabled &&
+				zerocopy->nb_copied >= RELAYD_ZEROCOPY_MAX_COPIED) {
+			DBG("Relayd socket %d data always copied, disabling zero-copy",
+					rsock->sock.fd);
+			zerocopy->enabled = 0;
+		}
+	}
+#endif /* RELAYD_HAVE_ZEROCOPY */
+
+	return 1;
+}
+
+/*
+ * Reset the connection of a relayd socket whose zero-copy sends are not known
+ * to be completed, and close it. Resetting discards the data still queued so
+ * the relayd never receives data overwritten once it is reused.
+ *
+ * The lock of the socket MUST be held.
+ */
+void relayd_zerocopy_abort(struct lttcomm_relayd_sock *rsock)
+{
+	int ret;
+	struct linger linger;
+
+	/* Code flow error. Safety net. */
+	assert(rsock);
+
+	if (rsock->sock.fd < 0) {
+		return;
+	}
+
+	DBG("Resetting relayd socket %d with zero-copy sends in progress",
+			rsock->sock.fd);
+
+	linger.l_onoff = 1;
+	linger.l_linger = 0;
+	ret = setsockopt(rsock->sock.fd, SOL_SOCKET, SO_LINGER, &linger,
+			sizeof(linger));
+	if (ret < 0) {
+		PERROR("setsockopt SO_LINGER relayd socket");
+	}
+	(void) relayd_close(rsock);
+}
+
+/*
+ * Send data header structure immediately followed by the data of size len to
+ * the relayd. Both are sent with a single vectored send unless the socket
+ * only accepts part of them. The data is sent without being copied if
+ * zero-copy is enabled in zerocopy, which can be NULL. In that case, the header
+ * and the data must be left untouched until relayd_zerocopy_completed()
+ * reports the completion of zerocopy->nb_sent as of the return of this call.
+ *
+ * Return the number of data bytes sent or -1 with errno set on error.
+ */
+ssize_t relayd_send_data(struct lttcomm_relayd_sock *rsock,
+		struct lttcomm_relayd_data_hdr *hdr, const void *buf, size_t len,
+		struct relayd_zerocopy *zerocopy)
+{
+	ssize_t ret;
+	size_t left, iovcnt;
+	struct iovec iov[2], *cur_iov;
+	int flags = 0;
+
+	/* Code flow error. Safety net. */
+	assert(rsock);
+	assert(hdr);
+
+	if (rsock->sock.fd < 0) {
+		errno = ECONNRESET;
+		return -1;
+	}
+
+	DBG3("Relayd sending data header and %zu bytes of data", len);
+
+	iov[0].iov_base = hdr;
+	iov[0].iov_len = sizeof(*hdr);
+	iov[1].iov_base = (void *) buf;
+	iov[1].iov_len = len;
+
+	cur_iov = iov;
+	iovcnt = 2;
+
+#ifdef RELAYD_HAVE_ZEROCOPY
+	if (zerocopy && zerocopy->enabled) {
+		flags = MSG_ZEROCOPY;
+	}
+#endif /* RELAYD_HAVE_ZEROCOPY */
+
+	left = sizeof(*hdr) + len;
+	while (left > 0) {
+		ret = rsock->sock.ops->sendmsg_iov(&rsock->sock, cur_iov, iovcnt,
+				flags);
+		if (ret < 0) {
+#ifdef RELAYD_HAVE_ZEROCOPY
+			/* Out of pinned memory for zero-copy, fall back on copying. */
+			if (errno == ENOBUFS && flags == MSG_ZEROCOPY) {
+				flags = 0;
+				continue;
+			}
+#endif /* RELAYD_HAVE_ZEROCOPY */
+			return -1;
+		}
+#ifdef RELAYD_HAVE_ZEROCOPY
+		if (flags == MSG_ZEROCOPY) {
+			zerocopy->nb_sent++;
+		}
+#endif /* RELAYD_HAVE_ZEROCOPY */
+		left -= ret;
+
+		/* Skip what was sent in case of a partial send. */
+		while (ret > 0) {
+			if ((size_t) ret >= cur_iov->iov_len) {
+				ret -= cur_iov->iov_len;
+				cur_iov++;
+				iovcnt--;
+			} else {
+				cur_iov->iov_base = (char *) cur_iov->iov_base + ret;
+				cur_iov->iov_len -= ret;
+				ret = 0;
+			}
+		}
+	}
+
+	return len;
+}
+
 /*
  * Send close stream command to the relayd.
  */
@@ -877,3 +1141,72 @@ int relayd_send_index(struct lttcomm_relayd_sock *rsock,
 error:
 	return ret;
 }
+
+/*
+ * Send the live beacons of a set of idle streams to the relayd in a single
+ * command. The beacon values must already be in big endian. A relayd older
+ * than 2.8 gets one empty index per stream instead.
+ */
+int relayd_send_beacons(struct lttcomm_relayd_sock *rsock,
+		struct lttcomm_relayd_beacons *beacons, uint32_t count)
+{
+	int ret;
+	uint32_t i;
+	struct lttcomm_relayd_generic_reply reply;
+
+	/* Code flow error. Safety net. */
+	assert(rsock);
+	assert(beacons);
+
+	if (count == 0) {
+		ret = 0;
+		goto error;
+	}
+
+	if (rsock->minor < 8) {
+		for (i = 0; i < count; i++) {
+			struct ctf_packet_index index;
+
+			memset(&index, 0, sizeof(index));
+			index.timestamp_end = beacons->beacons[i].timestamp_end;
+			index.stream_id = beacons->beacons[i].stream_id;
+			ret = relayd_send_index(rsock, &index,
+					be64toh(beacons->beacons[i].relay_stream_id), 0);
+			if (ret < 0) {
+				goto error;
+			}
+		}
+		ret = 0;
+		goto error;
+	}
+
+	DBG("Relayd sending %" PRIu32 " live beacons", count);
+
+	beacons->count = htobe32(count);
+
+	/* Send command */
+	ret = send_command(rsock, RELAYD_SEND_BEACONS, beacons,
+			sizeof(*beacons) + count * sizeof(beacons->beacons[0]), 0);
+	if (ret < 0) {
+		goto error;
+	}
+
+	/* Receive response */
+	ret = recv_reply(rsock, (void *) &reply, sizeof(reply));
+	if (ret < 0) {
+		goto error;
+	}
+
+	reply.ret_code = be32toh(reply.ret_code);
+
+	if (reply.ret_code != LTTNG_OK) {
+		ret = -1;
+		ERR("Relayd send beacons replied error %d", reply.ret_code);
+	} else {
+		/* Success */
+		ret = 0;
+	}
+
+error:
+	return ret;
+}
@@ -23,6 +23,24 @@
 #include <common/sessiond-comm/relayd.h>
 #include <common/sessiond-comm/sessiond-comm.h>
 
+/*
+ * Zero-copy transmission state of a relayd data socket. Must be accessed with
+ * the lock of the socket held.
+ */
+struct relayd_zerocopy {
+	/* Sends use MSG_ZEROCOPY. */
+	unsigned int enabled:1;
+	/*
+	 * Number of zero-copy sends issued on the socket. Its value right after
+	 * a send is the sequence to give to relayd_zerocopy_completed().
+	 */
+	uint32_t nb_sent;
+	/* Number of zero-copy sends the kernel reported as completed. */
+	uint32_t nb_completed;
+	/* Number of consecutive sends for which the kernel copied the data. */
+	unsigned int nb_copied;
+};
+
 int relayd_connect(struct lttcomm_relayd_sock *sock);
 int relayd_close(struct lttcomm_relayd_sock *sock);
 int relayd_create_session(struct lttcomm_relayd_sock *sock, uint64_t *session_id,
@@ -39,6 +57,14 @@ int relayd_start_data(struct lttcomm_relayd_sock *sock);
 int relayd_send_metadata(struct lttcomm_relayd_sock *sock, size_t len);
 int relayd_send_data_hdr(struct lttcomm_relayd_sock *sock,
 		struct lttcomm_relayd_data_hdr *hdr, size_t size);
+ssize_t relayd_send_data(struct lttcomm_relayd_sock *rsock,
+		struct lttcomm_relayd_data_hdr *hdr, const void *buf, size_t len,
+		struct relayd_zerocopy *zerocopy);
+int relayd_enable_zerocopy(struct lttcomm_relayd_sock *rsock,
+		struct relayd_zerocopy *zerocopy);
+int relayd_zerocopy_completed(struct lttcomm_relayd_sock *rsock,
+		struct relayd_zerocopy *zerocopy, uint32_t seq);
+void relayd_zerocopy_abort(struct lttcomm_relayd_sock *rsock);
 int relayd_data_pending(struct lttcomm_relayd_sock *sock, uint64_t stream_id,
 		uint64_t last_net_seq_num);
 int relayd_quiescent_control(struct lttcomm_relayd_sock *sock,
@@ -49,5 +75,7 @@ int relayd_end_data_pending(struct lttcomm_relayd_sock *sock, uint64_t id,
 int relayd_send_index(struct lttcomm_relayd_sock *rsock,
 		struct ctf_packet_index *index, uint64_t relay_stream_id,
 		uint64_t net_seq_num);
+int relayd_send_beacons(struct lttcomm_relayd_sock *rsock,
+		struct lttcomm_relayd_beacons *beacons, uint32_t count);
 
 #endif /* _RELAYD_H */
@@ -48,6 +48,7 @@ static const struct lttcomm_proto_ops inet_ops = {
 	.listen = lttcomm_listen_inet_sock,
 	.recvmsg = lttcomm_recvmsg_inet_sock,
 	.sendmsg = lttcomm_sendmsg_inet_sock,
+	.sendmsg_iov = lttcomm_sendmsg_iov_inet_sock,
 };
 
 unsigned long lttcomm_inet_tcp_timeout;
@@ -436,9 +437,12 @@ ssize_t lttcomm_sendmsg_inet_sock(struct lttcomm_sock *sock, const void *buf,
 	if (ret < 0) {
 		/*
 		 * Only warn about EPIPE when quiet mode is deactivated.
-		 * We consider EPIPE as expected.
+		 * We consider EPIPE as expected. A full socket is expected by
+		 * non-blocking callers.
 		 */
-		if (errno != EPIPE || !lttng_opt_quiet) {
+		if ((errno != EPIPE || !lttng_opt_quiet) &&
+				!((flags & MSG_DONTWAIT) &&
+				(errno == EAGAIN || errno == EWOULDBLOCK))) {
 			PERROR("sendmsg inet");
 		}
 	}
@@ -446,6 +450,49 @@ ssize_t lttcomm_sendmsg_inet_sock(struct lttcomm_sock *sock, const void *buf,
 	return ret;
 }
 
+/*
+ * Send the iovcnt buffers of iov with a single sendmsg call. Unlike
+ * lttcomm_sendmsg_inet_sock(), a partial send is returned as is to the caller.
+ *
+ * Return the size of sent data.
+ */
+LTTNG_HIDDEN
+ssize_t lttcomm_sendmsg_iov_inet_sock(struct lttcomm_sock *sock,
+		const struct iovec *iov, size_t iovcnt, int flags)
+{
+	struct msghdr msg;
+	ssize_t ret = -1;
+
+	memset(&msg, 0, sizeof(msg));
+
+	msg.msg_iov = (struct iovec *) iov;
+	msg.msg_iovlen = iovcnt;
+
+	switch (sock->proto) {
+	case LTTCOMM_SOCK_UDP:
+		msg.msg_name = (struct sockaddr *) &sock->sockaddr.addr.sin;
+		msg.msg_namelen = sizeof(sock->sockaddr.addr.sin);
+		break;
+	default:
+		break;
+	}
+
+	do {
+		ret = sendmsg(sock->fd, &msg, flags);
+	} while (ret < 0 && errno == EINTR);
+	if (ret < 0) {
+		/*
+		 * Same as above for EPIPE. ENOBUFS is handled by the caller
+		 * when the kernel runs out of memory for a zero-copy send.
+		 */
+		if (errno != ENOBUFS && (errno != EPIPE || !lttng_opt_quiet)) {
+			PERROR("sendmsg iov inet");
+		}
+	}
+
+	return ret;
+}
+
 /*
  * Shutdown cleanly and close.
  */
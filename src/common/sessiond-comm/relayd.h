@@ -161,6 +161,24 @@ struct lttcomm_relayd_index {
 	uint64_t stream_id;
 } LTTNG_PACKED;
 
+/*
+ * Live beacon of an idle stream: its inactivity timestamp.
+ */
+struct lttcomm_relayd_beacon {
+	uint64_t relay_stream_id;
+	uint64_t timestamp_end;
+	uint64_t stream_id;
+} LTTNG_PACKED;
+
+/*
+ * Batch of live beacons, sent once per live timer tick for all the idle
+ * streams of a channel.
+ */
+struct lttcomm_relayd_beacons {
+	uint32_t count;
+	struct lttcomm_relayd_beacon beacons[];
+} LTTNG_PACKED;
+
 /*
  * Create session in 2.4 adds additionnal parameters for live reading.
  */
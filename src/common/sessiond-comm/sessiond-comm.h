@@ -94,6 +94,9 @@ enum lttcomm_sessiond_command {
 	LTTNG_UNTRACK_PID                   = 33,
 	LTTNG_LIST_TRACKER_PIDS             = 34,
 	LTTNG_SET_SESSION_SHM_PATH          = 40,
+	LTTNG_WAIT_DATA_PENDING             = 41,
+	LTTNG_BEGIN_SESSION_UPDATE          = 42,
+	LTTNG_END_SESSION_UPDATE            = 43,
 };
 
 enum lttcomm_relayd_command {
@@ -115,6 +118,8 @@ enum lttcomm_relayd_command {
 	RELAYD_LIST_SESSIONS                = 15,
 	/* All streams of the channel have been sent to the relayd (2.4+). */
 	RELAYD_STREAMS_SENT                 = 16,
+	/* Live beacons of all the idle streams of a channel (2.8+). */
+	RELAYD_SEND_BEACONS                 = 17,
 };
 
 /*
@@ -220,6 +225,8 @@ struct lttcomm_proto_ops {
 			int flags);
 	ssize_t (*sendmsg) (struct lttcomm_sock *sock, const void *buf,
 			size_t len, int flags);
+	ssize_t (*sendmsg_iov) (struct lttcomm_sock *sock,
+			const struct iovec *iov, size_t iovcnt, int flags);
 };
 
 /*
@@ -343,6 +350,10 @@ struct lttng_event_exclusion {
 
 /*
  * Data structure for the response from sessiond to the lttng client.
+ *
+ * The session daemon keeps the client connection open after replying to a
+ * successful command so the client can send its next commands on it, which
+ * are answered in order. The connection is closed after a failed command.
  */
 struct lttcomm_lttng_msg {
 	uint32_t cmd_type;	/* enum lttcomm_sessiond_command */
@@ -214,13 +214,13 @@ static int send_stream_to_thread(struct lttng_consumer_stream *stream,
 		}
 		stream_pipe = ctx->consumer_metadata_pipe;
 	} else {
-		ret = consumer_add_data_stream(stream);
+		ret = consumer_add_data_stream(ctx, stream);
 		if (ret) {
 			ERR("Consumer add stream %" PRIu64 " failed.",
 					stream->key);
 			goto error;
 		}
-		stream_pipe = ctx->consumer_data_pipe;
+		stream_pipe = stream->data_thread->data_pipe;
 	}
 
 	/*
@@ -996,9 +996,97 @@ error:
 	return ret;
 }
 
+/*
+ * Copy the sub-buffers of a stream between its snapshot positions and close
+ * it so it can be used on the next snapshot. Called with the stream lock
+ * held, possibly from a snapshot copy thread.
+ *
+ * Returns 0 on success, < 0 on error
+ */
+static int snapshot_copy_stream(struct lttng_consumer_stream *stream,
+		struct lttng_consumer_local_data *ctx)
+{
+	int ret;
+	unsigned long consumed_pos = stream->snapshot_consumed_pos;
+
+	while (consumed_pos < stream->snapshot_produced_pos) {
+		ssize_t read_len;
+		unsigned long len, padded_len, mmap_offset;
+
+		health_code_update();
+
+		DBG("UST consumer taking snapshot at pos %lu", consumed_pos);
+
+		ret = ustctl_get_subbuf(stream->ustream, &consumed_pos);
+		if (ret < 0) {
+			if (ret != -EAGAIN) {
+				PERROR("ustctl_get_subbuf snapshot");
+				goto end;
+			}
+			DBG("UST consumer get subbuf failed. Skipping it.");
+			consumed_pos += stream->max_sb_size;
+			continue;
+		}
+
+		ret = ustctl_get_subbuf_size(stream->ustream, &len);
+		if (ret < 0) {
+			ERR("Snapshot ustctl_get_subbuf_size");
+			goto error_put_subbuf;
+		}
+
+		ret = ustctl_get_padded_subbuf_size(stream->ustream, &padded_len);
+		if (ret < 0) {
+			ERR("Snapshot ustctl_get_padded_subbuf_size");
+			goto error_put_subbuf;
+		}
+
+		ret = ustctl_get_mmap_read_offset(stream->ustream, &mmap_offset);
+		if (ret < 0) {
+			ERR("Snapshot ustctl_get_mmap_read_offset");
+			goto error_put_subbuf;
+		}
+
+		read_len = lttng_consumer_on_read_subbuffer_mmap(ctx, stream, len,
+				padded_len - len, mmap_offset, NULL);
+		if (stream->net_seq_idx != (uint64_t) -1ULL) {
+			if (read_len != len) {
+				ret = -EPERM;
+				goto error_put_subbuf;
+			}
+		} else {
+			if (read_len != padded_len) {
+				ret = -EPERM;
+				goto error_put_subbuf;
+			}
+		}
+
+		ret = ustctl_put_subbuf(stream->ustream);
+		if (ret < 0) {
+			ERR("Snapshot ustctl_put_subbuf");
+			goto end;
+		}
+		consumed_pos += stream->max_sb_size;
+	}
+	ret = 0;
+	goto end;
+
+error_put_subbuf:
+	if (ustctl_put_subbuf(stream->ustream) < 0) {
+		ERR("Snapshot ustctl_put_subbuf");
+	}
+end:
+	/* Simply close the stream so we can use it on the next snapshot. */
+	consumer_stream_close(stream);
+	return ret;
+}
+
 /*
  * Take a snapshot of all the stream of a channel.
  *
+ * The positions of every stream are taken first, back to back, so that the
+ * snapshot is as close as possible to a single point in time. The streams
+ * are then copied in parallel.
+ *
  * Returns 0 on success, < 0 on error
  */
 static int snapshot_channel(uint64_t key, char *path, uint64_t relayd_id,
@@ -1028,6 +1116,7 @@ static int snapshot_channel(uint64_t key, char *path, uint64_t relayd_id,
 	assert(!channel->monitor);
 	DBG("UST consumer snapshot channel %" PRIu64, key);
 
+	/* Set up the snapshot output of every stream. */
 	cds_list_for_each_entry(stream, &channel->streams.head, send_node) {
 
 		health_code_update();
@@ -1055,12 +1144,18 @@ static int snapshot_channel(uint64_t key, char *path, uint64_t relayd_id,
 			DBG("UST consumer snapshot stream %s/%s (%" PRIu64 ")", path,
 					stream->name, stream->key);
 		}
-		if (relayd_id != -1ULL) {
-			ret = consumer_send_relayd_streams_sent(relayd_id);
-			if (ret < 0) {
-				goto error_unlock;
-			}
+		pthread_mutex_unlock(&stream->lock);
+	}
+	if (use_relayd) {
+		ret = consumer_send_relayd_streams_sent(relayd_id);
+		if (ret < 0) {
+			goto error_close_streams;
 		}
+	}
+
+	/* Take the snapshot positions of every stream. */
+	cds_list_for_each_entry(stream, &channel->streams.head, send_node) {
+		pthread_mutex_lock(&stream->lock);
 
 		ustctl_flush_buffer(stream->ustream, 1);
 
@@ -1088,79 +1183,30 @@ static int snapshot_channel(uint64_t key, char *path, uint64_t relayd_id,
 		 * daemon should never send a maximum stream size that is lower than
 		 * subbuffer size.
 		 */
-		consumed_pos = consumer_get_consume_start_pos(consumed_pos,
-				produced_pos, nb_packets_per_stream,
+		stream->snapshot_consumed_pos = consumer_get_consume_start_pos(
+				consumed_pos, produced_pos, nb_packets_per_stream,
 				stream->max_sb_size);
-
-		while (consumed_pos < produced_pos) {
-			ssize_t read_len;
-			unsigned long len, padded_len;
-
-			health_code_update();
-
-			DBG("UST consumer taking snapshot at pos %lu", consumed_pos);
-
-			ret = ustctl_get_subbuf(stream->ustream, &consumed_pos);
-			if (ret < 0) {
-				if (ret != -EAGAIN) {
-					PERROR("ustctl_get_subbuf snapshot");
-					goto error_close_stream;
-				}
-				DBG("UST consumer get subbuf failed. Skipping it.");
-				consumed_pos += stream->max_sb_size;
-				continue;
-			}
-
-			ret = ustctl_get_subbuf_size(stream->ustream, &len);
-			if (ret < 0) {
-				ERR("Snapshot ustctl_get_subbuf_size");
-				goto error_put_subbuf;
-			}
-
-			ret = ustctl_get_padded_subbuf_size(stream->ustream, &padded_len);
-			if (ret < 0) {
-				ERR("Snapshot ustctl_get_padded_subbuf_size");
-				goto error_put_subbuf;
-			}
-
-			read_len = lttng_consumer_on_read_subbuffer_mmap(ctx, stream, len,
-					padded_len - len, NULL);
-			if (use_relayd) {
-				if (read_len != len) {
-					ret = -EPERM;
-					goto error_put_subbuf;
-				}
-			} else {
-				if (read_len != padded_len) {
-					ret = -EPERM;
-					goto error_put_subbuf;
-				}
-			}
-
-			ret = ustctl_put_subbuf(stream->ustream);
-			if (ret < 0) {
-				ERR("Snapshot ustctl_put_subbuf");
-				goto error_close_stream;
-			}
-			consumed_pos += stream->max_sb_size;
-		}
-
-		/* Simply close the stream so we can use it on the next snapshot. */
-		consumer_stream_close(stream);
+		stream->snapshot_produced_pos = produced_pos;
 		pthread_mutex_unlock(&stream->lock);
 	}
 
+	ret = consumer_snapshot_copy_streams(channel, ctx, snapshot_copy_stream);
+	if (ret < 0) {
+		goto error_close_streams;
+	}
+
 	rcu_read_unlock();
 	return 0;
 
-error_put_subbuf:
-	if (ustctl_put_subbuf(stream->ustream) < 0) {
-		ERR("Snapshot ustctl_put_subbuf");
-	}
-error_close_stream:
-	consumer_stream_close(stream);
 error_unlock:
 	pthread_mutex_unlock(&stream->lock);
+error_close_streams:
+	/* Release the outputs left open so the next snapshot can proceed. */
+	cds_list_for_each_entry(stream, &channel->streams.head, send_node) {
+		pthread_mutex_lock(&stream->lock);
+		consumer_stream_close(stream);
+		pthread_mutex_unlock(&stream->lock);
+	}
 error:
 	rcu_read_unlock();
 	return ret;
@@ -1820,6 +1866,17 @@ void lttng_ustconsumer_on_stream_hangup(struct lttng_consumer_stream *stream)
 	stream->hangup_flush_done = 1;
 }
 
+/*
+ * Release the sub-buffer of the stream acquired by the last read.
+ */
+int lttng_ustconsumer_put_next_subbuf(struct lttng_consumer_stream *stream)
+{
+	assert(stream);
+	assert(stream->ustream);
+
+	return ustctl_put_next_subbuf(stream->ustream);
+}
+
 void lttng_ustconsumer_del_channel(struct lttng_consumer_channel *chan)
 {
 	int i;
@@ -2086,17 +2143,18 @@ static int notify_if_more_data(struct lttng_consumer_stream *stream,
 	/* This stream still has data. Flag it and wake up the data thread. */
 	stream->has_data = 1;
 
-	if (stream->monitor && !stream->hangup_flush_done && !ctx->has_wakeup) {
+	if (stream->monitor && !stream->hangup_flush_done && stream->data_thread &&
+			!stream->data_thread->has_wakeup) {
 		ssize_t writelen;
 
-		writelen = lttng_pipe_write(ctx->consumer_wakeup_pipe, "!", 1);
+		writelen = lttng_pipe_write(stream->data_thread->wakeup_pipe, "!", 1);
 		if (writelen < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
 			ret = writelen;
 			goto end;
 		}
 
-		/* The wake up pipe has been notified. */
-		ctx->has_wakeup = 1;
+		/* The wake up pipe of the owning data thread has been notified. */
+		stream->data_thread->has_wakeup = 1;
 	}
 	ret = 0;
 
@@ -2114,7 +2172,7 @@ end:
 int lttng_ustconsumer_read_subbuffer(struct lttng_consumer_stream *stream,
 		struct lttng_consumer_local_data *ctx)
 {
-	unsigned long len, subbuf_size, padding;
+	unsigned long len, subbuf_size, padding, mmap_offset;
 	int err, write_index = 1;
 	long ret = 0;
 	struct ustctl_consumer_stream *ustream;
@@ -2151,6 +2209,20 @@ int lttng_ustconsumer_read_subbuffer(struct lttng_consumer_stream *stream,
 		}
 	}
 
+	/*
+	 * The previous sub-buffer may still be in use by a zero-copy send, the
+	 * data thread reads the stream again once it is released.
+	 */
+	if (stream->zerocopy_pending) {
+		ret = consumer_stream_release_zerocopy(stream, 0);
+		if (ret < 0) {
+			goto end;
+		} else if (ret == 0) {
+			ret = -EAGAIN;
+			goto end;
+		}
+	}
+
 retry:
 	/* Get the next subbuffer */
 	err = ustctl_get_next_subbuf(ustream);
@@ -2203,8 +2275,13 @@ retry:
 	assert(len >= subbuf_size);
 
 	padding = len - subbuf_size;
+
+	err = ustctl_get_mmap_read_offset(ustream, &mmap_offset);
+	assert(err == 0);
+
 	/* write the subbuffer to the tracefile */
-	ret = lttng_consumer_on_read_subbuffer_mmap(ctx, stream, subbuf_size, padding, &index);
+	ret = lttng_consumer_on_read_subbuffer_mmap(ctx, stream, subbuf_size,
+			padding, mmap_offset, &index);
 	/*
 	 * The mmap operation should write subbuf_size amount of data when network
 	 * streaming or the full padding (len) size when we are _not_ streaming.
@@ -2224,14 +2301,20 @@ retry:
 				ret, len, subbuf_size);
 		write_index = 0;
 	}
-	err = ustctl_put_next_subbuf(ustream);
-	assert(err == 0);
+	/*
+	 * A sub-buffer sent with zero-copy is released by the data thread once
+	 * the send completes. The stream is read again at that point.
+	 */
+	if (!stream->zerocopy_pending) {
+		err = ustctl_put_next_subbuf(ustream);
+		assert(err == 0);
+	}
 
 	/*
 	 * This will consumer the byte on the wait_fd if and only if there is not
 	 * next subbuffer to be acquired.
 	 */
-	if (!stream->metadata_flag) {
+	if (!stream->metadata_flag && !stream->zerocopy_pending) {
 		ret = notify_if_more_data(stream, ctx);
 		if (ret < 0) {
 			goto end;
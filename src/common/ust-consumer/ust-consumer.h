@@ -46,6 +46,7 @@ int lttng_ustconsumer_read_subbuffer(struct lttng_consumer_stream *stream,
 int lttng_ustconsumer_on_recv_stream(struct lttng_consumer_stream *stream);
 
 void lttng_ustconsumer_on_stream_hangup(struct lttng_consumer_stream *stream);
+int lttng_ustconsumer_put_next_subbuf(struct lttng_consumer_stream *stream);
 
 int lttng_ustctl_get_mmap_read_offset(struct lttng_consumer_stream *stream,
 		unsigned long *off);
@@ -153,6 +154,12 @@ void lttng_ustconsumer_on_stream_hangup(struct lttng_consumer_stream *stream)
 {
 }
 
+static inline
+int lttng_ustconsumer_put_next_subbuf(struct lttng_consumer_stream *stream)
+{
+	return -ENOSYS;
+}
+
 static inline
 int lttng_ustctl_get_mmap_read_offset(struct lttng_consumer_stream *stream,
 		unsigned long *off)
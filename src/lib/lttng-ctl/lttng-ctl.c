@@ -24,6 +24,7 @@
 #include <assert.h>
 #include <grp.h>
 #include <errno.h>
+#include <poll.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -65,6 +66,11 @@ static char sessiond_sock_path[PATH_MAX];
 /* Variables */
 static char *tracing_group;
 static int connected;
+/*
+ * Number of lttng_session_daemon_connect() calls not yet matched by
+ * lttng_session_daemon_disconnect(), keeping the connection open.
+ */
+static unsigned int persistent;
 
 /* Global */
 
@@ -340,6 +346,47 @@ error:
 	return -1;
 }
 
+/*
+ * Check if the persistent connection to the session daemon is still usable.
+ * Nothing is to be received on it between two commands, so it is readable only
+ * if the session daemon closed it.
+ *
+ * Return 1 if usable else 0.
+ */
+static int persistent_connection_alive(void)
+{
+	int ret;
+	struct pollfd pfd;
+
+	pfd.fd = sessiond_socket;
+	pfd.events = POLLIN | POLLPRI;
+	pfd.revents = 0;
+
+	do {
+		ret = poll(&pfd, 1, 0);
+	} while (ret < 0 && errno == EINTR);
+
+	return ret == 0;
+}
+
+/*
+ *  Clean disconnect from the session daemon.
+ *
+ *  On success, return 0. On error, return -1.
+ */
+static int disconnect_sessiond(void)
+{
+	int ret = 0;
+
+	if (connected) {
+		ret = lttcomm_close_unix_sock(sessiond_socket);
+		sessiond_socket = 0;
+		connected = 0;
+	}
+
+	return ret;
+}
+
 /*
  * Connect to the LTTng session daemon.
  *
@@ -351,7 +398,11 @@ static int connect_sessiond(void)
 
 	/* Don't try to connect if already connected. */
 	if (connected) {
-		return 0;
+		if (persistent_connection_alive()) {
+			return 0;
+		}
+		DBG("Session daemon closed the connection, reconnecting");
+		disconnect_sessiond();
 	}
 
 	ret = set_session_daemon_path();
@@ -374,24 +425,6 @@ error:
 	return -1;
 }
 
-/*
- *  Clean disconnect from the session daemon.
- *
- *  On success, return 0. On error, return -1.
- */
-static int disconnect_sessiond(void)
-{
-	int ret = 0;
-
-	if (connected) {
-		ret = lttcomm_close_unix_sock(sessiond_socket);
-		sessiond_socket = 0;
-		connected = 0;
-	}
-
-	return ret;
-}
-
 /*
  * Ask the session daemon a specific command and put the data into buf.
  * Takes extra var. len. data as input to send to the session daemon.
@@ -433,7 +466,10 @@ int lttng_ctl_ask_sessiond_varlen(struct lttcomm_session_msg *lsm,
 		goto end;
 	}
 
-	/* Check error code if OK */
+	/*
+	 * Check error code if OK. The payload is not received so the connection
+	 * can't be reused, the session daemon closes it anyway.
+	 */
 	if (llm.ret_code != LTTNG_OK) {
 		ret = -llm.ret_code;
 		goto end;
@@ -476,7 +512,9 @@ int lttng_ctl_ask_sessiond_varlen(struct lttcomm_session_msg *lsm,
 	ret = size;
 
 end:
-	disconnect_sessiond();
+	if (!persistent || ret < 0) {
+		disconnect_sessiond();
+	}
 	return ret;
 }
 
@@ -594,7 +632,22 @@ static int _lttng_stop_tracing(const char *session_name, int wait)
 		goto end;
 	}
 
-	/* Check for data availability */
+	/* Let the session daemon wait for the data to be available. */
+	memset(&lsm, 0, sizeof(lsm));
+	lsm.cmd_type = LTTNG_WAIT_DATA_PENDING;
+
+	lttng_ctl_copy_string(lsm.session.name, session_name,
+			sizeof(lsm.session.name));
+
+	data_ret = lttng_ctl_ask_sessiond(&lsm, NULL);
+	if (data_ret != -LTTNG_ERR_UND) {
+		if (data_ret < 0) {
+			ret = data_ret;
+		}
+		goto end;
+	}
+
+	/* Check for data availability, the session daemon can't wait for it. */
 	do {
 		data_ret = lttng_data_pending(session_name);
 		if (data_ret < 0) {
@@ -1583,6 +1636,47 @@ int lttng_set_session_shm_path(const char *session_name,
 	return lttng_ctl_ask_sessiond(&lsm, NULL);
 }
 
+/*
+ * Send a command without payload targeting a session.
+ */
+static int session_update_cmd(const char *session_name,
+		enum lttcomm_sessiond_command cmd_type)
+{
+	struct lttcomm_session_msg lsm;
+
+	if (session_name == NULL) {
+		return -LTTNG_ERR_INVALID;
+	}
+
+	memset(&lsm, 0, sizeof(lsm));
+	lsm.cmd_type = cmd_type;
+
+	lttng_ctl_copy_string(lsm.session.name, session_name,
+			sizeof(lsm.session.name));
+
+	return lttng_ctl_ask_sessiond(&lsm, NULL);
+}
+
+/*
+ * Begin a batch of updates of a session.
+ *
+ * Return 0 on success else a negative LTTng error code.
+ */
+int lttng_begin_session_update(const char *session_name)
+{
+	return session_update_cmd(session_name, LTTNG_BEGIN_SESSION_UPDATE);
+}
+
+/*
+ * End a batch of updates of a session.
+ *
+ * Return 0 on success else a negative LTTng error code.
+ */
+int lttng_end_session_update(const char *session_name)
+{
+	return session_update_cmd(session_name, LTTNG_END_SESSION_UPDATE);
+}
+
 /*
  * Ask the session daemon for all available domains of a session.
  * Sets the contents of the domains array.
@@ -1808,6 +1902,39 @@ int lttng_session_daemon_alive(void)
 	return 1;
 }
 
+/*
+ * Open a connection to the session daemon kept open for the following
+ * commands.
+ *
+ * Return 0 on success else a negative LTTng error code.
+ */
+int lttng_session_daemon_connect(void)
+{
+	int ret;
+
+	ret = connect_sessiond();
+	if (ret < 0) {
+		return -LTTNG_ERR_NO_SESSIOND;
+	}
+	persistent++;
+
+	return 0;
+}
+
+/*
+ * Close the connection opened by lttng_session_daemon_connect() if this call
+ * matches the first one.
+ */
+void lttng_session_daemon_disconnect(void)
+{
+	if (persistent > 0) {
+		persistent--;
+	}
+	if (!persistent) {
+		disconnect_sessiond();
+	}
+}
+
 /*
  * Set URL for a consumer for a session and domain.
  *
@@ -2111,5 +2238,7 @@ static void __attribute__((constructor)) init()
  */
 static void __attribute__((destructor)) lttng_ctl_exit()
 {
+	persistent = 0;
+	disconnect_sessiond();
 	free(tracing_group);
 }
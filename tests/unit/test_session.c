@@ -38,7 +38,7 @@
 #define RANDOM_STRING_LEN	11
 
 /* Number of TAP tests in this file */
-#define NUM_TESTS 11
+#define NUM_TESTS 12
 
 static struct ltt_session_list *session_list;
 
@@ -108,8 +108,7 @@ static void empty_session_list(void)
 	struct ltt_session *iter, *tmp;
 
 	cds_list_for_each_entry_safe(iter, tmp, &session_list->head, list) {
-		cds_list_del(&iter->list);
-		free(iter);
+		session_destroy(iter);
 	}
 
 	/* Session list must be 0 */
@@ -222,6 +221,9 @@ void test_validate_session(void)
 	   strlen(tmp->name),
 	   "Validating session: basic sanity check");
 
+	ok(session_find_by_id(tmp->id) == tmp,
+	   "Validating session: session found by id");
+
 	session_lock(tmp);
 	session_unlock(tmp);
 }